@@ -152,6 +152,7 @@ dctool_event_cb (dc_device_t *device, dc_event_type_t event, const void *data, v
 	const dc_event_devinfo_t *devinfo = (const dc_event_devinfo_t *) data;
 	const dc_event_clock_t *clock = (const dc_event_clock_t *) data;
 	const dc_event_vendor_t *vendor = (const dc_event_vendor_t *) data;
+	const dc_event_stats_t *stats = (const dc_event_stats_t *) data;
 
 	switch (event) {
 	case DC_EVENT_WAITING:
@@ -178,6 +179,21 @@ dctool_event_cb (dc_device_t *device, dc_event_type_t event, const void *data, v
 			message ("%02X", vendor->data[i]);
 		message ("\n");
 		break;
+	case DC_EVENT_STATS:
+		message ("Event: elapsed=%.3fs, callbacks=%.3fs (%u dives)\n",
+			stats->elapsed / 1000000.0, stats->callback_time / 1000000.0, stats->ndives);
+		message ("Event: in=%llu bytes (%u reads), out=%llu bytes (%u writes), blocks=%u (%llu bytes)\n",
+			stats->nbytes_in, stats->nreads, stats->nbytes_out, stats->nwrites,
+			stats->nblocks, stats->nbytes_blocks);
+		message ("Event: roundtrips=%u, latency avg=%.3fms, max=%.3fms, retries=%u, cancel checks=%u\n",
+			stats->nroundtrips,
+			stats->nroundtrips ? stats->latency_total / 1000.0 / stats->nroundtrips : 0.0,
+			stats->latency_max / 1000.0, stats->nretries, stats->ncancel);
+		message ("Event: latency histogram=");
+		for (unsigned int i = 0; i < DC_EVENT_STATS_LATENCY; ++i)
+			message ("%s%u", i ? "," : "", stats->latency[i]);
+		message ("\n");
+		break;
 	default:
 		break;
 	}
@@ -65,6 +65,7 @@ static const dctool_command_t *g_commands[] = {
 	&dctool_write,
 	&dctool_timesync,
 	&dctool_fwupdate,
+	&dctool_bench,
 	NULL
 };
 
@@ -52,6 +52,7 @@ extern const dctool_command_t dctool_read;
 extern const dctool_command_t dctool_write;
 extern const dctool_command_t dctool_timesync;
 extern const dctool_command_t dctool_fwupdate;
+extern const dctool_command_t dctool_bench;
 
 const dctool_command_t *
 dctool_command_find (const char *name);
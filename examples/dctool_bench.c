@@ -0,0 +1,285 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2017 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/descriptor.h>
+#include <libdivecomputer/device.h>
+#include <libdivecomputer/custom_io.h>
+#include <libdivecomputer/simulator.h>
+#include <libdivecomputer/shearwater_predator.h>
+#include <libdivecomputer/shearwater_petrel.h>
+#include <libdivecomputer/suunto_eonsteel.h>
+
+#include "dctool.h"
+#include "common.h"
+#include "utils.h"
+
+static int
+dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	unsigned int *ndives = (unsigned int *) userdata;
+
+	(*ndives)++;
+
+	return 1;
+}
+
+static dc_status_t
+bench (dc_context_t *context, dc_descriptor_t *descriptor, const char *devname, unsigned int window, unsigned int *ndives, dc_event_stats_t *stats)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_device_t *device = NULL;
+
+	// Open the device.
+	rc = dc_device_open (&device, context, descriptor, devname);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error opening the device.");
+		goto cleanup;
+	}
+
+	// Set the number of outstanding requests.
+	if (window) {
+		switch (dc_descriptor_get_type (descriptor)) {
+		case DC_FAMILY_SHEARWATER_PREDATOR:
+			rc = shearwater_predator_device_set_window (device, window);
+			break;
+		case DC_FAMILY_SHEARWATER_PETREL:
+			rc = shearwater_petrel_device_set_window (device, window);
+			break;
+		case DC_FAMILY_SUUNTO_EONSTEEL:
+			rc = suunto_eonsteel_device_set_window (device, window);
+			break;
+		default:
+			rc = DC_STATUS_UNSUPPORTED;
+			break;
+		}
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error setting the window.");
+			goto cleanup;
+		}
+	}
+
+	// Register the cancellation handler.
+	rc = dc_device_set_cancel (device, dctool_cancel_cb, NULL);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error registering the cancellation handler.");
+		goto cleanup;
+	}
+
+	// Download the dives.
+	*ndives = 0;
+	rc = dc_device_foreach (device, dive_cb, ndives);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error downloading the dives.");
+		goto cleanup;
+	}
+
+	rc = dc_device_get_stats (device, stats);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error retrieving the statistics.");
+		goto cleanup;
+	}
+
+cleanup:
+	dc_device_close (device);
+	return rc;
+}
+
+static int
+dctool_bench_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t *descriptor)
+{
+	int exitcode = EXIT_SUCCESS;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_custom_io_t *io = NULL;
+	dc_simulator_t *simulator = NULL;
+	dc_buffer_t *memory = NULL;
+	const char *devname = "replay";
+
+	// Default option values.
+	unsigned int help = 0;
+	unsigned int simulate = 0;
+	unsigned int iterations = 1;
+	unsigned int packet_latency = 0;
+	unsigned int byte_latency = 0;
+	unsigned int window = 0;
+
+	// Parse the command-line options.
+	int opt = 0;
+	const char *optstring = "hsn:l:b:w:";
+#ifdef HAVE_GETOPT_LONG
+	struct option options[] = {
+		{"help",         no_argument,       0, 'h'},
+		{"simulate",     no_argument,       0, 's'},
+		{"iterations",   required_argument, 0, 'n'},
+		{"latency",      required_argument, 0, 'l'},
+		{"byte-latency", required_argument, 0, 'b'},
+		{"window",       required_argument, 0, 'w'},
+		{0,              0,                 0,  0 }
+	};
+	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
+#else
+	while ((opt = getopt (argc, argv, optstring)) != -1) {
+#endif
+		switch (opt) {
+		case 'h':
+			help = 1;
+			break;
+		case 's':
+			simulate = 1;
+			break;
+		case 'n':
+			iterations = strtoul (optarg, NULL, 0);
+			break;
+		case 'l':
+			packet_latency = strtoul (optarg, NULL, 0);
+			break;
+		case 'b':
+			byte_latency = strtoul (optarg, NULL, 0);
+			break;
+		case 'w':
+			window = strtoul (optarg, NULL, 0);
+			break;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	// Show help message.
+	if (help) {
+		dctool_command_showhelp (&dctool_bench);
+		return EXIT_SUCCESS;
+	}
+
+	if (argc < 1) {
+		message ("ERROR: No %s specified.\n", simulate ? "memory dump" : "transcript");
+		return EXIT_FAILURE;
+	}
+
+	if (simulate) {
+		// Load the memory dump.
+		memory = dctool_file_read (argv[0]);
+		if (memory == NULL) {
+			message ("ERROR: Failed to read the memory dump.\n");
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+
+		// Start the simulator.
+		status = dc_simulator_new (&simulator, context, dc_descriptor_get_type (descriptor),
+			dc_buffer_get_data (memory), dc_buffer_get_size (memory));
+		if (status != DC_STATUS_SUCCESS) {
+			message ("ERROR: %s\n", dctool_errmsg (status));
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+
+		dc_simulator_set_latency (simulator, packet_latency, byte_latency);
+		devname = dc_simulator_get_name (simulator);
+	} else {
+		// Load the transcript.
+		status = dc_custom_io_replay_new (&io, context, argv[0], packet_latency, byte_latency);
+		if (status != DC_STATUS_SUCCESS) {
+			message ("ERROR: %s\n", dctool_errmsg (status));
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+
+		dc_context_set_custom_io (context, io, NULL);
+	}
+
+	unsigned long long total = 0, best = 0;
+	for (unsigned int i = 0; i < iterations; ++i) {
+		unsigned int ndives = 0;
+		dc_event_stats_t stats = {0};
+		status = bench (context, descriptor, devname, window, &ndives, &stats);
+		if (status != DC_STATUS_SUCCESS) {
+			message ("ERROR: %s\n", dctool_errmsg (status));
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+
+		double seconds = stats.elapsed / 1000000.0;
+		printf ("Run %u: %u dives, %llu bytes in, %llu bytes out, %u round-trips, %.3f s, %.1f KiB/s\n",
+			i + 1, ndives, stats.nbytes_in, stats.nbytes_out, stats.nroundtrips, seconds,
+			seconds > 0 ? stats.nbytes_in / 1024.0 / seconds : 0.0);
+
+		total += stats.elapsed;
+		if (i == 0 || stats.elapsed < best)
+			best = stats.elapsed;
+	}
+
+	if (iterations) {
+		printf ("Average: %.3f s, best: %.3f s\n",
+			total / 1000000.0 / iterations, best / 1000000.0);
+	}
+
+cleanup:
+	dc_simulator_free (simulator);
+	dc_buffer_free (memory);
+	dc_custom_io_replay_free (io);
+	return exitcode;
+}
+
+const dctool_command_t dctool_bench = {
+	dctool_bench_run,
+	DCTOOL_CONFIG_DESCRIPTOR,
+	"bench",
+	"Benchmark the download with a transcript or simulator",
+	"Usage:\n"
+	"   dctool bench [options] <transcript>\n"
+	"   dctool bench [options] -s <memory dump>\n"
+	"\n"
+	"The transcript is the logfile of a previous download with the\n"
+	"INFO loglevel (dctool -v -l <logfile> download ...). With the\n"
+	"simulate option, the device is simulated on top of a memory dump\n"
+	"(dctool dump -o <memory dump>) instead.\n"
+	"\n"
+	"Options:\n"
+#ifdef HAVE_GETOPT_LONG
+	"   -h, --help                 Show help message\n"
+	"   -s, --simulate             Simulate the device\n"
+	"   -n, --iterations <count>   Number of iterations\n"
+	"   -l, --latency <usecs>      Latency of each response\n"
+	"   -b, --byte-latency <usecs> Latency of each byte\n"
+	"   -w, --window <count>       Number of outstanding requests\n"
+#else
+	"   -h                 Show help message\n"
+	"   -s                 Simulate the device\n"
+	"   -n <count>         Number of iterations\n"
+	"   -l <usecs>         Latency of each response\n"
+	"   -b <usecs>         Latency of each byte\n"
+	"   -w <count>         Number of outstanding requests\n"
+#endif
+};
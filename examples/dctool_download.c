@@ -48,6 +48,7 @@ typedef struct event_data_t {
 
 typedef struct dive_data_t {
 	dc_device_t *device;
+	dc_parser_pool_t *pool;
 	dc_buffer_t **fingerprint;
 	unsigned int number;
 	dctool_output_t *output;
@@ -78,7 +79,7 @@ dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fing
 
 	// Create the parser.
 	message ("Creating the parser.\n");
-	rc = dc_parser_new (&parser, divedata->device);
+	rc = dc_parser_pool_acquire (divedata->pool, &parser, divedata->device);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR ("Error creating the parser.");
 		goto cleanup;
@@ -101,7 +102,8 @@ dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fing
 	}
 
 cleanup:
-	dc_parser_destroy (parser);
+	if (parser)
+		dc_parser_pool_release (divedata->pool, parser);
 	return 1;
 }
 
@@ -156,6 +158,7 @@ download (dc_context_t *context, dc_descriptor_t *descriptor, const char *devnam
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	dc_device_t *device = NULL;
+	dc_parser_pool_t *pool = NULL;
 	dc_buffer_t *ofingerprint = NULL;
 
 	// Open the device.
@@ -179,7 +182,7 @@ download (dc_context_t *context, dc_descriptor_t *descriptor, const char *devnam
 
 	// Register the event handler.
 	message ("Registering the event handler.\n");
-	int events = DC_EVENT_WAITING | DC_EVENT_PROGRESS | DC_EVENT_DEVINFO | DC_EVENT_CLOCK | DC_EVENT_VENDOR;
+	int events = DC_EVENT_WAITING | DC_EVENT_PROGRESS | DC_EVENT_DEVINFO | DC_EVENT_CLOCK | DC_EVENT_VENDOR | DC_EVENT_STATS;
 	rc = dc_device_set_events (device, events, event_cb, &eventdata);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR ("Error registering the event handler.");
@@ -194,6 +197,24 @@ download (dc_context_t *context, dc_descriptor_t *descriptor, const char *devnam
 		goto cleanup;
 	}
 
+	// Register the cache directory.
+	if (cachedir) {
+		message ("Registering the cache directory.\n");
+		rc = dc_device_set_cachedir (device, cachedir);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error registering the cache directory.");
+			goto cleanup;
+		}
+
+		// Skip all dives which are already present in the index.
+		message ("Enabling the fingerprint index.\n");
+		rc = dc_device_set_fingerprint_index (device, 1);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error enabling the fingerprint index.");
+			goto cleanup;
+		}
+	}
+
 	// Register the fingerprint data.
 	if (fingerprint) {
 		message ("Registering the fingerprint data.\n");
@@ -204,9 +225,17 @@ download (dc_context_t *context, dc_descriptor_t *descriptor, const char *devnam
 		}
 	}
 
+	// Create the parser pool.
+	rc = dc_parser_pool_new (&pool, context);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error creating the parser pool.");
+		goto cleanup;
+	}
+
 	// Initialize the dive data.
 	dive_data_t divedata = {0};
 	divedata.device = device;
+	divedata.pool = pool;
 	divedata.fingerprint = &ofingerprint;
 	divedata.number = 0;
 	divedata.output = output;
@@ -234,6 +263,7 @@ download (dc_context_t *context, dc_descriptor_t *descriptor, const char *devnam
 	}
 
 cleanup:
+	dc_parser_pool_free (pool);
 	dc_buffer_free (ofingerprint);
 	dc_device_close (device);
 	return rc;
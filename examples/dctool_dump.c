@@ -34,16 +34,18 @@
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/descriptor.h>
 #include <libdivecomputer/device.h>
+#include <libdivecomputer/image.h>
 
 #include "dctool.h"
 #include "common.h"
 #include "utils.h"
 
 static dc_status_t
-dump (dc_context_t *context, dc_descriptor_t *descriptor, const char *devname, dc_buffer_t *fingerprint, dc_buffer_t *buffer)
+dump (dc_context_t *context, dc_descriptor_t *descriptor, const char *devname, dc_buffer_t *fingerprint, dc_buffer_t *buffer, const char *imagename)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	dc_device_t *device = NULL;
+	dc_image_t *image = NULL;
 
 	// Open the device.
 	message ("Opening the device (%s %s, %s).\n",
@@ -83,16 +85,50 @@ dump (dc_context_t *context, dc_descriptor_t *descriptor, const char *devname, d
 		}
 	}
 
-	// Download the memory dump.
-	message ("Downloading the memory dump.\n");
-	rc = dc_device_dump (device, buffer);
-	if (rc != DC_STATUS_SUCCESS) {
-		ERROR ("Error downloading the memory dump.");
-		goto cleanup;
+	if (imagename) {
+		// Attach the image.
+		message ("Creating the image.\n");
+		rc = dc_image_new (&image, context);
+		if (rc == DC_STATUS_SUCCESS)
+			rc = dc_device_set_image (device, image);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error creating the image.");
+			goto cleanup;
+		}
+
+		// Download the dives, which also stores the memory dump.
+		message ("Downloading the dives.\n");
+		rc = dc_device_foreach (device, NULL, NULL);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error downloading the dives.");
+			goto cleanup;
+		}
+
+		// Write the image to disk.
+		message ("Writing the image (%u dives).\n", dc_image_get_count (image));
+		rc = dc_image_save (image, imagename);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error writing the image.");
+			goto cleanup;
+		}
+
+		const unsigned char *data = NULL;
+		unsigned int size = 0;
+		dc_image_get_memory (image, &data, &size);
+		dc_buffer_append (buffer, data, size);
+	} else {
+		// Download the memory dump.
+		message ("Downloading the memory dump.\n");
+		rc = dc_device_dump (device, buffer);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error downloading the memory dump.");
+			goto cleanup;
+		}
 	}
 
 cleanup:
 	dc_device_close (device);
+	dc_image_free (image);
 	return rc;
 }
 
@@ -108,15 +144,17 @@ dctool_dump_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 	unsigned int help = 0;
 	const char *fphex = NULL;
 	const char *filename = NULL;
+	const char *imagename = NULL;
 
 	// Parse the command-line options.
 	int opt = 0;
-	const char *optstring = "ho:p:";
+	const char *optstring = "ho:p:i:";
 #ifdef HAVE_GETOPT_LONG
 	struct option options[] = {
 		{"help",        no_argument,       0, 'h'},
 		{"output",      required_argument, 0, 'o'},
 		{"fingerprint", required_argument, 0, 'p'},
+		{"image",       required_argument, 0, 'i'},
 		{0,             0,                 0,  0 }
 	};
 	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
@@ -133,6 +171,9 @@ dctool_dump_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 		case 'p':
 			fphex = optarg;
 			break;
+		case 'i':
+			imagename = optarg;
+			break;
 		default:
 			return EXIT_FAILURE;
 		}
@@ -154,7 +195,7 @@ dctool_dump_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 	buffer = dc_buffer_new (0);
 
 	// Download the memory dump.
-	status = dump (context, descriptor, argv[0], fingerprint, buffer);
+	status = dump (context, descriptor, argv[0], fingerprint, buffer, imagename);
 	if (status != DC_STATUS_SUCCESS) {
 		message ("ERROR: %s\n", dctool_errmsg (status));
 		exitcode = EXIT_FAILURE;
@@ -162,7 +203,9 @@ dctool_dump_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 	}
 
 	// Write the memory dump to disk.
-	dctool_file_write (filename, buffer);
+	if (filename || imagename == NULL) {
+		dctool_file_write (filename, buffer);
+	}
 
 cleanup:
 	dc_buffer_free (buffer);
@@ -183,9 +226,11 @@ const dctool_command_t dctool_dump = {
 	"   -h, --help                 Show help message\n"
 	"   -o, --output <filename>    Output filename\n"
 	"   -p, --fingerprint <data>   Fingerprint data (hexadecimal)\n"
+	"   -i, --image <filename>     Image filename (with dive index)\n"
 #else
 	"   -h                 Show help message\n"
 	"   -o <filename>      Output filename\n"
 	"   -p <fingerprint>   Fingerprint data (hexadecimal)\n"
+	"   -i <filename>      Image filename (with dive index)\n"
 #endif
 };
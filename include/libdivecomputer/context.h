@@ -54,12 +54,38 @@ dc_context_free (dc_context_t *context);
 dc_status_t
 dc_context_set_custom_io (dc_context_t *context, dc_custom_io_t *custom_io, dc_user_device_t *);
 
+/*
+ * Register the batched packet transfer functions of the custom IO.
+ *
+ * Registering a new custom IO with dc_context_set_custom_io removes
+ * the batched functions again, so they need to be registered after
+ * the custom IO. Either function can be NULL.
+ */
+dc_status_t
+dc_context_set_custom_packet_multi (dc_context_t *context, dc_custom_packet_read_multi_t read_multi, dc_custom_packet_write_multi_t write_multi);
+
 dc_status_t
 dc_context_set_loglevel (dc_context_t *context, dc_loglevel_t loglevel);
 
 dc_status_t
 dc_context_set_logfunc (dc_context_t *context, dc_logfunc_t logfunc, void *userdata);
 
+/*
+ * Enable deferred logging, with a log buffer of the specified size.
+ *
+ * Instead of formatting every message and passing it to the log
+ * function immediately, a compact binary record is stored in the log
+ * buffer. The messages are formatted and passed to the log function
+ * when the buffer is drained with dc_context_drain_log, in the thread
+ * that drains the buffer. Messages which do not fit in the buffer are
+ * dropped and counted. A size of zero disables the log buffer again.
+ */
+dc_status_t
+dc_context_set_logbuffer (dc_context_t *context, size_t size);
+
+dc_status_t
+dc_context_drain_log (dc_context_t *context);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -12,6 +12,18 @@ extern "C" {
 struct dc_context_t;
 struct dc_user_device_t;
 
+/*
+ * A single packet for the batched packet transfer functions.
+ *
+ * For reading, 'size' contains the size of the buffer, and is
+ * updated with the size of the received packet.
+ */
+typedef struct dc_custom_packet_t
+{
+	void *data;
+	size_t size;
+} dc_custom_packet_t;
+
 /*
  * Two different pointers to user-supplied data.
  *
@@ -63,6 +75,38 @@ typedef struct dc_custom_io_t
 	dc_status_t (*packet_write) (struct dc_custom_io_t *, const void* data, size_t size, size_t *actual);
 } dc_custom_io_t;
 
+/*
+ * Optional batched packet transfer, to move several packets with a
+ * single call. The read function returns at least one packet, and
+ * any additional packets that are already received. The number of
+ * packets is returned in 'actual'. If these functions are not
+ * registered, the library falls back to the single packet functions.
+ *
+ * The functions are registered with dc_context_set_custom_packet_multi,
+ * after the custom IO itself, such that the layout of the dc_custom_io_t
+ * structure allocated by the application remains unchanged.
+ */
+typedef dc_status_t (*dc_custom_packet_read_multi_t) (dc_custom_io_t *io, dc_custom_packet_t packets[], size_t count, size_t *actual);
+typedef dc_status_t (*dc_custom_packet_write_multi_t) (dc_custom_io_t *io, const dc_custom_packet_t packets[], size_t count, size_t *actual);
+
+/*
+ * Serial transfer replaying a transcript of a previous session, to run
+ * the protocol code without the device. The transcript is a logfile
+ * with the "Read" and "Write" hexdumps of the INFO loglevel, as written
+ * by dctool. The written data must match the transcript. A response
+ * becomes available after the packet latency, and every byte takes the
+ * byte latency to arrive (both in microseconds). A response waits for
+ * all the data written before it in the transcript, so the timing of a
+ * pipelined session is only reproduced by replaying a transcript that
+ * was recorded with the same request window. The transcript is rewound
+ * every time the serial port is opened.
+ */
+dc_status_t
+dc_custom_io_replay_new (dc_custom_io_t **io, struct dc_context_t *context, const char *filename, unsigned int packet_latency, unsigned int byte_latency);
+
+void
+dc_custom_io_replay_free (dc_custom_io_t *io);
+
 
 #ifdef __cplusplus
 }
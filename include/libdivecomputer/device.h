@@ -37,7 +37,8 @@ typedef enum dc_event_type_t {
 	DC_EVENT_PROGRESS = (1 << 1),
 	DC_EVENT_DEVINFO = (1 << 2),
 	DC_EVENT_CLOCK = (1 << 3),
-	DC_EVENT_VENDOR = (1 << 4)
+	DC_EVENT_VENDOR = (1 << 4),
+	DC_EVENT_STATS = (1 << 5)
 } dc_event_type_t;
 
 typedef struct dc_device_t dc_device_t;
@@ -63,6 +64,34 @@ typedef struct dc_event_vendor_t {
 	unsigned int size;
 } dc_event_vendor_t;
 
+#define DC_EVENT_STATS_LATENCY 12
+
+/*
+ * Transfer statistics, collected since the device was opened. All times
+ * are in microseconds. The latency of a round-trip is the time between
+ * sending a request, and the completion of the first read afterwards.
+ * The histogram counts the round-trips with a latency of less than 1ms
+ * in the first bucket, and doubles the limit for each next bucket. The
+ * last bucket contains all remaining round-trips.
+ */
+typedef struct dc_event_stats_t {
+	unsigned long long nbytes_in;
+	unsigned long long nbytes_out;
+	unsigned int nreads;
+	unsigned int nwrites;
+	unsigned int nroundtrips;
+	unsigned long long latency_total;
+	unsigned int latency_max;
+	unsigned int latency[DC_EVENT_STATS_LATENCY];
+	unsigned int nblocks;
+	unsigned long long nbytes_blocks;
+	unsigned int nretries;
+	unsigned int ncancel;
+	unsigned int ndives;
+	unsigned long long callback_time;
+	unsigned long long elapsed;
+} dc_event_stats_t;
+
 typedef int (*dc_cancel_callback_t) (void *userdata);
 
 typedef void (*dc_event_callback_t) (dc_device_t *device, dc_event_type_t event, const void *data, void *userdata);
@@ -81,9 +110,18 @@ dc_device_set_cancel (dc_device_t *device, dc_cancel_callback_t callback, void *
 dc_status_t
 dc_device_set_events (dc_device_t *device, unsigned int events, dc_event_callback_t callback, void *userdata);
 
+dc_status_t
+dc_device_set_cachedir (dc_device_t *device, const char *dirname);
+
 dc_status_t
 dc_device_set_fingerprint (dc_device_t *device, const unsigned char data[], unsigned int size);
 
+dc_status_t
+dc_device_set_fingerprint_index (dc_device_t *device, unsigned int enable);
+
+dc_status_t
+dc_device_get_stats (dc_device_t *device, dc_event_stats_t *stats);
+
 dc_status_t
 dc_device_read (dc_device_t *device, unsigned int address, unsigned char data[], unsigned int size);
 
@@ -0,0 +1,119 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2018 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_DIVEBUF_H
+#define DC_DIVEBUF_H
+
+#include "common.h"
+#include "device.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Opaque object representing the data of a downloaded dive.
+ *
+ * A dive buffer passed to a #dc_divebuf_callback_t is only valid until
+ * the callback returns. To keep the dive afterwards, take a reference
+ * with #dc_divebuf_retain. Backends that download the dives into one
+ * large memory image hand out slices of that image, and retaining such
+ * a dive does not copy the data. For the other backends, the data is
+ * copied once when it is retained.
+ */
+typedef struct dc_divebuf_t dc_divebuf_t;
+
+/**
+ * Dive buffer callback.
+ *
+ * @param[in]  dive      The dive buffer, only valid during the callback.
+ * @param[in]  userdata  User data passed to #dc_device_foreach_divebuf.
+ * @returns Non-zero to continue the download, or zero to stop it.
+ */
+typedef int (*dc_divebuf_callback_t) (dc_divebuf_t *dive, void *userdata);
+
+/**
+ * Download the dives as dive buffers.
+ *
+ * This is a variant of #dc_device_foreach, which passes the dives as
+ * dive buffers that can be retained past the end of the callback.
+ *
+ * @param[in]  device    A valid device object.
+ * @param[in]  callback  The callback function.
+ * @param[in]  userdata  User data to pass to the callback function.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_device_foreach_divebuf (dc_device_t *device, dc_divebuf_callback_t callback, void *userdata);
+
+/**
+ * Get the dive data.
+ *
+ * @param[in]  dive  A valid dive buffer.
+ * @returns A pointer to the dive data.
+ */
+const unsigned char *
+dc_divebuf_get_data (dc_divebuf_t *dive);
+
+/**
+ * Get the size of the dive data.
+ *
+ * @param[in]  dive  A valid dive buffer.
+ * @returns The size of the dive data.
+ */
+unsigned int
+dc_divebuf_get_size (dc_divebuf_t *dive);
+
+/**
+ * Get the fingerprint of the dive.
+ *
+ * @param[in]  dive   A valid dive buffer.
+ * @param[out] fsize  A location to store the size of the fingerprint.
+ * @returns A pointer to the fingerprint data.
+ */
+const unsigned char *
+dc_divebuf_get_fingerprint (dc_divebuf_t *dive, unsigned int *fsize);
+
+/**
+ * Take a reference to the dive.
+ *
+ * The returned dive buffer remains valid until it is released with
+ * #dc_divebuf_release, and it can be passed to another thread.
+ *
+ * @param[in]  dive  A valid dive buffer.
+ * @returns A new reference to the dive, or NULL if out of memory.
+ */
+dc_divebuf_t *
+dc_divebuf_retain (dc_divebuf_t *dive);
+
+/**
+ * Release a dive buffer obtained with #dc_divebuf_retain.
+ *
+ * @param[in]  dive  A dive buffer.
+ */
+void
+dc_divebuf_release (dc_divebuf_t *dive);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_DIVEBUF_H */
@@ -0,0 +1,208 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2018 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_IMAGE_H
+#define DC_IMAGE_H
+
+#include "common.h"
+#include "device.h"
+#include "parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Opaque object representing a dump image.
+ *
+ * A dump image is a file containing everything that was downloaded from
+ * a device: the device info and clock calibration, the raw memory image,
+ * and an index with the location of each dive. An image opened from a
+ * file is mapped into memory, and the dives are accessed directly in the
+ * mapping, without parsing the memory image again.
+ */
+typedef struct dc_image_t dc_image_t;
+
+/**
+ * Create a new, empty image.
+ *
+ * The image is filled by attaching it to a device with
+ * #dc_device_set_image and downloading the dives.
+ *
+ * @param[out] image    A location to store the image.
+ * @param[in]  context  A valid context object.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_image_new (dc_image_t **image, dc_context_t *context);
+
+/**
+ * Open an image file.
+ *
+ * The returned image is read-only.
+ *
+ * @param[out] image     A location to store the image.
+ * @param[in]  context   A valid context object.
+ * @param[in]  filename  The name of the image file.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_image_open (dc_image_t **image, dc_context_t *context, const char *filename);
+
+/**
+ * Write the image to a file.
+ *
+ * @param[in]  image     A valid image.
+ * @param[in]  filename  The name of the image file.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_image_save (dc_image_t *image, const char *filename);
+
+/**
+ * Get the device family.
+ *
+ * @param[in]  image  A valid image.
+ * @returns The device family.
+ */
+dc_family_t
+dc_image_get_type (dc_image_t *image);
+
+/**
+ * Get the device info.
+ *
+ * @param[in]  image    A valid image.
+ * @param[out] devinfo  A location to store the device info.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_image_get_devinfo (dc_image_t *image, dc_event_devinfo_t *devinfo);
+
+/**
+ * Get the clock calibration.
+ *
+ * @param[in]  image  A valid image.
+ * @param[out] clock  A location to store the clock calibration.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_image_get_clock (dc_image_t *image, dc_event_clock_t *clock);
+
+/**
+ * Get the raw memory image.
+ *
+ * The memory image is empty for devices which don't download the dives
+ * from a memory image.
+ *
+ * @param[in]  image  A valid image.
+ * @param[out] data   A location to store a pointer to the data.
+ * @param[out] size   A location to store the size of the data.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_image_get_memory (dc_image_t *image, const unsigned char **data, unsigned int *size);
+
+/**
+ * Get the number of dives.
+ *
+ * @param[in]  image  A valid image.
+ * @returns The number of dives.
+ */
+unsigned int
+dc_image_get_count (dc_image_t *image);
+
+/**
+ * Get a dive.
+ *
+ * The dives are stored in the same order as they were downloaded, which
+ * means the most recent dive comes first. The returned pointers remain
+ * valid until the image is freed, or another dive is added to it.
+ *
+ * @param[in]  image        A valid image.
+ * @param[in]  index        The index of the dive.
+ * @param[out] data         A location to store a pointer to the dive data.
+ * @param[out] size         A location to store the size of the dive data.
+ * @param[out] fingerprint  A location to store a pointer to the fingerprint.
+ * @param[out] fsize        A location to store the size of the fingerprint.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_image_get_dive (dc_image_t *image, unsigned int index, const unsigned char **data, unsigned int *size, const unsigned char **fingerprint, unsigned int *fsize);
+
+/**
+ * Pass all dives to a callback function.
+ *
+ * @param[in]  image     A valid image.
+ * @param[in]  callback  The callback function.
+ * @param[in]  userdata  User data to pass to the callback function.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_image_foreach (dc_image_t *image, dc_dive_callback_t callback, void *userdata);
+
+/**
+ * Create a parser for the dives in the image.
+ *
+ * @param[out] parser  A location to store the parser.
+ * @param[in]  image   A valid image.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_parser_new_image (dc_parser_t **parser, dc_image_t *image);
+
+/**
+ * Free the image.
+ *
+ * @param[in]  image  An image.
+ */
+void
+dc_image_free (dc_image_t *image);
+
+/**
+ * Record the downloaded data in an image.
+ *
+ * While the image is attached, #dc_device_foreach adds every dive, and
+ * #dc_device_dump stores the memory image. Backends which download the
+ * dives by reading the entire memory store their memory image during
+ * #dc_device_foreach as well. The image is not owned by the device, and
+ * needs to remain valid until it is detached again by passing NULL.
+ *
+ * @param[in]  device  A valid device object.
+ * @param[in]  image   An image created with #dc_image_new, or NULL.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_device_set_image (dc_device_t *device, dc_image_t *image);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_IMAGE_H */
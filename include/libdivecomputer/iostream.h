@@ -186,6 +186,24 @@ dc_iostream_get_lines (dc_iostream_t *iostream, unsigned int *value);
 dc_status_t
 dc_iostream_get_available (dc_iostream_t *iostream, size_t *value);
 
+/**
+ * Enable or disable the receive buffer.
+ *
+ * With a receive buffer, the data that is already available is read
+ * from the underlying transport at once, and small reads are served
+ * from the buffer. The buffer does not change the timeout behaviour,
+ * and it is discarded when the input direction is purged. Reads that
+ * are at least as large as the buffer bypass it.
+ *
+ * @param[in]  iostream  A valid I/O stream.
+ * @param[in]  size      The size of the buffer in bytes, or zero to
+ *                       disable the buffer.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_iostream_set_buffer (dc_iostream_t *iostream, size_t size);
+
 /**
  * Configure the line settings.
  *
@@ -263,6 +281,22 @@ dc_iostream_purge (dc_iostream_t *iostream, dc_direction_t direction);
 dc_status_t
 dc_iostream_sleep (dc_iostream_t *iostream, unsigned int milliseconds);
 
+/**
+ * Get the number of data transfer calls into the underlying transport.
+ *
+ * Only the calls that read, write or poll for available data are
+ * counted. Every such call results in at least one system call for the
+ * native I/O streams. The counter can be used to measure the effect of
+ * the receive buffer.
+ *
+ * @param[in]   iostream  A valid I/O stream.
+ * @param[out]  value     A location to store the number of calls.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_iostream_get_syscalls (dc_iostream_t *iostream, unsigned int *value);
+
 /**
  * Close the I/O stream and free all resources.
  *
@@ -35,6 +35,22 @@ oceanic_atom2_device_version (dc_device_t *device, unsigned char data[], unsigne
 dc_status_t
 oceanic_atom2_device_keepalive (dc_device_t *device);
 
+/**
+ * Set the number of pages in the read cache.
+ *
+ * Recently read pages are kept in a small cache, to avoid reading the
+ * same page again for requests that are not page aligned. The cache is
+ * emptied when its size is changed. The default is 8 pages.
+ *
+ * @param[in]  device  A valid device handle.
+ * @param[in]  npages  The number of cached pages (0 to 64). Zero
+ *                     disables the cache.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+oceanic_atom2_device_set_cache (dc_device_t *device, unsigned int npages);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -246,6 +246,46 @@ typedef struct dc_parser_t dc_parser_t;
 
 typedef void (*dc_sample_callback_t) (dc_sample_type_t type, dc_sample_value_t value, void *userdata);
 
+/*
+ * Columnar sample batches
+ *
+ * Instead of invoking a callback function for every sample value, the
+ * samples can also be retrieved in chunks, with each sample type stored
+ * in its own array (structure of arrays). Every row corresponds with
+ * one DC_SAMPLE_TIME sample. The caller provides the arrays for the
+ * sample types it is interested in, and leaves all the others NULL.
+ *
+ * Values that are not present in a particular row are set to
+ * DC_SAMPLE_UNDEFINED (integer columns) or NAN (floating point
+ * columns). The gas mix column always contains the active gas mix
+ * (carried forward from the last gas change). If a row contains
+ * multiple values of the same type (for example the ppO2 of multiple
+ * sensors), only the last one is stored. Events, vendor data and
+ * strings are not available in columnar form.
+ */
+
+#define DC_SAMPLE_UNDEFINED 0xFFFFFFFF
+#define DC_SAMPLE_BATCH_MAXTANKS 8
+
+typedef struct dc_sample_batch_t {
+	unsigned int capacity; /* Number of rows available in each array */
+	unsigned int count;    /* Number of rows returned */
+	unsigned int *time;
+	double *depth;
+	double *temperature;
+	double *pressure[DC_SAMPLE_BATCH_MAXTANKS]; /* Indexed by tank */
+	unsigned int *rbt;
+	unsigned int *heartbeat;
+	unsigned int *bearing;
+	double *setpoint;
+	double *ppo2;
+	double *cns;
+	unsigned int *deco_type;
+	unsigned int *deco_time;
+	double *deco_depth;
+	unsigned int *gasmix;
+} dc_sample_batch_t;
+
 dc_status_t
 dc_parser_new (dc_parser_t **parser, dc_device_t *device);
 
@@ -267,9 +307,132 @@ dc_parser_get_field (dc_parser_t *parser, dc_field_type_t type, unsigned int fla
 dc_status_t
 dc_parser_samples_foreach (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata);
 
+/**
+ * Retrieve the next chunk of samples in columnar form.
+ *
+ * Up to batch->capacity rows are stored in the arrays of the batch, and
+ * the number of rows is returned in batch->count. Each call continues
+ * where the previous one stopped, until a count of zero indicates all
+ * samples have been returned. Setting new data with
+ * dc_parser_set_data restarts from the first sample.
+ *
+ * The rows are decoded directly into the arrays of the batch, without
+ * buffering the dive. Every call decodes the dive again from the start
+ * and skips the rows returned already, so the capacity should be large
+ * enough to hold a typical dive in a few calls. The requested columns
+ * may differ between calls.
+ *
+ * @param[in]  parser  A valid parser object.
+ * @param[in]  batch   The batch with the caller provided arrays.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_parser_samples_get_batch (dc_parser_t *parser, dc_sample_batch_t *batch);
+
+/**
+ * Get the memory allocation statistics of the parser.
+ *
+ * The strings and other variable sized data of a dive are allocated
+ * from memory owned by the parser. The memory is reused for the next
+ * dive, after calling dc_parser_set_data. Thus strings returned by the
+ * parser remain valid until the next call to dc_parser_set_data or
+ * dc_parser_destroy. Once the parser has processed a few dives, the
+ * number of allocations should no longer increase.
+ *
+ * @param[in]  parser   A valid parser object.
+ * @param[out] nallocs  A location to store the total number of memory
+ *                      allocations.
+ * @param[out] nbytes   A location to store the number of bytes
+ *                      currently reserved.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_parser_get_allocstats (dc_parser_t *parser, unsigned int *nallocs, unsigned int *nbytes);
+
 dc_status_t
 dc_parser_destroy (dc_parser_t *parser);
 
+/**
+ * Opaque object representing a pool of parsers.
+ *
+ * A parser pool keeps parsers that are no longer in use, and hands them
+ * out again for the next dive with the same parameters, instead of
+ * destroying and creating a new parser for every dive. A pool is not
+ * thread-safe. When parsing dives on multiple threads, use one pool per
+ * thread.
+ */
+typedef struct dc_parser_pool_t dc_parser_pool_t;
+
+/**
+ * Create a new parser pool.
+ *
+ * @param[out] pool     A location to store the parser pool.
+ * @param[in]  context  A valid context object.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_parser_pool_new (dc_parser_pool_t **pool, dc_context_t *context);
+
+/**
+ * Get a parser for the dives of a device from the pool.
+ *
+ * This is the equivalent of #dc_parser_new. An idle parser with the
+ * same parameters is reused if available, otherwise a new parser is
+ * created. The dive data must always be set with #dc_parser_set_data
+ * before use.
+ *
+ * @param[in]  pool    A valid parser pool.
+ * @param[out] parser  A location to store the parser.
+ * @param[in]  device  A valid device object.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_parser_pool_acquire (dc_parser_pool_t *pool, dc_parser_t **parser, dc_device_t *device);
+
+/**
+ * Get a parser for a device descriptor from the pool.
+ *
+ * This is the equivalent of #dc_parser_new2.
+ *
+ * @param[in]  pool        A valid parser pool.
+ * @param[out] parser      A location to store the parser.
+ * @param[in]  descriptor  A valid device descriptor.
+ * @param[in]  devtime     The device time.
+ * @param[in]  systime     The system time.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_parser_pool_acquire2 (dc_parser_pool_t *pool, dc_parser_t **parser, dc_descriptor_t *descriptor, unsigned int devtime, dc_ticks_t systime);
+
+/**
+ * Return a parser to the pool.
+ *
+ * The parser must have been obtained from the same pool, and should no
+ * longer be used afterwards.
+ *
+ * @param[in]  pool    A valid parser pool.
+ * @param[in]  parser  The parser.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_parser_pool_release (dc_parser_pool_t *pool, dc_parser_t *parser);
+
+/**
+ * Destroy the parser pool and all its parsers.
+ *
+ * @param[in]  pool  A valid parser pool.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_parser_pool_free (dc_parser_pool_t *pool);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
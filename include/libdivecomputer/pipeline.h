@@ -0,0 +1,97 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2018 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_PIPELINE_H
+#define DC_PIPELINE_H
+
+#include "common.h"
+#include "device.h"
+#include "parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Dive parse callback.
+ *
+ * The callback is invoked from one of the worker threads, with a parser
+ * that is already initialized with the dive data. Multiple dives are
+ * parsed concurrently, in an unspecified order.
+ *
+ * @param[in]  parser       A valid parser object.
+ * @param[in]  data         The dive data.
+ * @param[in]  size         The size of the dive data.
+ * @param[in]  fingerprint  The fingerprint of the dive.
+ * @param[in]  fsize        The size of the fingerprint.
+ * @param[in]  userdata     User data passed to the pipeline.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure. The value is passed to the completion callback.
+ */
+typedef dc_status_t (*dc_dive_parse_callback_t) (dc_parser_t *parser, const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata);
+
+/**
+ * Dive completion callback.
+ *
+ * The callback is invoked once the dive has been parsed, in the same
+ * order as the dives are downloaded. The invocations are serialized,
+ * but they may happen on any of the worker threads.
+ *
+ * @param[in]  status       The status returned by the parse callback.
+ * @param[in]  data         The dive data.
+ * @param[in]  size         The size of the dive data.
+ * @param[in]  fingerprint  The fingerprint of the dive.
+ * @param[in]  fsize        The size of the fingerprint.
+ * @param[in]  userdata     User data passed to the pipeline.
+ * @returns Non-zero to continue the download, or zero to stop it.
+ */
+typedef int (*dc_dive_complete_callback_t) (dc_status_t status, const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata);
+
+/**
+ * Download the dives and parse them concurrently.
+ *
+ * This is a variant of #dc_device_foreach where the downloaded dives
+ * are handed to a pool of worker threads for parsing, while the
+ * download continues on the calling thread. At most @a depth dives are
+ * queued. Once the queue is full, the download is blocked until a dive
+ * has been completed.
+ *
+ * The parsers log through the context of the device, from the worker
+ * threads. The log function of the context is therefore called from
+ * several threads at once, unless the messages are deferred with
+ * #dc_context_set_logbuffer.
+ *
+ * @param[in]  device    A valid device object.
+ * @param[in]  nthreads  The number of worker threads.
+ * @param[in]  depth     The maximum number of queued dives.
+ * @param[in]  parse     The parse callback.
+ * @param[in]  complete  The (optional) completion callback.
+ * @param[in]  userdata  User data to pass to the callback functions.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_device_foreach_pipelined (dc_device_t *device, unsigned int nthreads, unsigned int depth, dc_dive_parse_callback_t parse, dc_dive_complete_callback_t complete, void *userdata);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_PIPELINE_H */
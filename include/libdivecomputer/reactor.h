@@ -0,0 +1,170 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2018 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_REACTOR_H
+#define DC_REACTOR_H
+
+#include "common.h"
+#include "context.h"
+#include "iostream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Opaque object representing an event loop.
+ *
+ * The event loop drives the I/O of many serial connections from a
+ * single thread. Every connection can have one pending read or write
+ * operation at a time, which is completed asynchronously. The event
+ * loop is only available on platforms that support epoll.
+ */
+typedef struct dc_reactor_t dc_reactor_t;
+
+/**
+ * Completion callback.
+ *
+ * The callback is invoked from #dc_reactor_run once the operation has
+ * finished. It may queue a new operation on the same or another I/O
+ * stream, or remove the I/O stream from the event loop.
+ *
+ * @param[in]  iostream  The I/O stream of the operation.
+ * @param[in]  status    #DC_STATUS_SUCCESS if all data has been
+ *                       transferred, #DC_STATUS_TIMEOUT if the deadline
+ *                       expired, #DC_STATUS_CANCELLED if the I/O stream
+ *                       was removed, or another #dc_status_t code on
+ *                       failure.
+ * @param[in]  actual    The number of bytes transferred.
+ * @param[in]  userdata  User data passed with the operation.
+ */
+typedef void (*dc_reactor_callback_t) (dc_iostream_t *iostream, dc_status_t status, size_t actual, void *userdata);
+
+/**
+ * Create a new event loop.
+ *
+ * @param[out] reactor  A location to store the event loop.
+ * @param[in]  context  A valid context object.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_UNSUPPORTED if
+ * the platform has no epoll support, or another #dc_status_t code on
+ * failure.
+ */
+dc_status_t
+dc_reactor_new (dc_reactor_t **reactor, dc_context_t *context);
+
+/**
+ * Add an I/O stream to the event loop.
+ *
+ * The I/O stream is switched to non-blocking mode, and should not be
+ * used directly while it is part of the event loop. Only serial
+ * connections (opened with #dc_serial_open) are supported.
+ *
+ * @param[in]  reactor   A valid event loop.
+ * @param[in]  iostream  A valid I/O stream.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_reactor_add (dc_reactor_t *reactor, dc_iostream_t *iostream);
+
+/**
+ * Remove an I/O stream from the event loop.
+ *
+ * A pending operation is completed with #DC_STATUS_CANCELLED, and the
+ * I/O stream is switched back to blocking mode.
+ *
+ * @param[in]  reactor   A valid event loop.
+ * @param[in]  iostream  A valid I/O stream.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_reactor_remove (dc_reactor_t *reactor, dc_iostream_t *iostream);
+
+/**
+ * Queue a read operation.
+ *
+ * The buffer must remain valid until the operation has completed.
+ *
+ * @param[in]  reactor   A valid event loop.
+ * @param[in]  iostream  An I/O stream that is part of the event loop.
+ * @param[in]  data      The memory buffer to read the data into.
+ * @param[in]  size      The number of bytes to read.
+ * @param[in]  timeout   The deadline (in milliseconds) relative to the
+ *                       start of the operation, or a negative value to
+ *                       wait forever.
+ * @param[in]  callback  The completion callback.
+ * @param[in]  userdata  User data to pass to the callback.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_INVALIDARGS if an
+ * operation is already pending, or another #dc_status_t code on
+ * failure.
+ */
+dc_status_t
+dc_reactor_read (dc_reactor_t *reactor, dc_iostream_t *iostream, void *data, size_t size, int timeout, dc_reactor_callback_t callback, void *userdata);
+
+/**
+ * Queue a write operation.
+ *
+ * The buffer must remain valid until the operation has completed.
+ *
+ * @param[in]  reactor   A valid event loop.
+ * @param[in]  iostream  An I/O stream that is part of the event loop.
+ * @param[in]  data      The memory buffer to write the data from.
+ * @param[in]  size      The number of bytes to write.
+ * @param[in]  timeout   The deadline (in milliseconds) relative to the
+ *                       start of the operation, or a negative value to
+ *                       wait forever.
+ * @param[in]  callback  The completion callback.
+ * @param[in]  userdata  User data to pass to the callback.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_INVALIDARGS if an
+ * operation is already pending, or another #dc_status_t code on
+ * failure.
+ */
+dc_status_t
+dc_reactor_write (dc_reactor_t *reactor, dc_iostream_t *iostream, const void *data, size_t size, int timeout, dc_reactor_callback_t callback, void *userdata);
+
+/**
+ * Run the event loop until there are no more pending operations.
+ *
+ * @param[in]  reactor  A valid event loop.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_reactor_run (dc_reactor_t *reactor);
+
+/**
+ * Destroy the event loop and free all resources.
+ *
+ * The I/O streams are removed from the event loop, without invoking the
+ * callbacks of the pending operations. The I/O streams are not closed.
+ *
+ * @param[in]  reactor  A valid event loop.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_reactor_free (dc_reactor_t *reactor);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_REACTOR_H */
@@ -0,0 +1,130 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2018 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_SIMULATOR_H
+#define DC_SIMULATOR_H
+
+#include "common.h"
+#include "context.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Opaque object representing a device simulator.
+ *
+ * A simulator implements the device side of the communication protocol
+ * on top of a memory image. It runs in a background thread, connected
+ * to the master side of a pseudo terminal. The slave side appears as a
+ * regular serial port, so the simulated device is downloaded by passing
+ * its name to #dc_device_open. The simulator is full-duplex: commands
+ * are answered in order, and several commands can be outstanding.
+ *
+ * The supported families are #DC_FAMILY_OCEANIC_ATOM2,
+ * #DC_FAMILY_SUUNTO_VYPER2, #DC_FAMILY_SUUNTO_D9, #DC_FAMILY_HW_OSTC3
+ * and #DC_FAMILY_SHEARWATER_PREDATOR (uncompressed transfers only).
+ * The simulator requires pseudo terminal support (the --enable-pty
+ * configure option), and isn't available on Windows.
+ */
+typedef struct dc_simulator_t dc_simulator_t;
+
+/**
+ * Create a new simulator.
+ *
+ * The memory image is the same as the one returned by #dc_device_dump,
+ * and is copied by the simulator. The commands which write to the
+ * memory only modify the copy.
+ *
+ * @param[out] simulator  A location to store the simulator.
+ * @param[in]  context    A valid context object.
+ * @param[in]  family     The device family.
+ * @param[in]  data       The memory image.
+ * @param[in]  size       The size of the memory image.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_simulator_new (dc_simulator_t **simulator, dc_context_t *context, dc_family_t family, const unsigned char data[], unsigned int size);
+
+/**
+ * Set the version data.
+ *
+ * The version data is returned by the version command of the device,
+ * and determines the model and memory layout. It's the 16 byte version
+ * string for the Oceanic devices, the 4 byte version for the Suunto
+ * devices, and the 64 byte identity block for the OSTC3. Without
+ * version data, a default model is simulated (an Oceanic VT3, a Suunto
+ * D9 and an OSTC3) The Shearwater
+ * Predator has no version data.
+ *
+ * @param[in]  simulator  A valid simulator.
+ * @param[in]  data       The version data.
+ * @param[in]  size       The size of the version data.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_simulator_set_version (dc_simulator_t *simulator, const unsigned char data[], unsigned int size);
+
+/**
+ * Set the latency.
+ *
+ * Every response becomes available after the packet latency, and every
+ * byte takes the byte latency to transmit (both in microseconds). The
+ * responses are transmitted one after the other, but the packet latency
+ * of pipelined commands overlaps. The default is no latency at all.
+ *
+ * @param[in]  simulator       A valid simulator.
+ * @param[in]  packet_latency  The latency of each response.
+ * @param[in]  byte_latency    The latency of each byte.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_simulator_set_latency (dc_simulator_t *simulator, unsigned int packet_latency, unsigned int byte_latency);
+
+/**
+ * Get the device name.
+ *
+ * The device name is the name of the pseudo terminal, and remains valid
+ * until the simulator is freed.
+ *
+ * @param[in]  simulator  A valid simulator.
+ * @returns The device name.
+ */
+const char *
+dc_simulator_get_name (dc_simulator_t *simulator);
+
+/**
+ * Free the simulator.
+ *
+ * The device needs to be closed before freeing the simulator.
+ *
+ * @param[in]  simulator  A simulator.
+ */
+void
+dc_simulator_free (dc_simulator_t *simulator);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_SIMULATOR_H */
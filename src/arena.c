@@ -0,0 +1,139 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2018 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define BLOCKSIZE 1024
+#define ALIGNMENT 8
+
+struct dc_arena_block_t {
+	dc_arena_block_t *next;
+	size_t size;
+	size_t used;
+};
+
+#define HEADERSIZE ((sizeof (dc_arena_block_t) + ALIGNMENT - 1) & ~(size_t) (ALIGNMENT - 1))
+
+static void
+dc_arena_release (dc_arena_t *arena)
+{
+	dc_arena_block_t *block = arena->blocks;
+	while (block) {
+		dc_arena_block_t *next = block->next;
+		free (block);
+		block = next;
+	}
+
+	arena->blocks = NULL;
+	arena->nbytes = 0;
+}
+
+void
+dc_arena_init (dc_arena_t *arena)
+{
+	arena->blocks = NULL;
+	arena->reserve = 0;
+	arena->nallocs = 0;
+	arena->nbytes = 0;
+}
+
+void *
+dc_arena_alloc (dc_arena_t *arena, size_t size)
+{
+	// Round up to the alignment.
+	size = (size + ALIGNMENT - 1) & ~(size_t) (ALIGNMENT - 1);
+
+	// The most recent block is always at the head of the list.
+	dc_arena_block_t *block = arena->blocks;
+	if (block == NULL || block->size - block->used < size) {
+		size_t blocksize = BLOCKSIZE;
+		if (block && blocksize < 2 * block->size)
+			blocksize = 2 * block->size;
+		if (blocksize < arena->reserve)
+			blocksize = arena->reserve;
+		if (blocksize < size)
+			blocksize = size;
+
+		block = (dc_arena_block_t *) malloc (HEADERSIZE + blocksize);
+		if (block == NULL)
+			return NULL;
+
+		block->next = arena->blocks;
+		block->size = blocksize;
+		block->used = 0;
+
+		arena->blocks = block;
+		arena->reserve = 0;
+		arena->nallocs++;
+		arena->nbytes += blocksize;
+	}
+
+	void *ptr = (unsigned char *) block + HEADERSIZE + block->used;
+	block->used += size;
+
+	return ptr;
+}
+
+char *
+dc_arena_strndup (dc_arena_t *arena, const char *str, size_t len)
+{
+	char *copy = (char *) dc_arena_alloc (arena, len + 1);
+	if (copy == NULL)
+		return NULL;
+
+	memcpy (copy, str, len);
+	copy[len] = 0;
+
+	return copy;
+}
+
+char *
+dc_arena_strdup (dc_arena_t *arena, const char *str)
+{
+	return dc_arena_strndup (arena, str, strlen (str));
+}
+
+void
+dc_arena_reset (dc_arena_t *arena)
+{
+	dc_arena_block_t *block = arena->blocks;
+	if (block == NULL)
+		return;
+
+	if (block->next) {
+		// Replace the blocks with a single block, large enough to hold
+		// everything, on the next allocation.
+		arena->reserve = arena->nbytes;
+		dc_arena_release (arena);
+	} else {
+		block->used = 0;
+	}
+}
+
+void
+dc_arena_free (dc_arena_t *arena)
+{
+	dc_arena_release (arena);
+	arena->reserve = 0;
+}
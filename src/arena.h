@@ -0,0 +1,109 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2018 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_ARENA_H
+#define DC_ARENA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct dc_arena_block_t dc_arena_block_t;
+
+/**
+ * Simple arena (or region) allocator.
+ *
+ * Memory is handed out sequentially from one or more large blocks, and
+ * released all at once with dc_arena_reset. The blocks are kept for
+ * reuse, so once the arena has grown to its steady state size, no more
+ * calls to malloc are needed.
+ */
+typedef struct dc_arena_t {
+	dc_arena_block_t *blocks;
+	size_t reserve;
+	unsigned int nallocs;
+	size_t nbytes;
+} dc_arena_t;
+
+/**
+ * Initialize an empty arena. No memory is allocated until needed.
+ *
+ * @param[in]  arena  The arena.
+ */
+void
+dc_arena_init (dc_arena_t *arena);
+
+/**
+ * Allocate memory from the arena.
+ *
+ * @param[in]  arena  The arena.
+ * @param[in]  size   The number of bytes.
+ * @returns A pointer to the memory, or NULL if out of memory. The
+ * memory remains valid until the next reset of the arena.
+ */
+void *
+dc_arena_alloc (dc_arena_t *arena, size_t size);
+
+/**
+ * Copy a string into the arena.
+ *
+ * @param[in]  arena  The arena.
+ * @param[in]  str    The string.
+ * @returns A pointer to the copy, or NULL if out of memory.
+ */
+char *
+dc_arena_strdup (dc_arena_t *arena, const char *str);
+
+/**
+ * Copy the first @a len characters of a string into the arena. The
+ * copy is always NUL terminated.
+ *
+ * @param[in]  arena  The arena.
+ * @param[in]  str    The string.
+ * @param[in]  len    The number of characters.
+ * @returns A pointer to the copy, or NULL if out of memory.
+ */
+char *
+dc_arena_strndup (dc_arena_t *arena, const char *str, size_t len);
+
+/**
+ * Release all memory that was allocated from the arena, but keep the
+ * blocks for reuse.
+ *
+ * @param[in]  arena  The arena.
+ */
+void
+dc_arena_reset (dc_arena_t *arena);
+
+/**
+ * Free all blocks of the arena.
+ *
+ * @param[in]  arena  The arena.
+ */
+void
+dc_arena_free (dc_arena_t *arena);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_ARENA_H */
@@ -62,6 +62,7 @@ static const dc_parser_vtable_t atomics_cobalt_parser_vtable = {
 	atomics_cobalt_parser_get_datetime, /* datetime */
 	atomics_cobalt_parser_get_field, /* fields */
 	atomics_cobalt_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_decode */
 	NULL /* destroy */
 };
 
@@ -241,7 +242,9 @@ atomics_cobalt_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, un
 			default:
 				return DC_STATUS_UNSUPPORTED;
 			}
-			string->value = strdup(buf);
+			string->value = dc_arena_strdup (&abstract->arena, buf);
+			if (string->value == NULL)
+				return DC_STATUS_NOMEMORY;
 			break;
 		default:
 			return DC_STATUS_UNSUPPORTED;
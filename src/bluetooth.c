@@ -107,6 +107,7 @@ static const dc_iostream_vtable_t dc_bluetooth_vtable = {
 	dc_socket_configure, /* configure */
 	dc_socket_read, /* read */
 	dc_socket_write, /* write */
+	dc_socket_writev, /* writev */
 	dc_socket_flush, /* flush */
 	dc_socket_purge, /* purge */
 	dc_socket_sleep, /* sleep */
@@ -0,0 +1,424 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2018 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <libdivecomputer/buffer.h>
+#include <libdivecomputer/datetime.h>
+
+#include "checkpoint.h"
+#include "context-private.h"
+#include "array.h"
+
+#define CHECKPOINT_MAGIC   "DCCP"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_HEADER  (4 + 4 + 8)
+#define CHECKPOINT_RECORD  (4 + 4 + 4 + 4)
+
+#define MAXKEYSIZE  256
+#define MAXDATASIZE 0x1000000
+
+typedef struct dc_checkpoint_entry_t {
+	unsigned char *key;
+	unsigned int keysize;
+	unsigned int flags;
+	dc_buffer_t *data;
+} dc_checkpoint_entry_t;
+
+struct dc_checkpoint_t {
+	dc_context_t *context;
+	char *filename;
+	FILE *fp;
+	// The file contents are valid, and new records can be appended.
+	unsigned int valid;
+	// The records.
+	dc_checkpoint_entry_t *entries;
+	unsigned int count;
+	unsigned int capacity;
+};
+
+static dc_checkpoint_entry_t *
+dc_checkpoint_find (dc_checkpoint_t *checkpoint, const unsigned char key[], unsigned int keysize)
+{
+	for (unsigned int i = 0; i < checkpoint->count; ++i) {
+		dc_checkpoint_entry_t *entry = checkpoint->entries + i;
+		if (entry->keysize == keysize && memcmp (entry->key, key, keysize) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+static void
+dc_checkpoint_clear (dc_checkpoint_t *checkpoint)
+{
+	for (unsigned int i = 0; i < checkpoint->count; ++i) {
+		free (checkpoint->entries[i].key);
+		dc_buffer_free (checkpoint->entries[i].data);
+	}
+
+	checkpoint->count = 0;
+}
+
+static dc_status_t
+dc_checkpoint_apply (dc_checkpoint_t *checkpoint, const unsigned char key[], unsigned int keysize, unsigned int offset, const unsigned char data[], unsigned int size, unsigned int flags)
+{
+	dc_checkpoint_entry_t *entry = dc_checkpoint_find (checkpoint, key, keysize);
+
+	// Remove the record.
+	if (flags & DC_CHECKPOINT_DISCARD) {
+		if (entry) {
+			unsigned int idx = entry - checkpoint->entries;
+			free (entry->key);
+			dc_buffer_free (entry->data);
+			memmove (entry, entry + 1, (checkpoint->count - idx - 1) * sizeof (dc_checkpoint_entry_t));
+			checkpoint->count--;
+		}
+		return DC_STATUS_SUCCESS;
+	}
+
+	// Create a new record.
+	if (entry == NULL) {
+		if (checkpoint->count == checkpoint->capacity) {
+			unsigned int capacity = checkpoint->capacity ? checkpoint->capacity * 2 : 16;
+			dc_checkpoint_entry_t *entries = (dc_checkpoint_entry_t *) realloc (checkpoint->entries, capacity * sizeof (dc_checkpoint_entry_t));
+			if (entries == NULL) {
+				ERROR (checkpoint->context, "Failed to allocate memory.");
+				return DC_STATUS_NOMEMORY;
+			}
+
+			checkpoint->entries = entries;
+			checkpoint->capacity = capacity;
+		}
+
+		entry = checkpoint->entries + checkpoint->count;
+		entry->key = (unsigned char *) malloc (keysize);
+		entry->data = dc_buffer_new (offset + size);
+		if (entry->key == NULL || entry->data == NULL) {
+			ERROR (checkpoint->context, "Failed to allocate memory.");
+			free (entry->key);
+			dc_buffer_free (entry->data);
+			return DC_STATUS_NOMEMORY;
+		}
+
+		memcpy (entry->key, key, keysize);
+		entry->keysize = keysize;
+		entry->flags = 0;
+		checkpoint->count++;
+	}
+
+	if (offset > dc_buffer_get_size (entry->data))
+		return DC_STATUS_INVALIDARGS;
+
+	if (!dc_buffer_resize (entry->data, offset) ||
+		!dc_buffer_append (entry->data, data, size)) {
+		ERROR (checkpoint->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	entry->flags = flags;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_checkpoint_write (dc_checkpoint_t *checkpoint, const unsigned char key[], unsigned int keysize, unsigned int offset, const unsigned char data[], unsigned int size, unsigned int flags)
+{
+	unsigned char record[CHECKPOINT_RECORD] = {0};
+	array_uint32_le_set (record + 0, keysize);
+	array_uint32_le_set (record + 4, offset);
+	array_uint32_le_set (record + 8, size);
+	array_uint32_le_set (record + 12, flags);
+
+	if (fwrite (record, sizeof (record), 1, checkpoint->fp) != 1 ||
+		fwrite (key, keysize, 1, checkpoint->fp) != 1 ||
+		(size && fwrite (data, size, 1, checkpoint->fp) != 1))
+	{
+		ERROR (checkpoint->context, "Failed to write the checkpoint.");
+		return DC_STATUS_IO;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Update the timestamp in the header to the current time. The file
+ * position is restored to the end of the file afterwards.
+ */
+static dc_status_t
+dc_checkpoint_touch (dc_checkpoint_t *checkpoint)
+{
+	unsigned char timestamp[8] = {0};
+	dc_ticks_t now = dc_datetime_now ();
+	array_uint32_le_set (timestamp + 0, now & 0xFFFFFFFF);
+	array_uint32_le_set (timestamp + 4, (now >> 32) & 0xFFFFFFFF);
+
+	if (fseek (checkpoint->fp, 8, SEEK_SET) != 0 ||
+		fwrite (timestamp, sizeof (timestamp), 1, checkpoint->fp) != 1 ||
+		fseek (checkpoint->fp, 0, SEEK_END) != 0)
+	{
+		ERROR (checkpoint->context, "Failed to write the checkpoint.");
+		return DC_STATUS_IO;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_checkpoint_load (dc_checkpoint_t *checkpoint, unsigned int maxage)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned char *buffer = NULL;
+
+	FILE *fp = fopen (checkpoint->filename, "rb");
+	if (fp == NULL) {
+		// A missing checkpoint file is not an error.
+		return DC_STATUS_SUCCESS;
+	}
+
+	// Verify the header.
+	unsigned char header[CHECKPOINT_HEADER] = {0};
+	if (fread (header, sizeof (header), 1, fp) != 1 ||
+		memcmp (header, CHECKPOINT_MAGIC, 4) != 0 ||
+		array_uint32_le (header + 4) != CHECKPOINT_VERSION)
+	{
+		WARNING (checkpoint->context, "Ignoring incompatible checkpoint.");
+		goto error_close;
+	}
+
+	// Discard an outdated checkpoint. The device may have recorded new
+	// dives in the meantime. The timestamp is the time of the last
+	// update, and not the time the file was created.
+	dc_ticks_t now = dc_datetime_now ();
+	dc_ticks_t timestamp = array_uint32_le (header + 8) + ((dc_ticks_t) array_uint32_le (header + 12) << 32);
+	if (timestamp > now || now - timestamp > maxage) {
+		INFO (checkpoint->context, "Ignoring outdated checkpoint.");
+		goto error_close;
+	}
+
+	// Read the records.
+	unsigned char record[CHECKPOINT_RECORD] = {0};
+	while (fread (record, sizeof (record), 1, fp) == 1) {
+		unsigned int keysize = array_uint32_le (record + 0);
+		unsigned int offset  = array_uint32_le (record + 4);
+		unsigned int size    = array_uint32_le (record + 8);
+		unsigned int flags   = array_uint32_le (record + 12);
+		if (keysize == 0 || keysize > MAXKEYSIZE || size > MAXDATASIZE) {
+			WARNING (checkpoint->context, "Ignoring corrupt checkpoint.");
+			dc_checkpoint_clear (checkpoint);
+			goto error_close;
+		}
+
+		unsigned char *tmp = (unsigned char *) realloc (buffer, keysize + size);
+		if (tmp == NULL) {
+			ERROR (checkpoint->context, "Failed to allocate memory.");
+			status = DC_STATUS_NOMEMORY;
+			goto error_close;
+		}
+		buffer = tmp;
+
+		// A truncated record is left behind by an interrupted write.
+		if (fread (buffer, keysize + size, 1, fp) != 1) {
+			WARNING (checkpoint->context, "Ignoring truncated checkpoint record.");
+			goto error_close;
+		}
+
+		status = dc_checkpoint_apply (checkpoint, buffer, keysize, offset, buffer + keysize, size, flags);
+		if (status == DC_STATUS_INVALIDARGS) {
+			WARNING (checkpoint->context, "Ignoring corrupt checkpoint.");
+			dc_checkpoint_clear (checkpoint);
+			status = DC_STATUS_SUCCESS;
+			goto error_close;
+		} else if (status != DC_STATUS_SUCCESS) {
+			goto error_close;
+		}
+	}
+
+	checkpoint->valid = 1;
+
+error_close:
+	free (buffer);
+	fclose (fp);
+	return status;
+}
+
+dc_status_t
+dc_checkpoint_new (dc_checkpoint_t **out, dc_context_t *context, const char *filename, unsigned int maxage)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_checkpoint_t *checkpoint = NULL;
+
+	if (out == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Allocate memory.
+	checkpoint = (dc_checkpoint_t *) malloc (sizeof (dc_checkpoint_t));
+	if (checkpoint == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	checkpoint->context = context;
+	checkpoint->fp = NULL;
+	checkpoint->valid = 0;
+	checkpoint->entries = NULL;
+	checkpoint->count = 0;
+	checkpoint->capacity = 0;
+	checkpoint->filename = strdup (filename);
+	if (checkpoint->filename == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_free;
+	}
+
+	status = dc_checkpoint_load (checkpoint, maxage);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	if (checkpoint->count) {
+		INFO (context, "Loaded %u records from the checkpoint.", checkpoint->count);
+	}
+
+	*out = checkpoint;
+
+	return DC_STATUS_SUCCESS;
+
+error_free:
+	dc_checkpoint_free (checkpoint);
+	return status;
+}
+
+int
+dc_checkpoint_lookup (dc_checkpoint_t *checkpoint, const unsigned char key[], unsigned int keysize, const unsigned char **data, unsigned int *size, unsigned int *flags)
+{
+	if (checkpoint == NULL || key == NULL)
+		return 0;
+
+	dc_checkpoint_entry_t *entry = dc_checkpoint_find (checkpoint, key, keysize);
+	if (entry == NULL)
+		return 0;
+
+	if (data)
+		*data = dc_buffer_get_data (entry->data);
+	if (size)
+		*size = dc_buffer_get_size (entry->data);
+	if (flags)
+		*flags = entry->flags;
+
+	return 1;
+}
+
+dc_status_t
+dc_checkpoint_store (dc_checkpoint_t *checkpoint, const unsigned char key[], unsigned int keysize, unsigned int offset, const unsigned char data[], unsigned int size, unsigned int flags)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (checkpoint == NULL || key == NULL || keysize == 0 || keysize > MAXKEYSIZE || size > MAXDATASIZE)
+		return DC_STATUS_INVALIDARGS;
+
+	// Discarding a record that doesn't exist is a no-op. This avoids
+	// creating the file when there is nothing to remember.
+	if ((flags & DC_CHECKPOINT_DISCARD) && dc_checkpoint_find (checkpoint, key, keysize) == NULL)
+		return DC_STATUS_SUCCESS;
+
+	status = dc_checkpoint_apply (checkpoint, key, keysize, offset, data, size, flags);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	// Open the file. If the existing contents can't be extended, the file
+	// is rewritten with the records that are currently present. The file
+	// isn't opened in append mode, because the timestamp in the header
+	// is updated as well.
+	if (checkpoint->fp == NULL) {
+		if (checkpoint->valid) {
+			checkpoint->fp = fopen (checkpoint->filename, "r+b");
+			if (checkpoint->fp && fseek (checkpoint->fp, 0, SEEK_END) != 0) {
+				fclose (checkpoint->fp);
+				checkpoint->fp = NULL;
+			}
+			if (checkpoint->fp == NULL)
+				checkpoint->valid = 0;
+		}
+		if (checkpoint->fp == NULL) {
+			checkpoint->fp = fopen (checkpoint->filename, "wb");
+		}
+		if (checkpoint->fp == NULL) {
+			ERROR (checkpoint->context, "Failed to open the checkpoint.");
+			return DC_STATUS_IO;
+		}
+
+		if (!checkpoint->valid) {
+			unsigned char header[CHECKPOINT_HEADER] = {0};
+			dc_ticks_t now = dc_datetime_now ();
+			memcpy (header, CHECKPOINT_MAGIC, 4);
+			array_uint32_le_set (header + 4, CHECKPOINT_VERSION);
+			array_uint32_le_set (header + 8, now & 0xFFFFFFFF);
+			array_uint32_le_set (header + 12, (now >> 32) & 0xFFFFFFFF);
+			if (fwrite (header, sizeof (header), 1, checkpoint->fp) != 1) {
+				ERROR (checkpoint->context, "Failed to write the checkpoint.");
+				return DC_STATUS_IO;
+			}
+
+			for (unsigned int i = 0; i < checkpoint->count; ++i) {
+				dc_checkpoint_entry_t *entry = checkpoint->entries + i;
+				status = dc_checkpoint_write (checkpoint, entry->key, entry->keysize, 0,
+					dc_buffer_get_data (entry->data), dc_buffer_get_size (entry->data), entry->flags);
+				if (status != DC_STATUS_SUCCESS)
+					return status;
+			}
+
+			checkpoint->valid = 1;
+
+			return fflush (checkpoint->fp) == 0 ? DC_STATUS_SUCCESS : DC_STATUS_IO;
+		}
+	}
+
+	status = dc_checkpoint_write (checkpoint, key, keysize, offset, data, size, flags);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	status = dc_checkpoint_touch (checkpoint);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	if (fflush (checkpoint->fp) != 0) {
+		ERROR (checkpoint->context, "Failed to write the checkpoint.");
+		return DC_STATUS_IO;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+void
+dc_checkpoint_free (dc_checkpoint_t *checkpoint)
+{
+	if (checkpoint == NULL)
+		return;
+
+	if (checkpoint->fp)
+		fclose (checkpoint->fp);
+	dc_checkpoint_clear (checkpoint);
+	free (checkpoint->entries);
+	free (checkpoint->filename);
+	free (checkpoint);
+}
@@ -0,0 +1,117 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2018 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_CHECKPOINT_H
+#define DC_CHECKPOINT_H
+
+#include <libdivecomputer/context.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * The record contains the complete data.
+ */
+#define DC_CHECKPOINT_COMPLETE 0x01
+
+/**
+ * The record is no longer needed.
+ */
+#define DC_CHECKPOINT_DISCARD  0x02
+
+/**
+ * Opaque object representing a download checkpoint.
+ *
+ * A checkpoint persists the data received during a download, such that
+ * an interrupted download can be resumed afterwards, without
+ * transferring the same data again. The data is organized as records,
+ * identified by a key, which can be extended while the download is in
+ * progress. The records are appended to the file, and the timestamp in
+ * the header is updated on every change.
+ */
+typedef struct dc_checkpoint_t dc_checkpoint_t;
+
+/**
+ * Open a checkpoint.
+ *
+ * The records are loaded from the file. A missing file is not an error,
+ * and the contents of a file that wasn't updated within the maximum age
+ * are discarded.
+ * The file is only created once the first record is stored.
+ *
+ * @param[out]  checkpoint  A location to store the checkpoint.
+ * @param[in]   context     A valid context object.
+ * @param[in]   filename    The filename of the checkpoint.
+ * @param[in]   maxage      The maximum age of the checkpoint in seconds.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_checkpoint_new (dc_checkpoint_t **checkpoint, dc_context_t *context, const char *filename, unsigned int maxage);
+
+/**
+ * Lookup a record in the checkpoint.
+ *
+ * @param[in]   checkpoint  A valid checkpoint.
+ * @param[in]   key         The key of the record.
+ * @param[in]   keysize     The size of the key.
+ * @param[out]  data        A location to store the record data.
+ * @param[out]  size        A location to store the size of the record data.
+ * @param[out]  flags       A location to store the record flags.
+ * @returns Non-zero if the record is present, or zero otherwise.
+ */
+int
+dc_checkpoint_lookup (dc_checkpoint_t *checkpoint, const unsigned char key[], unsigned int keysize, const unsigned char **data, unsigned int *size, unsigned int *flags);
+
+/**
+ * Store data in a record of the checkpoint.
+ *
+ * The data is written at the specified offset in the record, which must
+ * not be beyond the end of the existing data. Any existing data after
+ * the offset is replaced. The record is written to the file immediately.
+ * With the #DC_CHECKPOINT_DISCARD flag, the record is removed.
+ *
+ * @param[in]  checkpoint  A valid checkpoint.
+ * @param[in]  key         The key of the record.
+ * @param[in]  keysize     The size of the key.
+ * @param[in]  offset      The offset of the data in the record.
+ * @param[in]  data        The data.
+ * @param[in]  size        The size of the data.
+ * @param[in]  flags       The record flags.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_checkpoint_store (dc_checkpoint_t *checkpoint, const unsigned char key[], unsigned int keysize, unsigned int offset, const unsigned char data[], unsigned int size, unsigned int flags);
+
+/**
+ * Close the checkpoint and free all resources.
+ *
+ * @param[in]  checkpoint  A valid checkpoint.
+ */
+void
+dc_checkpoint_free (dc_checkpoint_t *checkpoint);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_CHECKPOINT_H */
@@ -83,6 +83,8 @@ citizen_aqualand_device_open (dc_device_t **out, dc_context_t *context, const ch
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (4800 8N1).
 	status = dc_iostream_configure (device->iostream, 4800, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -560,6 +560,8 @@ cochran_commander_read_retry (cochran_commander_device_t *device, dc_event_progr
 		if (nretries++ >= MAXRETRIES)
 			return rc;
 
+		device_stats_retry ((dc_device_t *) device);
+
 		// Restore the state of the progress events.
 		if (progress) {
 			progress->current = saved;
@@ -742,6 +744,8 @@ cochran_commander_device_open (dc_device_t **out, dc_context_t *context, const c
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	status = cochran_commander_serial_setup(device);
 	if (status != DC_STATUS_SUCCESS) {
 		goto error_close;
@@ -75,9 +75,21 @@ dc_context_hexdump (dc_context_t *context, dc_loglevel_t loglevel, const char *f
 dc_custom_io_t*
 _dc_context_custom_io (dc_context_t *context);
 
+dc_custom_packet_read_multi_t
+_dc_context_packet_read_multi (dc_context_t *context);
+
+dc_custom_packet_write_multi_t
+_dc_context_packet_write_multi (dc_context_t *context);
+
 dc_status_t
 dc_custom_io_serial_open(dc_iostream_t **out, dc_context_t *context, const char *name);
 
+dc_status_t
+dc_custom_io_packet_read_multi (dc_context_t *context, dc_custom_packet_t packets[], size_t count, size_t *actual);
+
+dc_status_t
+dc_custom_io_packet_write_multi (dc_context_t *context, const dc_custom_packet_t packets[], size_t count, size_t *actual);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -30,19 +30,57 @@
 #endif
 
 #include "context-private.h"
+#include "thread.h"
 #include "timer.h"
 
 #include <libdivecomputer/custom_io.h>
 
+#ifdef ENABLE_LOGGING
+#define L_MSGSIZE   (8192 + 32)
+#define L_MAXARGS   1024
+#define L_MAXPREFIX 64
+#define L_MAXDATA   4096
+
+#define L_ALIGN(n) (((n) + 7) & ~(size_t) 7)
+
+#define L_MESSAGE 0
+#define L_HEXDUMP 1
+#define L_PADDING 2
+
+/*
+ * A binary log record, stored in the log buffer. The formatting of the
+ * message is deferred until the log buffer is drained. The record is
+ * followed by the payload: the packed arguments of the format string,
+ * or the prefix and the data of a hexdump.
+ */
+typedef struct l_record_t {
+	size_t size;
+	unsigned int type;
+	dc_loglevel_t loglevel;
+	const char *file;
+	unsigned int line;
+	const char *function;
+	const char *format;
+	dc_usecs_t timestamp;
+	size_t length[2];
+	unsigned int total;
+} l_record_t;
+#endif
+
 struct dc_context_t {
 	dc_loglevel_t loglevel;
 	dc_logfunc_t logfunc;
 	void *userdata;
 #ifdef ENABLE_LOGGING
-	char msg[8192 + 32];
 	dc_timer_t *timer;
+	dc_mutex_t mutex;
+	unsigned char *logbuffer;
+	size_t logsize, loghead, logtail;
+	unsigned int logdropped;
 #endif
 	dc_custom_io_t *custom_io;
+	dc_custom_packet_read_multi_t packet_read_multi;
+	dc_custom_packet_write_multi_t packet_write_multi;
 	dc_user_device_t *user_device;
 };
 
@@ -128,14 +166,345 @@ l_hexdump (char *str, size_t size, const unsigned char data[], size_t n)
 	return (n > maxlength ? -1 : length * 2);
 }
 
+typedef enum l_argtype_t {
+	L_NONE,
+	L_INVALID,
+	L_INT,
+	L_LONG,
+	L_LLONG,
+	L_SIZE,
+	L_DOUBLE,
+	L_LDOUBLE,
+	L_STRING,
+	L_POINTER
+} l_argtype_t;
+
+typedef struct l_spec_t {
+	size_t nliteral;
+	const char *spec;
+	size_t nspec;
+	unsigned int nstars;
+	l_argtype_t type;
+} l_spec_t;
+
+/*
+ * Parse the literal text and the next conversion specification of a
+ * printf format string. Returns a pointer past the parsed part. The
+ * spec pointer is NULL when the end of the string is reached.
+ */
+static const char *
+l_parse (const char *format, l_spec_t *spec)
+{
+	const char *p = format;
+
+	while (*p && *p != '%')
+		p++;
+
+	spec->nliteral = p - format;
+	spec->spec = NULL;
+	spec->nspec = 0;
+	spec->nstars = 0;
+	spec->type = L_NONE;
+
+	if (*p == 0)
+		return p;
+
+	spec->spec = p++;
+
+	/* Flags. */
+	while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0')
+		p++;
+
+	/* Field width. */
+	if (*p == '*') {
+		spec->nstars++;
+		p++;
+	} else {
+		while (*p >= '0' && *p <= '9')
+			p++;
+	}
+
+	/* Precision. */
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			spec->nstars++;
+			p++;
+		} else {
+			while (*p >= '0' && *p <= '9')
+				p++;
+		}
+	}
+
+	/* Length modifier. */
+	l_argtype_t integer = L_INT, floating = L_DOUBLE;
+	switch (*p) {
+	case 'h':
+		p += (p[1] == 'h' ? 2 : 1);
+		break;
+	case 'l':
+		if (p[1] == 'l') {
+			integer = L_LLONG;
+			p += 2;
+		} else {
+			integer = L_LONG;
+			p += 1;
+		}
+		break;
+	case 'j':
+		integer = L_LLONG;
+		p++;
+		break;
+	case 'z':
+	case 't':
+		integer = L_SIZE;
+		p++;
+		break;
+	case 'L':
+		floating = L_LDOUBLE;
+		p++;
+		break;
+	}
+
+	/* Conversion specifier. */
+	switch (*p) {
+	case 'd': case 'i': case 'u': case 'o':
+	case 'x': case 'X': case 'c':
+		spec->type = integer;
+		break;
+	case 'e': case 'E': case 'f': case 'F':
+	case 'g': case 'G': case 'a': case 'A':
+		spec->type = floating;
+		break;
+	case 's':
+		spec->type = L_STRING;
+		break;
+	case 'p':
+		spec->type = L_POINTER;
+		break;
+	case '%':
+		spec->type = L_NONE;
+		break;
+	default:
+		spec->type = L_INVALID;
+		break;
+	}
+
+	if (*p)
+		p++;
+
+	spec->nspec = p - spec->spec;
+
+	return p;
+}
+
+#define L_PACK(type) \
+	do { \
+		type value = va_arg (ap, type); \
+		if (n + sizeof (value) > size) \
+			return n; \
+		memcpy (buffer + n, &value, sizeof (value)); \
+		n += sizeof (value); \
+	} while (0)
+
+/*
+ * Pack the arguments of a printf format string into a binary buffer.
+ * Strings are copied, because they are not guaranteed to be valid when
+ * the message is formatted. If the buffer is too small, the remaining
+ * arguments are dropped.
+ */
+static size_t
+l_pack (unsigned char buffer[], size_t size, const char *format, va_list ap)
+{
+	size_t n = 0;
+	l_spec_t spec;
+
+	while (*format) {
+		format = l_parse (format, &spec);
+		if (spec.spec == NULL || spec.type == L_INVALID)
+			break;
+
+		for (unsigned int i = 0; i < spec.nstars; ++i)
+			L_PACK (int);
+
+		switch (spec.type) {
+		case L_INT:
+			L_PACK (int);
+			break;
+		case L_LONG:
+			L_PACK (long);
+			break;
+		case L_LLONG:
+			L_PACK (long long);
+			break;
+		case L_SIZE:
+			L_PACK (size_t);
+			break;
+		case L_DOUBLE:
+			L_PACK (double);
+			break;
+		case L_LDOUBLE:
+			L_PACK (long double);
+			break;
+		case L_POINTER:
+			L_PACK (void *);
+			break;
+		case L_STRING: {
+			const char *str = va_arg (ap, const char *);
+			if (str == NULL)
+				str = "(null)";
+			if (n >= size)
+				return n;
+			size_t length = strlen (str);
+			if (length > size - n - 1)
+				length = size - n - 1;
+			memcpy (buffer + n, str, length);
+			buffer[n + length] = 0;
+			n += length + 1;
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	return n;
+}
+
+#define L_UNPACK(type, value) \
+	do { \
+		if (offset + sizeof (value) > nargs) \
+			goto done; \
+		memcpy (&value, args + offset, sizeof (value)); \
+		offset += sizeof (value); \
+	} while (0)
+
+#define L_FORMAT(value) \
+	(spec.nstars == 0 ? l_snprintf (str + n, size - n, fmt, value) : \
+	 spec.nstars == 1 ? l_snprintf (str + n, size - n, fmt, stars[0], value) : \
+	 l_snprintf (str + n, size - n, fmt, stars[0], stars[1], value))
+
+/*
+ * Format a message from a printf format string and the arguments packed
+ * with the l_pack function.
+ */
+static int
+l_format (char *str, size_t size, const char *format, const unsigned char args[], size_t nargs)
+{
+	size_t n = 0, offset = 0;
+	l_spec_t spec;
+	char fmt[32];
+
+	if (size == 0)
+		return -1;
+
+	str[0] = 0;
+
+	while (*format) {
+		const char *literal = format;
+		format = l_parse (format, &spec);
+
+		/* Append the literal text. */
+		size_t length = spec.nliteral;
+		if (length > size - n - 1)
+			length = size - n - 1;
+		memcpy (str + n, literal, length);
+		n += length;
+		str[n] = 0;
+
+		if (spec.spec == NULL)
+			break;
+
+		if (spec.type == L_INVALID || spec.nspec >= sizeof (fmt)) {
+			/* Append the remainder of the format string unchanged. */
+			l_snprintf (str + n, size - n, "%s", spec.spec);
+			break;
+		}
+
+		memcpy (fmt, spec.spec, spec.nspec);
+		fmt[spec.nspec] = 0;
+
+		int stars[2] = {0, 0};
+		for (unsigned int i = 0; i < spec.nstars; ++i)
+			L_UNPACK (int, stars[i]);
+
+		int rc = 0;
+		switch (spec.type) {
+		case L_NONE:
+			rc = l_snprintf (str + n, size - n, "%%");
+			break;
+		case L_INT: {
+			int value;
+			L_UNPACK (int, value);
+			rc = L_FORMAT (value);
+			break;
+		}
+		case L_LONG: {
+			long value;
+			L_UNPACK (long, value);
+			rc = L_FORMAT (value);
+			break;
+		}
+		case L_LLONG: {
+			long long value;
+			L_UNPACK (long long, value);
+			rc = L_FORMAT (value);
+			break;
+		}
+		case L_SIZE: {
+			size_t value;
+			L_UNPACK (size_t, value);
+			rc = L_FORMAT (value);
+			break;
+		}
+		case L_DOUBLE: {
+			double value;
+			L_UNPACK (double, value);
+			rc = L_FORMAT (value);
+			break;
+		}
+		case L_LDOUBLE: {
+			long double value;
+			L_UNPACK (long double, value);
+			rc = L_FORMAT (value);
+			break;
+		}
+		case L_POINTER: {
+			void *value;
+			L_UNPACK (void *, value);
+			rc = L_FORMAT (value);
+			break;
+		}
+		case L_STRING: {
+			const char *value = (const char *) args + offset;
+			if (offset >= nargs)
+				goto done;
+			const unsigned char *end = (const unsigned char *) memchr (args + offset, 0, nargs - offset);
+			if (end == NULL)
+				goto done;
+			offset = end - args + 1;
+			rc = L_FORMAT (value);
+			break;
+		}
+		default:
+			break;
+		}
+
+		if (rc < 0)
+			return -1;
+
+		n += rc;
+	}
+
+done:
+	return n;
+}
+
 static void
-logfunc (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *msg, void *userdata)
+l_print (dc_usecs_t now, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *msg)
 {
 	const char *loglevels[] = {"NONE", "ERROR", "WARNING", "INFO", "DEBUG", "ALL"};
 
-	dc_usecs_t now = 0;
-	dc_timer_now (context->timer, &now);
-
 	unsigned long seconds = now / 1000000;
 	unsigned long microseconds = now % 1000000;
 
@@ -149,6 +518,122 @@ logfunc (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsign
 			loglevels[loglevel], msg);
 	}
 }
+
+static void
+logfunc (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *msg, void *userdata)
+{
+	dc_usecs_t now = 0;
+	dc_timer_now (context->timer, &now);
+
+	l_print (now, loglevel, file, line, function, msg);
+}
+
+static void
+l_emit (dc_context_t *context, dc_usecs_t timestamp, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *msg)
+{
+	/*
+	 * The default log function prints the time of the original log call,
+	 * and not the time at which the message is emitted.
+	 */
+	if (context->logfunc == logfunc) {
+		l_print (timestamp, loglevel, file, line, function, msg);
+	} else {
+		context->logfunc (context, loglevel, file, line, function, msg, context->userdata);
+	}
+}
+
+/*
+ * Append a record to the log buffer. The payload consists of two
+ * parts. Records which do not fit in the free space are dropped.
+ * Returns zero if there is no log buffer, and the record needs to be
+ * emitted directly by the caller. The buffer is checked under the
+ * lock, because it can be replaced from another thread.
+ */
+static int
+l_append (dc_context_t *context, l_record_t *record, const void *data1, const void *data2)
+{
+	record->size = L_ALIGN (sizeof (l_record_t) + record->length[0] + record->length[1]);
+
+	dc_mutex_lock (&context->mutex);
+
+	if (context->logbuffer == NULL) {
+		dc_mutex_unlock (&context->mutex);
+		return 0;
+	}
+
+	/* Records are never split, but wrap to the start of the buffer. */
+	size_t offset = context->loghead % context->logsize;
+	size_t padding = 0;
+	if (context->logsize - offset < record->size)
+		padding = context->logsize - offset;
+
+	size_t available = context->logsize - (context->loghead - context->logtail);
+	if (padding + record->size > available) {
+		context->logdropped++;
+		dc_mutex_unlock (&context->mutex);
+		return 1;
+	}
+
+	if (padding) {
+		if (padding >= sizeof (l_record_t)) {
+			l_record_t *pad = (l_record_t *) (context->logbuffer + offset);
+			pad->size = padding;
+			pad->type = L_PADDING;
+		}
+		context->loghead += padding;
+		offset = 0;
+	}
+
+	unsigned char *p = context->logbuffer + offset;
+	memcpy (p, record, sizeof (l_record_t));
+	if (record->length[0])
+		memcpy (p + sizeof (l_record_t), data1, record->length[0]);
+	if (record->length[1])
+		memcpy (p + sizeof (l_record_t) + record->length[0], data2, record->length[1]);
+	context->loghead += record->size;
+
+	dc_mutex_unlock (&context->mutex);
+
+	return 1;
+}
+
+/*
+ * Remove the oldest record from the log buffer. Returns zero if the
+ * buffer is empty.
+ */
+static int
+l_remove (dc_context_t *context, unsigned char buffer[], size_t size, unsigned int *dropped)
+{
+	int found = 0;
+
+	dc_mutex_lock (&context->mutex);
+
+	*dropped = context->logdropped;
+	context->logdropped = 0;
+
+	while (context->logbuffer && context->logtail != context->loghead) {
+		size_t offset = context->logtail % context->logsize;
+
+		/* Skip the padding at the end of the buffer. */
+		if (context->logsize - offset < sizeof (l_record_t)) {
+			context->logtail += context->logsize - offset;
+			continue;
+		}
+
+		const l_record_t *record = (const l_record_t *) (context->logbuffer + offset);
+		context->logtail += record->size;
+		if (record->type == L_PADDING || record->size > size)
+			continue;
+
+		memcpy (buffer, record, record->size);
+		found = 1;
+		break;
+	}
+
+	dc_mutex_unlock (&context->mutex);
+
+	return found;
+}
 #endif
 
 dc_status_t
@@ -173,12 +658,25 @@ dc_context_new (dc_context_t **out)
 	context->userdata = NULL;
 
 #ifdef ENABLE_LOGGING
-	memset (context->msg, 0, sizeof (context->msg));
 	context->timer = NULL;
 	dc_timer_new (&context->timer);
+
+	if (dc_mutex_init (&context->mutex) != DC_STATUS_SUCCESS) {
+		dc_timer_free (context->timer);
+		free (context);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	context->logbuffer = NULL;
+	context->logsize = 0;
+	context->loghead = 0;
+	context->logtail = 0;
+	context->logdropped = 0;
 #endif
 
 	context->custom_io = NULL;
+	context->packet_read_multi = NULL;
+	context->packet_write_multi = NULL;
 
 	*out = context;
 
@@ -191,7 +689,12 @@ dc_context_free (dc_context_t *context)
 	if (context == NULL)
 		return DC_STATUS_SUCCESS;
 
+#ifdef ENABLE_LOGGING
+	// Emit the remaining messages.
+	dc_context_set_logbuffer (context, 0);
+	dc_mutex_free (&context->mutex);
 	dc_timer_free (context->timer);
+#endif
 	free (context);
 
 	return DC_STATUS_SUCCESS;
@@ -204,17 +707,43 @@ dc_context_set_custom_io (dc_context_t *context, dc_custom_io_t *custom_io, dc_u
 		return DC_STATUS_INVALIDARGS;
 
 	context->custom_io = custom_io;
+	context->packet_read_multi = NULL;
+	context->packet_write_multi = NULL;
 	custom_io->user_device = user_device;
 
 	return DC_STATUS_SUCCESS;
 }
 
+dc_status_t
+dc_context_set_custom_packet_multi (dc_context_t *context, dc_custom_packet_read_multi_t read_multi, dc_custom_packet_write_multi_t write_multi)
+{
+	if (context == NULL || context->custom_io == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	context->packet_read_multi = read_multi;
+	context->packet_write_multi = write_multi;
+
+	return DC_STATUS_SUCCESS;
+}
+
 dc_custom_io_t*
 _dc_context_custom_io (dc_context_t *context)
 {
 	return context->custom_io;
 }
 
+dc_custom_packet_read_multi_t
+_dc_context_packet_read_multi (dc_context_t *context)
+{
+	return context->packet_read_multi;
+}
+
+dc_custom_packet_write_multi_t
+_dc_context_packet_write_multi (dc_context_t *context)
+{
+	return context->packet_write_multi;
+}
+
 dc_status_t
 dc_context_set_loglevel (dc_context_t *context, dc_loglevel_t loglevel)
 {
@@ -242,6 +771,88 @@ dc_context_set_logfunc (dc_context_t *context, dc_logfunc_t logfunc, void *userd
 	return DC_STATUS_SUCCESS;
 }
 
+dc_status_t
+dc_context_set_logbuffer (dc_context_t *context, size_t size)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef ENABLE_LOGGING
+	unsigned char *logbuffer = NULL;
+	if (size) {
+		size = L_ALIGN (size);
+		if (size < sizeof (l_record_t))
+			return DC_STATUS_INVALIDARGS;
+
+		logbuffer = (unsigned char *) malloc (size);
+		if (logbuffer == NULL)
+			return DC_STATUS_NOMEMORY;
+	}
+
+	// Emit the messages in the old buffer first.
+	dc_context_drain_log (context);
+
+	dc_mutex_lock (&context->mutex);
+	free (context->logbuffer);
+	context->logbuffer = logbuffer;
+	context->logsize = size;
+	context->loghead = 0;
+	context->logtail = 0;
+	dc_mutex_unlock (&context->mutex);
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_drain_log (dc_context_t *context)
+{
+#ifdef ENABLE_LOGGING
+	unsigned char buffer[sizeof (l_record_t) + L_MAXARGS + L_MAXPREFIX + L_MAXDATA + 8];
+	unsigned int dropped = 0;
+	char msg[L_MSGSIZE];
+#endif
+
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef ENABLE_LOGGING
+	while (l_remove (context, buffer, sizeof (buffer), &dropped)) {
+		const l_record_t *record = (const l_record_t *) buffer;
+		const unsigned char *payload = buffer + sizeof (l_record_t);
+
+		if (dropped && context->logfunc) {
+			l_snprintf (msg, sizeof (msg), "%u log messages dropped", dropped);
+			l_emit (context, record->timestamp, DC_LOGLEVEL_WARNING, __FILE__, __LINE__, FUNCTION, msg);
+		}
+
+		if (context->logfunc == NULL)
+			continue;
+
+		if (record->type == L_HEXDUMP) {
+			int n = l_snprintf (msg, sizeof (msg), "%.*s: size=%u, data=",
+				(int) record->length[0], (const char *) payload, record->total);
+			if (n >= 0) {
+				l_hexdump (msg + n, sizeof (msg) - n, payload + record->length[0], record->length[1]);
+			}
+		} else {
+			l_format (msg, sizeof (msg), record->format, payload, record->length[0]);
+		}
+
+		l_emit (context, record->timestamp, record->loglevel, record->file, record->line, record->function, msg);
+	}
+
+	if (dropped && context->logfunc) {
+		dc_usecs_t now = 0;
+		dc_timer_now (context->timer, &now);
+		l_snprintf (msg, sizeof (msg), "%u log messages dropped", dropped);
+		l_emit (context, now, DC_LOGLEVEL_WARNING, __FILE__, __LINE__, FUNCTION, msg);
+	}
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
 dc_status_t
 dc_context_log (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *format, ...)
 {
@@ -259,11 +870,38 @@ dc_context_log (dc_context_t *context, dc_loglevel_t loglevel, const char *file,
 	if (context->logfunc == NULL)
 		return DC_STATUS_SUCCESS;
 
+	// The log buffer is checked without the lock first, to keep the
+	// default path cheap, and checked again under the lock in l_append.
+	// If it was disabled in the meantime, the message is emitted directly.
+	if (context->logbuffer) {
+		l_record_t record;
+		unsigned char args[L_MAXARGS];
+
+		va_start (ap, format);
+		record.length[0] = l_pack (args, sizeof (args), format, ap);
+		va_end (ap);
+
+		record.type = L_MESSAGE;
+		record.loglevel = loglevel;
+		record.file = file;
+		record.line = line;
+		record.function = function;
+		record.format = format;
+		record.length[1] = 0;
+		record.total = 0;
+		dc_timer_now (context->timer, &record.timestamp);
+
+		if (l_append (context, &record, args, NULL))
+			return DC_STATUS_SUCCESS;
+	}
+
+	char msg[L_MSGSIZE];
+
 	va_start (ap, format);
-	l_vsnprintf (context->msg, sizeof (context->msg), format, ap);
+	l_vsnprintf (msg, sizeof (msg), format, ap);
 	va_end (ap);
 
-	context->logfunc (context, loglevel, file, line, function, context->msg, context->userdata);
+	context->logfunc (context, loglevel, file, line, function, msg, context->userdata);
 #endif
 
 	return DC_STATUS_SUCCESS;
@@ -326,13 +964,37 @@ dc_context_hexdump (dc_context_t *context, dc_loglevel_t loglevel, const char *f
 	if (context->logfunc == NULL)
 		return DC_STATUS_SUCCESS;
 
-	n = l_snprintf (context->msg, sizeof (context->msg), "%s: size=%u, data=", prefix, size);
+	if (context->logbuffer) {
+		// Store the raw data, and encode it when the buffer is drained.
+		l_record_t record;
+		size_t length = strlen (prefix);
+		if (length > L_MAXPREFIX)
+			length = L_MAXPREFIX;
+
+		record.type = L_HEXDUMP;
+		record.loglevel = loglevel;
+		record.file = file;
+		record.line = line;
+		record.function = function;
+		record.format = NULL;
+		record.length[0] = length;
+		record.length[1] = (size > L_MAXDATA ? L_MAXDATA : size);
+		record.total = size;
+		dc_timer_now (context->timer, &record.timestamp);
+
+		if (l_append (context, &record, prefix, data))
+			return DC_STATUS_SUCCESS;
+	}
+
+	char msg[L_MSGSIZE];
+
+	n = l_snprintf (msg, sizeof (msg), "%s: size=%u, data=", prefix, size);
 
 	if (n >= 0) {
-		n = l_hexdump (context->msg + n, sizeof (context->msg) - n, data, size);
+		n = l_hexdump (msg + n, sizeof (msg) - n, data, size);
 	}
 
-	context->logfunc (context, loglevel, file, line, function, context->msg, context->userdata);
+	context->logfunc (context, loglevel, file, line, function, msg, context->userdata);
 #endif
 
 	return DC_STATUS_SUCCESS;
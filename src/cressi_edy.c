@@ -164,6 +164,8 @@ cressi_edy_transfer (cressi_edy_device_t *device, const unsigned char command[],
 		if (nretries++ >= MAXRETRIES)
 			return rc;
 
+		device_stats_retry ((dc_device_t *) device);
+
 		// Delay the next attempt.
 		dc_iostream_sleep (device->iostream, 300);
 		dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
@@ -246,6 +248,8 @@ cressi_edy_device_open (dc_device_t **out, dc_context_t *context, const char *na
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (1200 8N1).
 	status = dc_iostream_configure (device->iostream, 1200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
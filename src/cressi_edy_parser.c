@@ -50,6 +50,7 @@ static const dc_parser_vtable_t cressi_edy_parser_vtable = {
 	cressi_edy_parser_get_datetime, /* datetime */
 	cressi_edy_parser_get_field, /* fields */
 	cressi_edy_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_decode */
 	NULL /* destroy */
 };
 
@@ -155,6 +155,8 @@ cressi_leonardo_transfer (cressi_leonardo_device_t *device, const unsigned char
 		if (nretries++ >= MAXRETRIES)
 			return rc;
 
+		device_stats_retry ((dc_device_t *) device);
+
 		// Discard any garbage bytes.
 		dc_iostream_sleep (device->iostream, 100);
 		dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
@@ -190,6 +192,8 @@ cressi_leonardo_device_open (dc_device_t **out, dc_context_t *context, const cha
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -428,6 +432,8 @@ cressi_leonardo_device_foreach (dc_device_t *abstract, dc_dive_callback_t callba
 	devinfo.serial = array_uint24_le (data + 1);
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
+	device_image_set_memory (abstract, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+
 	rc = cressi_leonardo_extract_dives (abstract, dc_buffer_get_data (buffer),
 		dc_buffer_get_size (buffer), callback, userdata);
 
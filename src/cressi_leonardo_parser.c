@@ -51,6 +51,7 @@ static const dc_parser_vtable_t cressi_leonardo_parser_vtable = {
 	cressi_leonardo_parser_get_datetime, /* datetime */
 	cressi_leonardo_parser_get_field, /* fields */
 	cressi_leonardo_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_decode */
 	NULL /* destroy */
 };
 
@@ -194,6 +194,7 @@ static const dc_iostream_vtable_t dc_custom_vtable = {
 	dc_custom_configure, /* configure */
 	dc_custom_read, /* read */
 	dc_custom_write, /* write */
+	NULL, /* writev */
 	dc_custom_flush, /* flush */
 	dc_custom_purge, /* purge */
 	dc_custom_sleep, /* sleep */
@@ -216,3 +217,76 @@ dc_custom_io_serial_open(dc_iostream_t **out, dc_context_t *context, const char
 	*out = (dc_iostream_t *) custom;
 	return io->serial_open(io, context, name);
 }
+
+dc_status_t
+dc_custom_io_packet_read_multi (dc_context_t *context, dc_custom_packet_t packets[], size_t count, size_t *actual)
+{
+	dc_custom_io_t *io = _dc_context_custom_io (context);
+	dc_custom_packet_read_multi_t read_multi = _dc_context_packet_read_multi (context);
+	dc_status_t status = DC_STATUS_SUCCESS;
+	size_t npackets = 0;
+
+	if (count == 0)
+		goto out;
+
+	if (read_multi) {
+		status = read_multi (io, packets, count, &npackets);
+		goto out;
+	}
+
+	if (!io->packet_read) {
+		status = DC_STATUS_UNSUPPORTED;
+		goto out;
+	}
+
+	// Without the batched function, it's unknown whether more packets
+	// are available, so only a single packet is read.
+	size_t transferred = 0;
+	status = io->packet_read (io, packets[0].data, packets[0].size, &transferred);
+	if (status == DC_STATUS_SUCCESS) {
+		packets[0].size = transferred;
+		npackets = 1;
+	}
+
+out:
+	if (actual)
+		*actual = npackets;
+
+	return status;
+}
+
+dc_status_t
+dc_custom_io_packet_write_multi (dc_context_t *context, const dc_custom_packet_t packets[], size_t count, size_t *actual)
+{
+	dc_custom_io_t *io = _dc_context_custom_io (context);
+	dc_custom_packet_write_multi_t write_multi = _dc_context_packet_write_multi (context);
+	dc_status_t status = DC_STATUS_SUCCESS;
+	size_t npackets = 0;
+
+	if (count == 0)
+		goto out;
+
+	if (write_multi) {
+		status = write_multi (io, packets, count, &npackets);
+		goto out;
+	}
+
+	if (!io->packet_write) {
+		status = DC_STATUS_UNSUPPORTED;
+		goto out;
+	}
+
+	while (npackets < count) {
+		size_t transferred = 0;
+		status = io->packet_write (io, packets[npackets].data, packets[npackets].size, &transferred);
+		if (status != DC_STATUS_SUCCESS)
+			break;
+		npackets++;
+	}
+
+out:
+	if (actual)
+		*actual = npackets;
+
+	return status;
+}
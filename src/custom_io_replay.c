@@ -0,0 +1,546 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2018 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h> // malloc, free
+#include <string.h> // memcmp, memcpy, strstr
+#include <stdio.h>  // fopen, fread
+
+#ifdef _WIN32
+#define NOGDI
+#include <windows.h>
+#else
+#include <time.h>
+#include <errno.h>
+#endif
+
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/custom_io.h>
+#include <libdivecomputer/buffer.h>
+
+#include "context-private.h"
+#include "timer.h"
+
+#define READ  "INFO: Read: size="
+#define WRITE "INFO: Write: size="
+
+typedef struct dc_replay_segment_t {
+	/* Number of bytes written before the data is sent. */
+	size_t gate;
+	/* Location of the data in the input stream. */
+	size_t begin;
+	size_t end;
+	/* Time at which the response becomes available. */
+	dc_usecs_t ready;
+} dc_replay_segment_t;
+
+typedef struct dc_replay_t {
+	/* Base class. */
+	dc_custom_io_t base;
+	/* Internal state. */
+	dc_context_t *context;
+	dc_timer_t *timer;
+	unsigned int packet_latency;
+	unsigned int byte_latency;
+	long timeout;
+	/* Transcript. */
+	dc_buffer_t *input;
+	dc_buffer_t *output;
+	dc_replay_segment_t *segments;
+	unsigned int nsegments;
+	unsigned int capacity;
+	/* Replay position. */
+	size_t nwritten;
+	size_t nread;
+	unsigned int current;
+	dc_usecs_t finish;
+} dc_replay_t;
+
+static dc_usecs_t
+dc_replay_now (dc_replay_t *replay)
+{
+	dc_usecs_t now = 0;
+	dc_timer_now (replay->timer, &now);
+	return now;
+}
+
+static void
+dc_replay_wait (dc_replay_t *replay, dc_usecs_t until)
+{
+	dc_usecs_t now = dc_replay_now (replay);
+	while (now < until) {
+		// Sleep for most of the remaining time, and busy wait for the
+		// rest, because the resolution of the sleep functions is much
+		// worse than the latency of a single byte.
+		dc_usecs_t remaining = until - now;
+		if (remaining > 2000) {
+#ifdef _WIN32
+			Sleep ((DWORD) ((remaining - 1000) / 1000));
+#else
+			struct timespec ts;
+			ts.tv_sec  = (remaining - 1000) / 1000000;
+			ts.tv_nsec = ((remaining - 1000) % 1000000) * 1000;
+			while (nanosleep (&ts, &ts) != 0 && errno == EINTR);
+#endif
+		}
+		now = dc_replay_now (replay);
+	}
+}
+
+static int
+dc_replay_hex (unsigned char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+static dc_status_t
+dc_replay_parse (dc_replay_t *replay, const char *line, size_t length, unsigned int lineno)
+{
+	dc_buffer_t *buffer = NULL;
+	const char *p = NULL;
+
+	// Locate the hexdump of a read or write operation.
+	if ((p = strstr (line, READ)) != NULL) {
+		buffer = replay->input;
+		p += strlen (READ);
+	} else if ((p = strstr (line, WRITE)) != NULL) {
+		buffer = replay->output;
+		p += strlen (WRITE);
+	} else {
+		return DC_STATUS_SUCCESS;
+	}
+
+	const char *end = line + length;
+	size_t size = strtoul (p, NULL, 10);
+	p = strstr (p, "data=");
+	if (p == NULL) {
+		ERROR (replay->context, "Invalid transcript record (line %u).", lineno);
+		return DC_STATUS_DATAFORMAT;
+	}
+	p += 5;
+
+	// Decode the data.
+	size_t offset = dc_buffer_get_size (buffer);
+	if (!dc_buffer_resize (buffer, offset + size)) {
+		ERROR (replay->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	unsigned char *data = dc_buffer_get_data (buffer) + offset;
+	for (size_t i = 0; i < size; ++i) {
+		int hi = -1, lo = -1;
+		if (p + 1 < end) {
+			hi = dc_replay_hex (p[0]);
+			lo = dc_replay_hex (p[1]);
+		}
+		if (hi < 0 || lo < 0) {
+			// The hexdump of large packets is truncated in the log.
+			ERROR (replay->context, "Truncated transcript record (line %u).", lineno);
+			return DC_STATUS_DATAFORMAT;
+		}
+		data[i] = (hi << 4) | lo;
+		p += 2;
+	}
+
+	if (buffer == replay->output || size == 0)
+		return DC_STATUS_SUCCESS;
+
+	// Consecutive reads without a write in between are combined into a
+	// single response.
+	size_t gate = dc_buffer_get_size (replay->output);
+	if (replay->nsegments && replay->segments[replay->nsegments - 1].gate == gate) {
+		replay->segments[replay->nsegments - 1].end += size;
+		return DC_STATUS_SUCCESS;
+	}
+
+	if (replay->nsegments == replay->capacity) {
+		unsigned int capacity = replay->capacity ? replay->capacity * 2 : 64;
+		dc_replay_segment_t *segments = (dc_replay_segment_t *) realloc (replay->segments, capacity * sizeof (dc_replay_segment_t));
+		if (segments == NULL) {
+			ERROR (replay->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+
+		replay->segments = segments;
+		replay->capacity = capacity;
+	}
+
+	dc_replay_segment_t *segment = replay->segments + replay->nsegments++;
+	segment->gate = gate;
+	segment->begin = offset;
+	segment->end = offset + size;
+	segment->ready = 0;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_replay_load (dc_replay_t *replay, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	FILE *fp = fopen (filename, "rb");
+	if (fp == NULL) {
+		ERROR (replay->context, "Failed to open the transcript.");
+		return DC_STATUS_IO;
+	}
+
+	// Read the entire file.
+	dc_buffer_t *buffer = dc_buffer_new (0);
+	if (buffer == NULL) {
+		fclose (fp);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	size_t nbytes = 0;
+	unsigned char block[4096];
+	while ((nbytes = fread (block, 1, sizeof (block), fp)) > 0) {
+		if (!dc_buffer_append (buffer, block, nbytes)) {
+			ERROR (replay->context, "Failed to allocate memory.");
+			status = DC_STATUS_NOMEMORY;
+			goto error;
+		}
+	}
+
+	// Add a terminating null byte for the string functions.
+	if (!dc_buffer_append (buffer, (const unsigned char *) "", 1)) {
+		ERROR (replay->context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error;
+	}
+
+	// Parse the transcript line by line.
+	char *text = (char *) dc_buffer_get_data (buffer);
+	unsigned int lineno = 1;
+	while (*text) {
+		char *eol = strchr (text, '\n');
+		if (eol)
+			*eol = 0;
+
+		status = dc_replay_parse (replay, text, strlen (text), lineno);
+		if (status != DC_STATUS_SUCCESS)
+			goto error;
+
+		if (eol == NULL)
+			break;
+
+		text = eol + 1;
+		lineno++;
+	}
+
+	if (dc_buffer_get_size (replay->output) == 0 && replay->nsegments == 0) {
+		ERROR (replay->context, "Empty transcript.");
+		status = DC_STATUS_DATAFORMAT;
+		goto error;
+	}
+
+error:
+	dc_buffer_free (buffer);
+	fclose (fp);
+	return status;
+}
+
+static void
+dc_replay_release (dc_replay_t *replay, dc_usecs_t now)
+{
+	// Responses become available once all data preceding them in the
+	// transcript has been written.
+	for (unsigned int i = replay->current; i < replay->nsegments; ++i) {
+		dc_replay_segment_t *segment = replay->segments + i;
+		if (segment->gate > replay->nwritten)
+			break;
+		if (segment->ready == 0)
+			segment->ready = now + replay->packet_latency;
+	}
+}
+
+static dc_usecs_t
+dc_replay_base (dc_replay_t *replay, const dc_replay_segment_t *segment)
+{
+	// A response can't start before the previous one is finished.
+	return segment->ready > replay->finish ? segment->ready : replay->finish;
+}
+
+static dc_status_t
+dc_replay_serial_open (dc_custom_io_t *io, dc_context_t *context, const char *name)
+{
+	dc_replay_t *replay = (dc_replay_t *) io;
+
+	// Rewind the transcript.
+	replay->nwritten = 0;
+	replay->nread = 0;
+	replay->current = 0;
+	replay->finish = 0;
+	replay->timeout = -1;
+	for (unsigned int i = 0; i < replay->nsegments; ++i) {
+		replay->segments[i].ready = 0;
+	}
+
+	dc_replay_release (replay, dc_replay_now (replay));
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_replay_serial_close (dc_custom_io_t *io)
+{
+	dc_replay_t *replay = (dc_replay_t *) io;
+
+	if (replay->nwritten != dc_buffer_get_size (replay->output) ||
+		replay->nread != dc_buffer_get_size (replay->input)) {
+		WARNING (replay->context, "Transcript not finished (%zu of %zu bytes written, %zu of %zu bytes read).",
+			replay->nwritten, dc_buffer_get_size (replay->output),
+			replay->nread, dc_buffer_get_size (replay->input));
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_replay_serial_read (dc_custom_io_t *io, void *data, size_t size, size_t *actual)
+{
+	dc_replay_t *replay = (dc_replay_t *) io;
+	const unsigned char *input = dc_buffer_get_data (replay->input);
+	unsigned char *buffer = (unsigned char *) data;
+	size_t nbytes = 0;
+
+	dc_usecs_t deadline = 0;
+	if (replay->timeout >= 0)
+		deadline = dc_replay_now (replay) + replay->timeout * 1000ULL;
+
+	while (nbytes < size && replay->current < replay->nsegments) {
+		dc_replay_segment_t *segment = replay->segments + replay->current;
+
+		// The response isn't sent before the request is written, so
+		// waiting is pointless.
+		if (segment->ready == 0)
+			break;
+
+		size_t len = size - nbytes;
+		if (len > segment->end - replay->nread)
+			len = segment->end - replay->nread;
+
+		// Wait for the arrival of the data.
+		dc_usecs_t base = dc_replay_base (replay, segment);
+		dc_usecs_t arrival = base + (replay->nread - segment->begin + len) * replay->byte_latency;
+		unsigned int expired = 0;
+		if (deadline && arrival > deadline) {
+			size_t n = 0;
+			if (deadline > base && replay->byte_latency)
+				n = (deadline - base) / replay->byte_latency - (replay->nread - segment->begin);
+			if (n < len)
+				len = n;
+			arrival = deadline;
+			expired = 1;
+		}
+		dc_replay_wait (replay, arrival);
+
+		memcpy (buffer + nbytes, input + replay->nread, len);
+		replay->nread += len;
+		nbytes += len;
+
+		if (replay->nread == segment->end) {
+			replay->finish = base + (segment->end - segment->begin) * replay->byte_latency;
+			replay->current++;
+		}
+
+		if (expired)
+			break;
+	}
+
+	if (actual)
+		*actual = nbytes;
+
+	return nbytes == size ? DC_STATUS_SUCCESS : DC_STATUS_TIMEOUT;
+}
+
+static dc_status_t
+dc_replay_serial_write (dc_custom_io_t *io, const void *data, size_t size, size_t *actual)
+{
+	dc_replay_t *replay = (dc_replay_t *) io;
+	const unsigned char *output = dc_buffer_get_data (replay->output);
+
+	// Verify the data against the transcript.
+	if (size > dc_buffer_get_size (replay->output) - replay->nwritten ||
+		memcmp (data, output + replay->nwritten, size) != 0) {
+		ERROR (replay->context, "Unexpected data written at offset %zu.", replay->nwritten);
+		if (actual)
+			*actual = 0;
+		return DC_STATUS_PROTOCOL;
+	}
+
+	// Wait for the transmission of the data.
+	dc_usecs_t now = dc_replay_now (replay) + size * replay->byte_latency;
+	dc_replay_wait (replay, now);
+
+	replay->nwritten += size;
+	dc_replay_release (replay, now);
+
+	if (actual)
+		*actual = size;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_replay_serial_purge (dc_custom_io_t *io, dc_direction_t direction)
+{
+	// Data discarded during the recording never shows up in the
+	// transcript, so there is nothing to discard.
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_replay_serial_get_available (dc_custom_io_t *io, size_t *value)
+{
+	dc_replay_t *replay = (dc_replay_t *) io;
+	size_t available = 0;
+
+	if (replay->current < replay->nsegments) {
+		dc_replay_segment_t *segment = replay->segments + replay->current;
+		dc_usecs_t now = dc_replay_now (replay);
+		dc_usecs_t base = dc_replay_base (replay, segment);
+		if (segment->ready && now >= base) {
+			available = segment->end - replay->nread;
+			if (replay->byte_latency) {
+				size_t arrived = (now - base) / replay->byte_latency;
+				size_t consumed = replay->nread - segment->begin;
+				if (arrived < consumed + available)
+					available = arrived > consumed ? arrived - consumed : 0;
+			}
+		}
+	}
+
+	*value = available;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_replay_serial_set_timeout (dc_custom_io_t *io, long timeout)
+{
+	dc_replay_t *replay = (dc_replay_t *) io;
+
+	replay->timeout = timeout;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_replay_serial_configure (dc_custom_io_t *io, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
+{
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_replay_serial_set_level (dc_custom_io_t *io, int level)
+{
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_replay_serial_set_break (dc_custom_io_t *io, unsigned int level)
+{
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_custom_io_replay_new (dc_custom_io_t **out, dc_context_t *context, const char *filename, unsigned int packet_latency, unsigned int byte_latency)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_replay_t *replay = NULL;
+
+	if (out == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Allocate memory.
+	replay = (dc_replay_t *) calloc (1, sizeof (dc_replay_t));
+	if (replay == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	replay->context = context;
+	replay->packet_latency = packet_latency;
+	replay->byte_latency = byte_latency;
+	replay->timeout = -1;
+	replay->input = dc_buffer_new (0);
+	replay->output = dc_buffer_new (0);
+	if (replay->input == NULL || replay->output == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_free;
+	}
+
+	status = dc_timer_new (&replay->timer);
+	if (status != DC_STATUS_SUCCESS) {
+		goto error_free;
+	}
+
+	status = dc_replay_load (replay, filename);
+	if (status != DC_STATUS_SUCCESS) {
+		goto error_free;
+	}
+
+	INFO (context, "Loaded transcript with %u responses (%zu bytes written, %zu bytes read).",
+		replay->nsegments, dc_buffer_get_size (replay->output), dc_buffer_get_size (replay->input));
+
+	replay->base.userdata = replay;
+	replay->base.serial_open = dc_replay_serial_open;
+	replay->base.serial_close = dc_replay_serial_close;
+	replay->base.serial_read = dc_replay_serial_read;
+	replay->base.serial_write = dc_replay_serial_write;
+	replay->base.serial_purge = dc_replay_serial_purge;
+	replay->base.serial_get_available = dc_replay_serial_get_available;
+	replay->base.serial_set_timeout = dc_replay_serial_set_timeout;
+	replay->base.serial_configure = dc_replay_serial_configure;
+	replay->base.serial_set_dtr = dc_replay_serial_set_level;
+	replay->base.serial_set_rts = dc_replay_serial_set_level;
+	replay->base.serial_set_break = dc_replay_serial_set_break;
+
+	*out = (dc_custom_io_t *) replay;
+
+	return DC_STATUS_SUCCESS;
+
+error_free:
+	dc_custom_io_replay_free ((dc_custom_io_t *) replay);
+	return status;
+}
+
+void
+dc_custom_io_replay_free (dc_custom_io_t *io)
+{
+	dc_replay_t *replay = (dc_replay_t *) io;
+
+	if (replay == NULL)
+		return;
+
+	dc_timer_free (replay->timer);
+	dc_buffer_free (replay->input);
+	dc_buffer_free (replay->output);
+	free (replay->segments);
+	free (replay);
+}
@@ -26,8 +26,14 @@
 
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/device.h>
+#include <libdivecomputer/iostream.h>
+#include <libdivecomputer/image.h>
 
 #include "common-private.h"
+#include "divebuf-private.h"
+#include "timer.h"
+#include "fpindex.h"
+#include "checkpoint.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -54,6 +60,22 @@ struct dc_device_t {
 	// Cached events for the parsers.
 	dc_event_devinfo_t devinfo;
 	dc_event_clock_t clock;
+	// Directory for persistent state.
+	char *cachedir;
+	// Persistent index of the downloaded dives.
+	unsigned int fpindex_enabled;
+	dc_fpindex_t *fpindex;
+	// Progress of an interrupted download.
+	dc_checkpoint_t *checkpoint;
+	// Image recording the downloaded data.
+	dc_image_t *image;
+	// Memory block containing the dives that are being downloaded.
+	dc_membuf_t *membuf;
+	// Transfer statistics.
+	dc_event_stats_t stats;
+	dc_timer_t *timer;
+	dc_usecs_t request;
+	unsigned int pending;
 };
 
 struct dc_device_vtable_t {
@@ -88,9 +110,33 @@ dc_device_deallocate (dc_device_t *device);
 void
 device_event_emit (dc_device_t *device, dc_event_type_t event, const void *data);
 
+void
+device_set_membuf (dc_device_t *device, dc_membuf_t *membuf);
+
 int
 device_is_cancelled (dc_device_t *device);
 
+void
+device_set_iostream (dc_device_t *device, dc_iostream_t *iostream);
+
+void
+device_stats_transfer (dc_device_t *device, dc_direction_t direction, size_t nbytes);
+
+void
+device_stats_retry (dc_device_t *device);
+
+int
+device_is_known_dive (dc_device_t *device, const unsigned char fingerprint[], unsigned int size);
+
+void
+device_image_set_memory (dc_device_t *device, const unsigned char data[], unsigned int size);
+
+int
+device_checkpoint_lookup (dc_device_t *device, const unsigned char key[], unsigned int keysize, const unsigned char **data, unsigned int *size, unsigned int *flags);
+
+dc_status_t
+device_checkpoint_store (dc_device_t *device, const unsigned char key[], unsigned int keysize, unsigned int offset, const unsigned char data[], unsigned int size, unsigned int flags);
+
 dc_status_t
 device_dump_read (dc_device_t *device, unsigned char data[], unsigned int size, unsigned int blocksize);
 
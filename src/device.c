@@ -22,6 +22,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
 
 #include "suunto_d9.h"
 #include "suunto_eon.h"
@@ -60,6 +61,10 @@
 
 #include "device-private.h"
 #include "context-private.h"
+#include "iostream-private.h"
+#include "image-private.h"
+
+#define CHECKPOINT_MAXAGE 3600
 
 dc_device_t *
 dc_device_allocate (dc_context_t *context, const dc_device_vtable_t *vtable)
@@ -90,12 +95,37 @@ dc_device_allocate (dc_context_t *context, const dc_device_vtable_t *vtable)
 	memset (&device->devinfo, 0, sizeof (device->devinfo));
 	memset (&device->clock, 0, sizeof (device->clock));
 
+	device->cachedir = NULL;
+
+	device->fpindex_enabled = 0;
+	device->fpindex = NULL;
+
+	device->checkpoint = NULL;
+
+	device->image = NULL;
+
+	device->membuf = NULL;
+
+	memset (&device->stats, 0, sizeof (device->stats));
+	device->timer = NULL;
+	device->request = 0;
+	device->pending = 0;
+	dc_timer_new (&device->timer);
+
 	return device;
 }
 
 void
 dc_device_deallocate (dc_device_t *device)
 {
+	if (device == NULL)
+		return;
+
+	dc_membuf_unref (device->membuf);
+	dc_timer_free (device->timer);
+	dc_fpindex_free (device->fpindex);
+	dc_checkpoint_free (device->checkpoint);
+	free (device->cachedir);
 	free (device);
 }
 
@@ -268,6 +298,29 @@ dc_device_set_events (dc_device_t *device, unsigned int events, dc_event_callbac
 }
 
 
+dc_status_t
+dc_device_set_cachedir (dc_device_t *device, const char *dirname)
+{
+	char *cachedir = NULL;
+
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (dirname) {
+		cachedir = strdup (dirname);
+		if (cachedir == NULL) {
+			ERROR (device->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+	}
+
+	free (device->cachedir);
+	device->cachedir = cachedir;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 dc_status_t
 dc_device_set_fingerprint (dc_device_t *device, const unsigned char data[], unsigned int size)
 {
@@ -281,6 +334,41 @@ dc_device_set_fingerprint (dc_device_t *device, const unsigned char data[], unsi
 }
 
 
+dc_status_t
+dc_device_set_fingerprint_index (dc_device_t *device, unsigned int enable)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	device->fpindex_enabled = enable;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_device_get_stats (dc_device_t *device, dc_event_stats_t *stats)
+{
+	if (device == NULL || stats == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_timer_now (device->timer, &device->stats.elapsed);
+
+	*stats = device->stats;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static void
+device_stats_emit (dc_device_t *device)
+{
+	dc_timer_now (device->timer, &device->stats.elapsed);
+
+	device_event_emit (device, DC_EVENT_STATS, &device->stats);
+}
+
+
 dc_status_t
 dc_device_read (dc_device_t *device, unsigned int address, unsigned char data[], unsigned int size)
 {
@@ -290,7 +378,13 @@ dc_device_read (dc_device_t *device, unsigned int address, unsigned char data[],
 	if (device->vtable->read == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	return device->vtable->read (device, address, data, size);
+	dc_status_t rc = device->vtable->read (device, address, data, size);
+	if (rc == DC_STATUS_SUCCESS) {
+		device->stats.nblocks++;
+		device->stats.nbytes_blocks += size;
+	}
+
+	return rc;
 }
 
 
@@ -307,6 +401,100 @@ dc_device_write (dc_device_t *device, unsigned int address, const unsigned char
 }
 
 
+static void
+device_image_set_info (dc_device_t *device)
+{
+	if (device->image == NULL)
+		return;
+
+	dc_image_set_info (device->image, device->vtable->type, &device->devinfo, &device->clock);
+}
+
+
+void
+device_image_set_memory (dc_device_t *device, const unsigned char data[], unsigned int size)
+{
+	if (device == NULL || device->image == NULL)
+		return;
+
+	dc_image_set_memory (device->image, data, size);
+}
+
+
+static void
+device_checkpoint_filename (dc_device_t *device, char filename[], size_t size)
+{
+	snprintf (filename, size, "%s/checkpoint-%08X-%08X.bin",
+		device->cachedir, device->vtable->type, device->devinfo.serial);
+}
+
+
+static dc_checkpoint_t *
+device_get_checkpoint (dc_device_t *device)
+{
+	// The checkpoint is tied to the serial number, to make sure it's
+	// never applied to a different device.
+	if (device->cachedir == NULL || device->devinfo.serial == 0)
+		return NULL;
+
+	if (device->checkpoint == NULL) {
+		char filename[1024] = {0};
+		device_checkpoint_filename (device, filename, sizeof (filename));
+
+		dc_status_t rc = dc_checkpoint_new (&device->checkpoint, device->context, filename, CHECKPOINT_MAXAGE);
+		if (rc != DC_STATUS_SUCCESS) {
+			WARNING (device->context, "Failed to open the checkpoint.");
+			return NULL;
+		}
+	}
+
+	return device->checkpoint;
+}
+
+
+static void
+device_checkpoint_finish (dc_device_t *device, dc_status_t status)
+{
+	if (device->checkpoint == NULL)
+		return;
+
+	dc_checkpoint_free (device->checkpoint);
+	device->checkpoint = NULL;
+
+	// A completed download has no use for the checkpoint anymore. After
+	// a failure, it's kept for the next attempt.
+	if (status == DC_STATUS_SUCCESS) {
+		char filename[1024] = {0};
+		device_checkpoint_filename (device, filename, sizeof (filename));
+		remove (filename);
+	}
+}
+
+
+int
+device_checkpoint_lookup (dc_device_t *device, const unsigned char key[], unsigned int keysize, const unsigned char **data, unsigned int *size, unsigned int *flags)
+{
+	if (device == NULL)
+		return 0;
+
+	return dc_checkpoint_lookup (device_get_checkpoint (device), key, keysize, data, size, flags);
+}
+
+
+dc_status_t
+device_checkpoint_store (dc_device_t *device, const unsigned char key[], unsigned int keysize, unsigned int offset, const unsigned char data[], unsigned int size, unsigned int flags)
+{
+	if (device == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_checkpoint_t *checkpoint = device_get_checkpoint (device);
+	if (checkpoint == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return dc_checkpoint_store (checkpoint, key, keysize, offset, data, size, flags);
+}
+
+
 dc_status_t
 dc_device_dump (dc_device_t *device, dc_buffer_t *buffer)
 {
@@ -321,7 +509,18 @@ dc_device_dump (dc_device_t *device, dc_buffer_t *buffer)
 
 	dc_buffer_clear (buffer);
 
-	return device->vtable->dump (device, buffer);
+	dc_status_t rc = device->vtable->dump (device, buffer);
+
+	device_checkpoint_finish (device, rc);
+
+	if (rc == DC_STATUS_SUCCESS) {
+		device_image_set_memory (device, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+	}
+	device_image_set_info (device);
+
+	device_stats_emit (device);
+
+	return rc;
 }
 
 
@@ -351,6 +550,9 @@ device_dump_read (dc_device_t *device, unsigned char data[], unsigned int size,
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 
+		device->stats.nblocks++;
+		device->stats.nbytes_blocks += len;
+
 		// Update and emit a progress event.
 		progress.current += len;
 		device_event_emit (device, DC_EVENT_PROGRESS, &progress);
@@ -362,6 +564,83 @@ device_dump_read (dc_device_t *device, unsigned char data[], unsigned int size,
 }
 
 
+static dc_fpindex_t *
+device_get_fpindex (dc_device_t *device, unsigned int fsize)
+{
+	if (!device->fpindex_enabled || device->cachedir == NULL || fsize == 0)
+		return NULL;
+
+	// The index is opened on first use, because the serial number is
+	// only known once the device info event has been emitted.
+	if (device->fpindex == NULL) {
+		char filename[1024] = {0};
+		snprintf (filename, sizeof (filename), "%s/fingerprint-%08X-%08X.idx",
+			device->cachedir, device->vtable->type, device->devinfo.serial);
+
+		dc_status_t rc = dc_fpindex_new (&device->fpindex, device->context, filename, fsize);
+		if (rc != DC_STATUS_SUCCESS) {
+			WARNING (device->context, "Disabling the fingerprint index.");
+			device->fpindex_enabled = 0;
+			return NULL;
+		}
+	}
+
+	if (dc_fpindex_get_fsize (device->fpindex) != fsize)
+		return NULL;
+
+	return device->fpindex;
+}
+
+
+int
+device_is_known_dive (dc_device_t *device, const unsigned char fingerprint[], unsigned int size)
+{
+	if (device == NULL)
+		return 0;
+
+	return dc_fpindex_contains (device_get_fpindex (device, size), fingerprint, size);
+}
+
+
+typedef struct device_foreach_t {
+	dc_device_t *device;
+	dc_dive_callback_t callback;
+	void *userdata;
+} device_foreach_t;
+
+static int
+device_foreach_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	device_foreach_t *foreach = (device_foreach_t *) userdata;
+	dc_device_t *device = foreach->device;
+
+	// Record the dive in the image.
+	if (device->image) {
+		dc_image_add_dive (device->image, data, size, fingerprint, fsize);
+	}
+
+	if (foreach->callback == NULL)
+		return 1;
+
+	// Measure the time spent in the application.
+	dc_usecs_t begin = 0, end = 0;
+	dc_timer_now (device->timer, &begin);
+	int rc = foreach->callback (data, size, fingerprint, fsize, foreach->userdata);
+	dc_timer_now (device->timer, &end);
+
+	device->stats.ndives++;
+	device->stats.callback_time += end - begin;
+
+	// Remember the dive for the next download.
+	dc_fpindex_t *fpindex = device_get_fpindex (device, fsize);
+	if (fpindex) {
+		dc_fpindex_add (fpindex, fingerprint, fsize);
+	}
+
+	return rc;
+}
+
+
 dc_status_t
 dc_device_foreach (dc_device_t *device, dc_dive_callback_t callback, void *userdata)
 {
@@ -371,7 +650,20 @@ dc_device_foreach (dc_device_t *device, dc_dive_callback_t callback, void *userd
 	if (device->vtable->foreach == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	return device->vtable->foreach (device, callback, userdata);
+	device_foreach_t foreach;
+	foreach.device = device;
+	foreach.callback = callback;
+	foreach.userdata = userdata;
+
+	dc_status_t rc = device->vtable->foreach (device, device_foreach_cb, &foreach);
+
+	device_checkpoint_finish (device, rc);
+
+	device_image_set_info (device);
+
+	device_stats_emit (device);
+
+	return rc;
 }
 
 
@@ -431,6 +723,9 @@ device_event_emit (dc_device_t *device, dc_event_type_t event, const void *data)
 	case DC_EVENT_CLOCK:
 		assert (data != NULL);
 		break;
+	case DC_EVENT_STATS:
+		assert (data != NULL);
+		break;
 	default:
 		break;
 	}
@@ -462,14 +757,88 @@ device_event_emit (dc_device_t *device, dc_event_type_t event, const void *data)
 }
 
 
+void
+device_set_membuf (dc_device_t *device, dc_membuf_t *membuf)
+{
+	if (device == NULL)
+		return;
+
+	// The device takes over the reference of the caller.
+	dc_membuf_unref (device->membuf);
+	device->membuf = membuf;
+}
+
+
 int
 device_is_cancelled (dc_device_t *device)
 {
 	if (device == NULL)
 		return 0;
 
+	device->stats.ncancel++;
+
 	if (device->cancel_callback == NULL)
 		return 0;
 
 	return device->cancel_callback (device->cancel_userdata);
 }
+
+
+void
+device_set_iostream (dc_device_t *device, dc_iostream_t *iostream)
+{
+	if (iostream == NULL)
+		return;
+
+	iostream->device = device;
+}
+
+
+void
+device_stats_transfer (dc_device_t *device, dc_direction_t direction, size_t nbytes)
+{
+	if (device == NULL)
+		return;
+
+	if (direction == DC_DIRECTION_OUTPUT) {
+		device->stats.nwrites++;
+		device->stats.nbytes_out += nbytes;
+
+		// Start a new round-trip, unless a request is already pending.
+		if (nbytes && !device->pending) {
+			dc_timer_now (device->timer, &device->request);
+			device->pending = 1;
+		}
+	} else {
+		device->stats.nreads++;
+		device->stats.nbytes_in += nbytes;
+
+		// The first data received completes the round-trip.
+		if (nbytes && device->pending) {
+			dc_usecs_t now = 0;
+			dc_timer_now (device->timer, &now);
+
+			dc_usecs_t latency = now - device->request;
+			unsigned int i = 0;
+			while (i < DC_EVENT_STATS_LATENCY - 1 && latency >= (1000ULL << i))
+				i++;
+
+			device->stats.nroundtrips++;
+			device->stats.latency_total += latency;
+			if (latency > device->stats.latency_max)
+				device->stats.latency_max = latency;
+			device->stats.latency[i]++;
+			device->pending = 0;
+		}
+	}
+}
+
+
+void
+device_stats_retry (dc_device_t *device)
+{
+	if (device == NULL)
+		return;
+
+	device->stats.nretries++;
+}
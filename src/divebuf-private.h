@@ -0,0 +1,71 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2018 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_DIVEBUF_PRIVATE_H
+#define DC_DIVEBUF_PRIVATE_H
+
+#include <stddef.h>
+
+#include <libdivecomputer/divebuf.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Reference counted block of memory, used by the backends to store the
+ * memory image from which the dives are handed out. The reference
+ * counting is thread-safe.
+ */
+typedef struct dc_membuf_t dc_membuf_t;
+
+struct dc_divebuf_t {
+	dc_membuf_t *membuf;
+	const unsigned char *data;
+	unsigned int size;
+	const unsigned char *fingerprint;
+	unsigned int fsize;
+};
+
+dc_membuf_t *
+dc_membuf_new (size_t size);
+
+unsigned char *
+dc_membuf_get_data (dc_membuf_t *membuf);
+
+dc_membuf_t *
+dc_membuf_ref (dc_membuf_t *membuf);
+
+void
+dc_membuf_unref (dc_membuf_t *membuf);
+
+/*
+ * Initialize a dive buffer that is valid for the duration of the dive
+ * callback. If the data is located inside the memory block, retaining
+ * the dive only takes a reference to the block.
+ */
+void
+dc_divebuf_init (dc_divebuf_t *dive, dc_membuf_t *membuf, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_DIVEBUF_PRIVATE_H */
@@ -0,0 +1,223 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2018 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "divebuf-private.h"
+#include "device-private.h"
+#include "thread.h"
+
+typedef struct dc_divebuf_foreach_t {
+	dc_device_t *device;
+	dc_divebuf_callback_t callback;
+	void *userdata;
+} dc_divebuf_foreach_t;
+
+struct dc_membuf_t {
+	unsigned int refcount;
+	size_t size;
+	unsigned char *data;
+};
+
+// Protects the reference counts of all memory blocks.
+static dc_mutex_t g_membuf_lock = DC_MUTEX_INITIALIZER;
+
+dc_membuf_t *
+dc_membuf_new (size_t size)
+{
+	dc_membuf_t *membuf = (dc_membuf_t *) malloc (sizeof (dc_membuf_t) + size);
+	if (membuf == NULL)
+		return NULL;
+
+	membuf->refcount = 1;
+	membuf->size = size;
+	membuf->data = (unsigned char *) (membuf + 1);
+
+	return membuf;
+}
+
+unsigned char *
+dc_membuf_get_data (dc_membuf_t *membuf)
+{
+	return membuf->data;
+}
+
+dc_membuf_t *
+dc_membuf_ref (dc_membuf_t *membuf)
+{
+	dc_mutex_lock (&g_membuf_lock);
+	membuf->refcount++;
+	dc_mutex_unlock (&g_membuf_lock);
+
+	return membuf;
+}
+
+void
+dc_membuf_unref (dc_membuf_t *membuf)
+{
+	if (membuf == NULL)
+		return;
+
+	dc_mutex_lock (&g_membuf_lock);
+	unsigned int refcount = --membuf->refcount;
+	dc_mutex_unlock (&g_membuf_lock);
+
+	if (refcount == 0)
+		free (membuf);
+}
+
+static int
+dc_membuf_contains (dc_membuf_t *membuf, const unsigned char data[], unsigned int size)
+{
+	return membuf != NULL &&
+		data >= membuf->data &&
+		size <= membuf->size &&
+		(size_t) (data - membuf->data) <= membuf->size - size;
+}
+
+void
+dc_divebuf_init (dc_divebuf_t *dive, dc_membuf_t *membuf, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize)
+{
+	// Only share the memory block if it contains both the dive data
+	// and the fingerprint.
+	if (!dc_membuf_contains (membuf, data, size) ||
+		!dc_membuf_contains (membuf, fingerprint, fsize))
+		membuf = NULL;
+
+	dive->membuf = membuf;
+	dive->data = data;
+	dive->size = size;
+	dive->fingerprint = fingerprint;
+	dive->fsize = fsize;
+}
+
+const unsigned char *
+dc_divebuf_get_data (dc_divebuf_t *dive)
+{
+	if (dive == NULL)
+		return NULL;
+
+	return dive->data;
+}
+
+unsigned int
+dc_divebuf_get_size (dc_divebuf_t *dive)
+{
+	if (dive == NULL)
+		return 0;
+
+	return dive->size;
+}
+
+const unsigned char *
+dc_divebuf_get_fingerprint (dc_divebuf_t *dive, unsigned int *fsize)
+{
+	if (dive == NULL) {
+		if (fsize)
+			*fsize = 0;
+		return NULL;
+	}
+
+	if (fsize)
+		*fsize = dive->fsize;
+
+	return dive->fingerprint;
+}
+
+dc_divebuf_t *
+dc_divebuf_retain (dc_divebuf_t *dive)
+{
+	if (dive == NULL)
+		return NULL;
+
+	dc_divebuf_t *copy = (dc_divebuf_t *) malloc (sizeof (dc_divebuf_t));
+	if (copy == NULL)
+		return NULL;
+
+	if (dive->membuf) {
+		// Share the memory block.
+		copy->membuf = dc_membuf_ref (dive->membuf);
+		copy->data = dive->data;
+		copy->fingerprint = dive->fingerprint;
+	} else {
+		// Copy the dive data and the fingerprint into a new block.
+		copy->membuf = dc_membuf_new (dive->size + dive->fsize);
+		if (copy->membuf == NULL) {
+			free (copy);
+			return NULL;
+		}
+
+		unsigned char *data = dc_membuf_get_data (copy->membuf);
+		if (dive->size)
+			memcpy (data, dive->data, dive->size);
+		if (dive->fsize)
+			memcpy (data + dive->size, dive->fingerprint, dive->fsize);
+		copy->data = data;
+		copy->fingerprint = data + dive->size;
+	}
+
+	copy->size = dive->size;
+	copy->fsize = dive->fsize;
+
+	return copy;
+}
+
+void
+dc_divebuf_release (dc_divebuf_t *dive)
+{
+	if (dive == NULL)
+		return;
+
+	dc_membuf_unref (dive->membuf);
+	free (dive);
+}
+
+static int
+dc_divebuf_foreach_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	dc_divebuf_foreach_t *foreach = (dc_divebuf_foreach_t *) userdata;
+	dc_divebuf_t dive;
+
+	// The memory block registered by the backend is checked for every
+	// dive, because the dive may also come from a temporary buffer.
+	dc_divebuf_init (&dive, foreach->device->membuf, data, size, fingerprint, fsize);
+
+	return foreach->callback (&dive, foreach->userdata);
+}
+
+dc_status_t
+dc_device_foreach_divebuf (dc_device_t *device, dc_divebuf_callback_t callback, void *userdata)
+{
+	dc_divebuf_foreach_t foreach;
+
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (callback == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	foreach.device = device;
+	foreach.callback = callback;
+	foreach.userdata = userdata;
+
+	return dc_device_foreach (device, dc_divebuf_foreach_cb, &foreach);
+}
@@ -174,6 +174,8 @@ diverite_nitekq_device_open (dc_device_t **out, dc_context_t *context, const cha
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (9600 8N1).
 	status = dc_iostream_configure (device->iostream, 9600, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -346,6 +348,8 @@ diverite_nitekq_device_foreach (dc_device_t *abstract, dc_dive_callback_t callba
 		return rc;
 	}
 
+	device_image_set_memory (abstract, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+
 	rc = diverite_nitekq_extract_dives (abstract,
 		dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), callback, userdata);
 
@@ -142,6 +142,8 @@ divesystem_idive_device_open (dc_device_t **out, dc_context_t *context, const ch
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -156,6 +158,14 @@ divesystem_idive_device_open (dc_device_t **out, dc_context_t *context, const ch
 		goto error_close;
 	}
 
+	// Enable the receive buffer, to avoid reading the packet headers
+	// with a separate system call.
+	status = dc_iostream_set_buffer (device->iostream, 1024);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to enable the receive buffer.");
+		goto error_close;
+	}
+
 	// Make sure everything is in a sane state.
 	dc_iostream_sleep (device->iostream, 300);
 	dc_iostream_purge (device->iostream, DC_DIRECTION_ALL);
@@ -382,6 +392,8 @@ divesystem_idive_transfer (divesystem_idive_device_t *device, const unsigned cha
 		if (nretries++ >= MAXRETRIES)
 			break;
 
+		device_stats_retry ((dc_device_t *) device);
+
 		// Delay the next attempt.
 		dc_iostream_sleep (device->iostream, 100);
 	}
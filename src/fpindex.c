@@ -0,0 +1,322 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2018 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "fpindex.h"
+#include "context-private.h"
+#include "array.h"
+
+#define FPINDEX_MAGIC   "DCFP"
+#define FPINDEX_VERSION 1
+#define FPINDEX_HEADER  (4 + 4 + 4)
+
+#define MAXFSIZE 64
+
+#define NSLOTS 64
+
+struct dc_fpindex_t {
+	dc_context_t *context;
+	FILE *fp;
+	unsigned int fsize;
+	// Fingerprint storage.
+	unsigned char *data;
+	unsigned int count;
+	unsigned int capacity;
+	// Hash set with the index of each fingerprint (plus one), or
+	// zero for an empty slot.
+	unsigned int *slots;
+	unsigned int nslots;
+};
+
+static unsigned int
+dc_fpindex_hash (const unsigned char data[], unsigned int size)
+{
+	// FNV-1a hash function.
+	unsigned int hash = 2166136261u;
+	for (unsigned int i = 0; i < size; ++i) {
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static unsigned int
+dc_fpindex_lookup (dc_fpindex_t *fpindex, const unsigned char fingerprint[])
+{
+	unsigned int mask = fpindex->nslots - 1;
+	unsigned int i = dc_fpindex_hash (fingerprint, fpindex->fsize) & mask;
+
+	// Linear probing until the fingerprint or an empty slot is found.
+	while (fpindex->slots[i]) {
+		const unsigned char *p = fpindex->data + (fpindex->slots[i] - 1) * fpindex->fsize;
+		if (memcmp (p, fingerprint, fpindex->fsize) == 0)
+			break;
+		i = (i + 1) & mask;
+	}
+
+	return i;
+}
+
+static dc_status_t
+dc_fpindex_rehash (dc_fpindex_t *fpindex, unsigned int nslots)
+{
+	unsigned int *slots = (unsigned int *) calloc (nslots, sizeof (unsigned int));
+	if (slots == NULL) {
+		ERROR (fpindex->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	free (fpindex->slots);
+	fpindex->slots = slots;
+	fpindex->nslots = nslots;
+
+	for (unsigned int n = 0; n < fpindex->count; ++n) {
+		unsigned int i = dc_fpindex_lookup (fpindex, fpindex->data + n * fpindex->fsize);
+		fpindex->slots[i] = n + 1;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_fpindex_insert (dc_fpindex_t *fpindex, const unsigned char fingerprint[], int *inserted)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	*inserted = 0;
+
+	unsigned int i = dc_fpindex_lookup (fpindex, fingerprint);
+	if (fpindex->slots[i])
+		return DC_STATUS_SUCCESS;
+
+	// Grow the storage.
+	if (fpindex->count == fpindex->capacity) {
+		unsigned int capacity = fpindex->capacity ? fpindex->capacity * 2 : NSLOTS / 2;
+		unsigned char *data = (unsigned char *) realloc (fpindex->data, capacity * fpindex->fsize);
+		if (data == NULL) {
+			ERROR (fpindex->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+
+		fpindex->data = data;
+		fpindex->capacity = capacity;
+	}
+
+	memcpy (fpindex->data + fpindex->count * fpindex->fsize, fingerprint, fpindex->fsize);
+	fpindex->slots[i] = ++fpindex->count;
+
+	// Keep the load factor below one half.
+	if (fpindex->count * 2 > fpindex->nslots) {
+		status = dc_fpindex_rehash (fpindex, fpindex->nslots * 2);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	*inserted = 1;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_fpindex_load (dc_fpindex_t *fpindex, const char *filename, int *rewrite)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	*rewrite = 1;
+
+	FILE *fp = fopen (filename, "rb");
+	if (fp == NULL) {
+		// A missing index file is not an error.
+		return DC_STATUS_SUCCESS;
+	}
+
+	// Verify the header. The index is discarded if it was created for
+	// another fingerprint size.
+	unsigned char header[FPINDEX_HEADER] = {0};
+	if (fread (header, sizeof (header), 1, fp) != 1 ||
+		memcmp (header, FPINDEX_MAGIC, 4) != 0 ||
+		array_uint32_le (header + 4) != FPINDEX_VERSION ||
+		array_uint32_le (header + 8) != fpindex->fsize)
+	{
+		WARNING (fpindex->context, "Ignoring incompatible fingerprint index.");
+		goto error_close;
+	}
+
+	// Read the fingerprints.
+	unsigned char fingerprint[MAXFSIZE] = {0};
+	size_t n = 0;
+	while ((n = fread (fingerprint, 1, fpindex->fsize, fp)) == fpindex->fsize) {
+		int inserted = 0;
+		status = dc_fpindex_insert (fpindex, fingerprint, &inserted);
+		if (status != DC_STATUS_SUCCESS)
+			goto error_close;
+	}
+
+	// A partial record is left behind by an interrupted write. The file
+	// is rewritten to restore the record alignment.
+	if (n != 0) {
+		WARNING (fpindex->context, "Ignoring truncated fingerprint record.");
+	} else {
+		*rewrite = 0;
+	}
+
+error_close:
+	fclose (fp);
+	return status;
+}
+
+dc_status_t
+dc_fpindex_new (dc_fpindex_t **out, dc_context_t *context, const char *filename, unsigned int fsize)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_fpindex_t *fpindex = NULL;
+
+	if (out == NULL || filename == NULL || fsize == 0 || fsize > MAXFSIZE)
+		return DC_STATUS_INVALIDARGS;
+
+	// Allocate memory.
+	fpindex = (dc_fpindex_t *) malloc (sizeof (dc_fpindex_t));
+	if (fpindex == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	fpindex->context = context;
+	fpindex->fp = NULL;
+	fpindex->fsize = fsize;
+	fpindex->data = NULL;
+	fpindex->count = 0;
+	fpindex->capacity = 0;
+	fpindex->slots = NULL;
+	fpindex->nslots = 0;
+
+	status = dc_fpindex_rehash (fpindex, NSLOTS);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	int rewrite = 0;
+	status = dc_fpindex_load (fpindex, filename, &rewrite);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	if (rewrite) {
+		fpindex->fp = fopen (filename, "wb");
+		if (fpindex->fp == NULL) {
+			ERROR (context, "Failed to create the fingerprint index.");
+			status = DC_STATUS_IO;
+			goto error_free;
+		}
+
+		unsigned char header[FPINDEX_HEADER] = {0};
+		memcpy (header, FPINDEX_MAGIC, 4);
+		array_uint32_le_set (header + 4, FPINDEX_VERSION);
+		array_uint32_le_set (header + 8, fsize);
+		if (fwrite (header, sizeof (header), 1, fpindex->fp) != 1 ||
+			(fpindex->count && fwrite (fpindex->data, fsize, fpindex->count, fpindex->fp) != fpindex->count) ||
+			fflush (fpindex->fp) != 0)
+		{
+			ERROR (context, "Failed to write the fingerprint index.");
+			status = DC_STATUS_IO;
+			goto error_close;
+		}
+	} else {
+		fpindex->fp = fopen (filename, "ab");
+		if (fpindex->fp == NULL) {
+			ERROR (context, "Failed to open the fingerprint index.");
+			status = DC_STATUS_IO;
+			goto error_free;
+		}
+	}
+
+	INFO (context, "Loaded %u fingerprints from the index.", fpindex->count);
+
+	*out = fpindex;
+
+	return DC_STATUS_SUCCESS;
+
+error_close:
+	fclose (fpindex->fp);
+error_free:
+	free (fpindex->slots);
+	free (fpindex->data);
+	free (fpindex);
+	return status;
+}
+
+unsigned int
+dc_fpindex_get_fsize (dc_fpindex_t *fpindex)
+{
+	if (fpindex == NULL)
+		return 0;
+
+	return fpindex->fsize;
+}
+
+int
+dc_fpindex_contains (dc_fpindex_t *fpindex, const unsigned char fingerprint[], unsigned int size)
+{
+	if (fpindex == NULL || fingerprint == NULL || size != fpindex->fsize)
+		return 0;
+
+	unsigned int i = dc_fpindex_lookup (fpindex, fingerprint);
+
+	return fpindex->slots[i] != 0;
+}
+
+dc_status_t
+dc_fpindex_add (dc_fpindex_t *fpindex, const unsigned char fingerprint[], unsigned int size)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (fpindex == NULL || fingerprint == NULL || size != fpindex->fsize)
+		return DC_STATUS_INVALIDARGS;
+
+	int inserted = 0;
+	status = dc_fpindex_insert (fpindex, fingerprint, &inserted);
+	if (status != DC_STATUS_SUCCESS || !inserted)
+		return status;
+
+	// Append the new fingerprint to the file.
+	if (fwrite (fingerprint, size, 1, fpindex->fp) != 1 ||
+		fflush (fpindex->fp) != 0)
+	{
+		ERROR (fpindex->context, "Failed to write the fingerprint index.");
+		return DC_STATUS_IO;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+void
+dc_fpindex_free (dc_fpindex_t *fpindex)
+{
+	if (fpindex == NULL)
+		return;
+
+	fclose (fpindex->fp);
+	free (fpindex->slots);
+	free (fpindex->data);
+	free (fpindex);
+}
@@ -0,0 +1,105 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2018 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_FPINDEX_H
+#define DC_FPINDEX_H
+
+#include <libdivecomputer/context.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Opaque object representing a persistent fingerprint index.
+ *
+ * The index keeps the fingerprint of every dive that has been
+ * downloaded from a device. The fingerprints are stored in an
+ * append-only file, and kept in an in-memory hash set for fast
+ * lookups.
+ */
+typedef struct dc_fpindex_t dc_fpindex_t;
+
+/**
+ * Open a fingerprint index.
+ *
+ * The existing fingerprints are loaded from the file. A missing file is
+ * not an error, and a file with a different fingerprint size is
+ * discarded.
+ *
+ * @param[out]  fpindex   A location to store the fingerprint index.
+ * @param[in]   context   A valid context object.
+ * @param[in]   filename  The filename of the index.
+ * @param[in]   fsize     The fingerprint size in bytes.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_fpindex_new (dc_fpindex_t **fpindex, dc_context_t *context, const char *filename, unsigned int fsize);
+
+/**
+ * Get the fingerprint size of the index.
+ *
+ * @param[in]  fpindex  A valid fingerprint index.
+ * @returns The fingerprint size in bytes.
+ */
+unsigned int
+dc_fpindex_get_fsize (dc_fpindex_t *fpindex);
+
+/**
+ * Check whether a fingerprint is present in the index.
+ *
+ * @param[in]  fpindex      A valid fingerprint index.
+ * @param[in]  fingerprint  The fingerprint data.
+ * @param[in]  size         The size of the fingerprint data.
+ * @returns Non-zero if the fingerprint is present, or zero otherwise.
+ */
+int
+dc_fpindex_contains (dc_fpindex_t *fpindex, const unsigned char fingerprint[], unsigned int size);
+
+/**
+ * Add a fingerprint to the index.
+ *
+ * The fingerprint is appended to the file immediately, such that it
+ * survives an interrupted download. Adding a fingerprint which is
+ * already present is a no-op.
+ *
+ * @param[in]  fpindex      A valid fingerprint index.
+ * @param[in]  fingerprint  The fingerprint data.
+ * @param[in]  size         The size of the fingerprint data.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_fpindex_add (dc_fpindex_t *fpindex, const unsigned char fingerprint[], unsigned int size);
+
+/**
+ * Close the fingerprint index and free all resources.
+ *
+ * @param[in]  fpindex  A valid fingerprint index.
+ */
+void
+dc_fpindex_free (dc_fpindex_t *fpindex);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_FPINDEX_H */
@@ -149,6 +149,8 @@ hw_ostc_device_open (dc_device_t **out, dc_context_t *context, const char *name)
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -334,6 +336,8 @@ hw_ostc_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void
 		devinfo.model = 0; // OSTC
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
+	device_image_set_memory (abstract, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+
 	rc = hw_ostc_extract_dives (abstract, dc_buffer_get_data (buffer),
 		dc_buffer_get_size (buffer), callback, userdata);
 
@@ -809,6 +813,8 @@ hw_ostc_firmware_setup (hw_ostc_device_t *device, unsigned int maxretries)
 		// Abort if the maximum number of retries is reached.
 		if (nretries++ >= maxretries)
 			break;
+
+		device_stats_retry ((dc_device_t *) device);
 	}
 
 	return rc;
@@ -860,6 +866,8 @@ hw_ostc_firmware_write (hw_ostc_device_t *device, unsigned char *data, unsigned
 		// Abort if the maximum number of retries is reached.
 		if (nretries++ >= MAXRETRIES)
 			break;
+
+		device_stats_retry ((dc_device_t *) device);
 	}
 
 	return rc;
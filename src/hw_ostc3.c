@@ -345,6 +345,8 @@ hw_ostc3_device_open (dc_device_t **out, dc_context_t *context, const char *name
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -704,6 +706,7 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 	}
 
 	// Calculate the total and maximum size.
+	unsigned int nentries = 0;
 	unsigned int ndives = 0;
 	unsigned int size = 0;
 	unsigned int maxsize = 0;
@@ -737,6 +740,12 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 		if (memcmp (header + offset + logbook->fingerprint, device->fingerprint, sizeof (device->fingerprint)) == 0)
 			break;
 
+		nentries++;
+
+		// Skip dives that were already downloaded before.
+		if (device_is_known_dive (abstract, header + offset + logbook->fingerprint, sizeof (device->fingerprint)))
+			continue;
+
 		if (length > maxsize)
 			maxsize = length;
 		size += length;
@@ -762,10 +771,13 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 	}
 
 	// Download the dives.
-	for (unsigned int i = 0; i < ndives; ++i) {
+	for (unsigned int i = 0; i < nentries; ++i) {
 		unsigned int idx = (latest + RB_LOGBOOK_COUNT - i) % RB_LOGBOOK_COUNT;
 		unsigned int offset = idx * logbook->size;
 
+		if (device_is_known_dive (abstract, header + offset + logbook->fingerprint, sizeof (device->fingerprint)))
+			continue;
+
 		// Calculate the profile length.
 		unsigned int length = RB_LOGBOOK_SIZE_FULL + array_uint24_le (header + offset + logbook->profile) - 3;
 		if (!compact) {
@@ -775,15 +787,32 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 				length -= 3;
 		}
 
-		// Download the dive.
+		// Download the dive, unless it was already downloaded before the
+		// connection was lost during a previous attempt. The dives are
+		// identified by their fingerprint, because the position in the
+		// ringbuffer changes when new dives are recorded.
 		unsigned char number[1] = {idx};
-		rc = hw_ostc3_transfer (device, &progress, DIVE,
-			number, sizeof (number), profile, length, NODELAY);
-		if (rc != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to read the dive.");
-			free (profile);
-			free (header);
-			return rc;
+		const unsigned char *key = header + offset + logbook->fingerprint;
+		const unsigned char *cpdata = NULL;
+		unsigned int cpsize = 0, cpflags = 0;
+		if (device_checkpoint_lookup (abstract, key, sizeof (device->fingerprint), &cpdata, &cpsize, &cpflags) &&
+			(cpflags & DC_CHECKPOINT_COMPLETE) && cpsize == length) {
+			memcpy (profile, cpdata, length);
+
+			// Update and emit a progress event.
+			progress.current += sizeof (number) + length;
+			device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+		} else {
+			rc = hw_ostc3_transfer (device, &progress, DIVE,
+				number, sizeof (number), profile, length, NODELAY);
+			if (rc != DC_STATUS_SUCCESS) {
+				ERROR (abstract->context, "Failed to read the dive.");
+				free (profile);
+				free (header);
+				return rc;
+			}
+
+			device_checkpoint_store (abstract, key, sizeof (device->fingerprint), 0, profile, length, DC_CHECKPOINT_COMPLETE);
 		}
 
 		// Verify the header in the logbook and profile are identical.
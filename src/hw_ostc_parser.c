@@ -125,7 +125,7 @@ typedef struct hw_ostc_parser_t {
 static dc_status_t hw_ostc_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
 static dc_status_t hw_ostc_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t hw_ostc_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
-static dc_status_t hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t hw_ostc_parser_samples_decode (dc_parser_t *abstract, const dc_sample_sink_t *sink);
 
 static const dc_parser_vtable_t hw_ostc_parser_vtable = {
 	sizeof(hw_ostc_parser_t),
@@ -133,7 +133,8 @@ static const dc_parser_vtable_t hw_ostc_parser_vtable = {
 	hw_ostc_parser_set_data, /* set_data */
 	hw_ostc_parser_get_datetime, /* datetime */
 	hw_ostc_parser_get_field, /* fields */
-	hw_ostc_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_foreach */
+	hw_ostc_parser_samples_decode, /* samples_decode */
 	NULL /* destroy */
 };
 
@@ -482,7 +483,7 @@ hw_ostc_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned
 
 	// Cache the profile data.
 	if (parser->cached < PROFILE) {
-		rc = hw_ostc_parser_samples_foreach (abstract, NULL, NULL);
+		rc = hw_ostc_parser_samples_decode (abstract, NULL);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 	}
@@ -664,7 +665,9 @@ hw_ostc_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned
 			default:
 				return DC_STATUS_UNSUPPORTED;
 			}
-			string->value = strdup(buf);
+			string->value = dc_arena_strdup (&abstract->arena, buf);
+			if (string->value == NULL)
+				return DC_STATUS_NOMEMORY;
 			break;
 		default:
 			return DC_STATUS_UNSUPPORTED;
@@ -676,7 +679,7 @@ hw_ostc_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned
 
 
 static dc_status_t
-hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+hw_ostc_parser_samples_decode (dc_parser_t *abstract, const dc_sample_sink_t *sink)
 {
 	hw_ostc_parser_t *parser = (hw_ostc_parser_t *) abstract;
 	const unsigned char *data = abstract->data;
@@ -804,30 +807,30 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 		// Time (seconds).
 		time += samplerate;
 		sample.time = time;
-		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+		dc_sample_sink_emit (sink, DC_SAMPLE_TIME, &sample);
 
 		// Initial gas mix.
 		if (time == samplerate && parser->initial != UNDEFINED) {
 			sample.gasmix = parser->initial;
-			if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
+			dc_sample_sink_emit (sink, DC_SAMPLE_GASMIX, &sample);
 		}
 
 		// Initial setpoint (mbar).
 		if (time == samplerate && parser->initial_setpoint != UNDEFINED) {
 			sample.setpoint = parser->initial_setpoint / 100.0;
-			if (callback) callback (DC_SAMPLE_SETPOINT, sample, userdata);
+			dc_sample_sink_emit (sink, DC_SAMPLE_SETPOINT, &sample);
 		}
 
 		// Initial CNS (%).
 		if (time == samplerate && parser->initial_cns != UNDEFINED) {
 			sample.cns = parser->initial_cns / 100.0;
-			if (callback) callback (DC_SAMPLE_CNS, sample, userdata);
+			dc_sample_sink_emit (sink, DC_SAMPLE_CNS, &sample);
 		}
 
 		// Depth (mbar).
 		unsigned int depth = array_uint16_le (data + offset);
 		sample.depth = (depth * BAR / 1000.0) / hydrostatic;
-		if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+		dc_sample_sink_emit (sink, DC_SAMPLE_DEPTH, &sample);
 		offset += 2;
 
 		// Extended sample info.
@@ -885,8 +888,8 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 		case 7: // Low Battery
 			break;
 		}
-		if (sample.event.type && callback)
-			callback (DC_SAMPLE_EVENT, sample, userdata);
+		if (sample.event.type)
+			dc_sample_sink_emit (sink, DC_SAMPLE_EVENT, &sample);
 
 		// Manual Gas Set & Change
 		if (events & 0x10) {
@@ -908,7 +911,7 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 			}
 
 			sample.gasmix = idx;
-			if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
+			dc_sample_sink_emit (sink, DC_SAMPLE_GASMIX, &sample);
 			offset += 2;
 			length -= 2;
 		}
@@ -926,7 +929,7 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 			}
 			idx--; /* Convert to a zero based index. */
 			sample.gasmix = idx;
-			if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
+			dc_sample_sink_emit (sink, DC_SAMPLE_GASMIX, &sample);
 			tank = idx;
 			offset++;
 			length--;
@@ -940,7 +943,7 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 					return DC_STATUS_DATAFORMAT;
 				}
 				sample.setpoint = data[offset] / 100.0;
-				if (callback) callback (DC_SAMPLE_SETPOINT, sample, userdata);
+				dc_sample_sink_emit (sink, DC_SAMPLE_SETPOINT, &sample);
 				offset++;
 				length--;
 			}
@@ -966,7 +969,7 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 				}
 
 				sample.gasmix = idx;
-				if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
+				dc_sample_sink_emit (sink, DC_SAMPLE_GASMIX, &sample);
 				offset += 2;
 				length -= 2;
 			}
@@ -987,7 +990,7 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 				case 0: // Temperature (0.1 °C).
 					value = array_uint16_le (data + offset);
 					sample.temperature = value / 10.0;
-					if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
+					dc_sample_sink_emit (sink, DC_SAMPLE_TEMPERATURE, &sample);
 					break;
 				case 1: // Deco / NDL
 					// Due to a firmware bug, the deco/ndl info is incorrect for
@@ -1002,7 +1005,7 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 						sample.deco.depth = 0.0;
 					}
 					sample.deco.time = data[offset + 1] * 60;
-					if (callback) callback (DC_SAMPLE_DECO, sample, userdata);
+					dc_sample_sink_emit (sink, DC_SAMPLE_DECO, &sample);
 					break;
 				case 3: // ppO2 (0.01 bar).
 					for (unsigned int j = 0; j < 3; ++j) {
@@ -1017,7 +1020,7 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 					if (count) {
 						for (unsigned int j = 0; j < 3; ++j) {
 							sample.ppo2 = ppo2[j] / 100.0;
-							if (callback) callback (DC_SAMPLE_PPO2, sample, userdata);
+							dc_sample_sink_emit (sink, DC_SAMPLE_PPO2, &sample);
 						}
 					}
 					break;
@@ -1026,13 +1029,13 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 						sample.cns = array_uint16_le (data + offset) / 100.0;
 					else
 						sample.cns = data[offset] / 100.0;
-					if (callback) callback (DC_SAMPLE_CNS, sample, userdata);
+					dc_sample_sink_emit (sink, DC_SAMPLE_CNS, &sample);
 					break;
 				case 6: // Tank pressure
 					value = array_uint16_le (data + offset);
 					sample.pressure.tank = tank;
 					sample.pressure.value = value / 10.0;
-					if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
+					dc_sample_sink_emit (sink, DC_SAMPLE_PRESSURE, &sample);
 					break;
 				default: // Not yet used.
 					break;
@@ -1051,7 +1054,7 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 					return DC_STATUS_DATAFORMAT;
 				}
 				sample.setpoint = data[offset] / 100.0;
-				if (callback) callback (DC_SAMPLE_SETPOINT, sample, userdata);
+				dc_sample_sink_emit (sink, DC_SAMPLE_SETPOINT, &sample);
 				offset++;
 				length--;
 			}
@@ -1077,7 +1080,7 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 				}
 
 				sample.gasmix = idx;
-				if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
+				dc_sample_sink_emit (sink, DC_SAMPLE_GASMIX, &sample);
 				offset += 2;
 				length -= 2;
 			}
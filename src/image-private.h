@@ -0,0 +1,82 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2018 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_IMAGE_PRIVATE_H
+#define DC_IMAGE_PRIVATE_H
+
+#include <libdivecomputer/image.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Store the device family, device info and clock calibration.
+ *
+ * @param[in]  image    A valid image.
+ * @param[in]  family   The device family.
+ * @param[in]  devinfo  The device info.
+ * @param[in]  clock    The clock calibration.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure. Images opened from a file are read-only.
+ */
+dc_status_t
+dc_image_set_info (dc_image_t *image, dc_family_t family, const dc_event_devinfo_t *devinfo, const dc_event_clock_t *clock);
+
+/**
+ * Store the memory image, replacing the previous contents.
+ *
+ * @param[in]  image  A valid image.
+ * @param[in]  data   The memory image.
+ * @param[in]  size   The size of the memory image.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_image_set_memory (dc_image_t *image, const unsigned char data[], unsigned int size);
+
+/**
+ * Append a dive.
+ *
+ * @param[in]  image        A valid image.
+ * @param[in]  data         The dive data.
+ * @param[in]  size         The size of the dive data.
+ * @param[in]  fingerprint  The fingerprint.
+ * @param[in]  fsize        The size of the fingerprint.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_image_add_dive (dc_image_t *image, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
+
+/**
+ * Get the context of the image.
+ *
+ * @param[in]  image  A valid image.
+ * @returns The context, or NULL.
+ */
+dc_context_t *
+dc_image_get_context (dc_image_t *image);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_IMAGE_PRIVATE_H */
@@ -0,0 +1,627 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2018 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#if defined (_WIN32)
+#define NOGDI
+#include <windows.h>
+#elif defined (HAVE_MMAP)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <libdivecomputer/buffer.h>
+
+#include "image-private.h"
+#include "device-private.h"
+#include "context-private.h"
+#include "array.h"
+
+#define IMAGE_MAGIC   "DCIM"
+#define IMAGE_VERSION 1
+#define IMAGE_HEADER  64
+#define IMAGE_ENTRY   16
+#define IMAGE_ALIGN   16
+
+#define ALIGN(x) (((x) + IMAGE_ALIGN - 1) & ~(IMAGE_ALIGN - 1))
+
+/*
+ * File layout (all values are little endian):
+ *
+ *  0  magic "DCIM"         32  systime (64 bit)
+ *  4  version              40  memory offset
+ *  8  family               44  memory size
+ * 12  reserved             48  dives offset
+ * 16  model                52  dives size
+ * 20  firmware             56  index offset
+ * 24  serial               60  number of dives
+ * 28  devtime
+ *
+ * The index contains one entry per dive with the offset and size of the
+ * dive data, and the offset and size of the fingerprint. The offsets
+ * are relative to the start of the dives section. All sections are
+ * aligned to 16 bytes.
+ */
+
+struct dc_image_t {
+	dc_context_t *context;
+	dc_family_t family;
+	dc_event_devinfo_t devinfo;
+	dc_event_clock_t clock;
+	// Contents of an image created in memory.
+	dc_buffer_t *memory;
+	dc_buffer_t *dives;
+	dc_buffer_t *index;
+	// Contents of an image opened from a file.
+	unsigned char *map;
+	size_t mapsize;
+	// Location of the sections.
+	const unsigned char *mdata;
+	unsigned int msize;
+	const unsigned char *ddata;
+	unsigned int dsize;
+	const unsigned char *idata;
+	unsigned int count;
+};
+
+static void
+dc_image_update (dc_image_t *image)
+{
+	image->mdata = dc_buffer_get_data (image->memory);
+	image->msize = dc_buffer_get_size (image->memory);
+	image->ddata = dc_buffer_get_data (image->dives);
+	image->dsize = dc_buffer_get_size (image->dives);
+	image->idata = dc_buffer_get_data (image->index);
+	image->count = dc_buffer_get_size (image->index) / IMAGE_ENTRY;
+}
+
+static dc_image_t *
+dc_image_allocate (dc_context_t *context)
+{
+	dc_image_t *image = (dc_image_t *) malloc (sizeof (dc_image_t));
+	if (image == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return NULL;
+	}
+
+	image->context = context;
+	image->family = DC_FAMILY_NULL;
+	memset (&image->devinfo, 0, sizeof (image->devinfo));
+	memset (&image->clock, 0, sizeof (image->clock));
+	image->memory = NULL;
+	image->dives = NULL;
+	image->index = NULL;
+	image->map = NULL;
+	image->mapsize = 0;
+	image->mdata = NULL;
+	image->msize = 0;
+	image->ddata = NULL;
+	image->dsize = 0;
+	image->idata = NULL;
+	image->count = 0;
+
+	return image;
+}
+
+dc_status_t
+dc_image_new (dc_image_t **out, dc_context_t *context)
+{
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_image_t *image = dc_image_allocate (context);
+	if (image == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	image->memory = dc_buffer_new (0);
+	image->dives = dc_buffer_new (0);
+	image->index = dc_buffer_new (0);
+	if (image->memory == NULL || image->dives == NULL || image->index == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		dc_image_free (image);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	dc_image_update (image);
+
+	*out = image;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_image_map (dc_image_t *image, const char *filename)
+{
+#if defined (_WIN32)
+	HANDLE hFile = CreateFileA (filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE) {
+		ERROR (image->context, "Failed to open the image file.");
+		return DC_STATUS_IO;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx (hFile, &size) || size.QuadPart < IMAGE_HEADER || size.QuadPart > 0xFFFFFFFF) {
+		ERROR (image->context, "Invalid image file size.");
+		CloseHandle (hFile);
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	HANDLE hMapping = CreateFileMapping (hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle (hFile);
+	if (hMapping == NULL) {
+		ERROR (image->context, "Failed to map the image file.");
+		return DC_STATUS_IO;
+	}
+
+	// The view keeps a reference to the mapping object.
+	image->map = (unsigned char *) MapViewOfFile (hMapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle (hMapping);
+	if (image->map == NULL) {
+		ERROR (image->context, "Failed to map the image file.");
+		return DC_STATUS_IO;
+	}
+
+	image->mapsize = size.QuadPart;
+#elif defined (HAVE_MMAP)
+	int fd = open (filename, O_RDONLY);
+	if (fd < 0) {
+		SYSERROR (image->context, errno);
+		return DC_STATUS_IO;
+	}
+
+	struct stat st;
+	if (fstat (fd, &st) != 0 || st.st_size < IMAGE_HEADER || (unsigned long long) st.st_size > 0xFFFFFFFF) {
+		ERROR (image->context, "Invalid image file size.");
+		close (fd);
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	void *map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close (fd);
+	if (map == MAP_FAILED) {
+		SYSERROR (image->context, errno);
+		return DC_STATUS_IO;
+	}
+
+	image->map = (unsigned char *) map;
+	image->mapsize = st.st_size;
+#else
+	// Without support for memory mapped files, the file is read into
+	// memory instead.
+	FILE *fp = fopen (filename, "rb");
+	if (fp == NULL) {
+		ERROR (image->context, "Failed to open the image file.");
+		return DC_STATUS_IO;
+	}
+
+	long size = 0;
+	if (fseek (fp, 0, SEEK_END) != 0 || (size = ftell (fp)) < IMAGE_HEADER || fseek (fp, 0, SEEK_SET) != 0) {
+		ERROR (image->context, "Invalid image file size.");
+		fclose (fp);
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	image->map = (unsigned char *) malloc (size);
+	if (image->map == NULL) {
+		ERROR (image->context, "Failed to allocate memory.");
+		fclose (fp);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	image->mapsize = size;
+
+	if (fread (image->map, size, 1, fp) != 1) {
+		ERROR (image->context, "Failed to read the image file.");
+		fclose (fp);
+		return DC_STATUS_IO;
+	}
+
+	fclose (fp);
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+dc_image_unmap (dc_image_t *image)
+{
+	if (image->map == NULL)
+		return;
+
+#if defined (_WIN32)
+	UnmapViewOfFile (image->map);
+#elif defined (HAVE_MMAP)
+	munmap (image->map, image->mapsize);
+#else
+	free (image->map);
+#endif
+}
+
+static int
+dc_image_inside (unsigned int offset, unsigned int size, size_t total)
+{
+	return offset <= total && size <= total - offset;
+}
+
+dc_status_t
+dc_image_open (dc_image_t **out, dc_context_t *context, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (out == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_image_t *image = dc_image_allocate (context);
+	if (image == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	status = dc_image_map (image, filename);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	// Verify the header.
+	const unsigned char *header = image->map;
+	if (memcmp (header, IMAGE_MAGIC, 4) != 0 ||
+		array_uint32_le (header + 4) != IMAGE_VERSION) {
+		ERROR (context, "Invalid image header.");
+		status = DC_STATUS_DATAFORMAT;
+		goto error_free;
+	}
+
+	image->family = array_uint32_le (header + 8);
+	image->devinfo.model = array_uint32_le (header + 16);
+	image->devinfo.firmware = array_uint32_le (header + 20);
+	image->devinfo.serial = array_uint32_le (header + 24);
+	image->clock.devtime = array_uint32_le (header + 28);
+	image->clock.systime = (dc_ticks_t) (array_uint32_le (header + 32) +
+		((unsigned long long) array_uint32_le (header + 36) << 32));
+
+	// Locate the sections.
+	unsigned int moffset = array_uint32_le (header + 40);
+	unsigned int msize = array_uint32_le (header + 44);
+	unsigned int doffset = array_uint32_le (header + 48);
+	unsigned int dsize = array_uint32_le (header + 52);
+	unsigned int ioffset = array_uint32_le (header + 56);
+	unsigned int count = array_uint32_le (header + 60);
+	if (!dc_image_inside (moffset, msize, image->mapsize) ||
+		!dc_image_inside (doffset, dsize, image->mapsize) ||
+		count > image->mapsize / IMAGE_ENTRY ||
+		!dc_image_inside (ioffset, count * IMAGE_ENTRY, image->mapsize)) {
+		ERROR (context, "Invalid image section.");
+		status = DC_STATUS_DATAFORMAT;
+		goto error_free;
+	}
+
+	image->mdata = image->map + moffset;
+	image->msize = msize;
+	image->ddata = image->map + doffset;
+	image->dsize = dsize;
+	image->idata = image->map + ioffset;
+	image->count = count;
+
+	// Verify the index once, to allow direct access afterwards.
+	for (unsigned int i = 0; i < count; ++i) {
+		const unsigned char *entry = image->idata + i * IMAGE_ENTRY;
+		if (!dc_image_inside (array_uint32_le (entry + 0), array_uint32_le (entry + 4), dsize) ||
+			!dc_image_inside (array_uint32_le (entry + 8), array_uint32_le (entry + 12), dsize)) {
+			ERROR (context, "Invalid index entry %u.", i);
+			status = DC_STATUS_DATAFORMAT;
+			goto error_free;
+		}
+	}
+
+	*out = image;
+
+	return DC_STATUS_SUCCESS;
+
+error_free:
+	dc_image_free (image);
+	return status;
+}
+
+static dc_status_t
+dc_image_write (dc_image_t *image, FILE *fp, const unsigned char data[], unsigned int size)
+{
+	static const unsigned char padding[IMAGE_ALIGN] = {0};
+
+	if (size && fwrite (data, size, 1, fp) != 1) {
+		ERROR (image->context, "Failed to write the image file.");
+		return DC_STATUS_IO;
+	}
+
+	unsigned int npadding = ALIGN (size) - size;
+	if (npadding && fwrite (padding, npadding, 1, fp) != 1) {
+		ERROR (image->context, "Failed to write the image file.");
+		return DC_STATUS_IO;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_image_save (dc_image_t *image, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (image == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned int moffset = IMAGE_HEADER;
+	unsigned int doffset = moffset + ALIGN (image->msize);
+	unsigned int ioffset = doffset + ALIGN (image->dsize);
+
+	unsigned long long systime = image->clock.systime;
+	unsigned char header[IMAGE_HEADER] = {0};
+	memcpy (header, IMAGE_MAGIC, 4);
+	array_uint32_le_set (header + 4, IMAGE_VERSION);
+	array_uint32_le_set (header + 8, image->family);
+	array_uint32_le_set (header + 16, image->devinfo.model);
+	array_uint32_le_set (header + 20, image->devinfo.firmware);
+	array_uint32_le_set (header + 24, image->devinfo.serial);
+	array_uint32_le_set (header + 28, image->clock.devtime);
+	array_uint32_le_set (header + 32, systime & 0xFFFFFFFF);
+	array_uint32_le_set (header + 36, (systime >> 32) & 0xFFFFFFFF);
+	array_uint32_le_set (header + 40, moffset);
+	array_uint32_le_set (header + 44, image->msize);
+	array_uint32_le_set (header + 48, doffset);
+	array_uint32_le_set (header + 52, image->dsize);
+	array_uint32_le_set (header + 56, ioffset);
+	array_uint32_le_set (header + 60, image->count);
+
+	FILE *fp = fopen (filename, "wb");
+	if (fp == NULL) {
+		ERROR (image->context, "Failed to open the image file.");
+		return DC_STATUS_IO;
+	}
+
+	if ((status = dc_image_write (image, fp, header, sizeof (header))) != DC_STATUS_SUCCESS ||
+		(status = dc_image_write (image, fp, image->mdata, image->msize)) != DC_STATUS_SUCCESS ||
+		(status = dc_image_write (image, fp, image->ddata, image->dsize)) != DC_STATUS_SUCCESS ||
+		(status = dc_image_write (image, fp, image->idata, image->count * IMAGE_ENTRY)) != DC_STATUS_SUCCESS) {
+		fclose (fp);
+		return status;
+	}
+
+	if (fclose (fp) != 0) {
+		ERROR (image->context, "Failed to write the image file.");
+		return DC_STATUS_IO;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_family_t
+dc_image_get_type (dc_image_t *image)
+{
+	if (image == NULL)
+		return DC_FAMILY_NULL;
+
+	return image->family;
+}
+
+dc_status_t
+dc_image_get_devinfo (dc_image_t *image, dc_event_devinfo_t *devinfo)
+{
+	if (image == NULL || devinfo == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	*devinfo = image->devinfo;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_image_get_clock (dc_image_t *image, dc_event_clock_t *clock)
+{
+	if (image == NULL || clock == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	*clock = image->clock;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_image_get_memory (dc_image_t *image, const unsigned char **data, unsigned int *size)
+{
+	if (image == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (data)
+		*data = image->mdata;
+	if (size)
+		*size = image->msize;
+
+	return DC_STATUS_SUCCESS;
+}
+
+unsigned int
+dc_image_get_count (dc_image_t *image)
+{
+	if (image == NULL)
+		return 0;
+
+	return image->count;
+}
+
+dc_status_t
+dc_image_get_dive (dc_image_t *image, unsigned int index, const unsigned char **data, unsigned int *size, const unsigned char **fingerprint, unsigned int *fsize)
+{
+	if (image == NULL || index >= image->count)
+		return DC_STATUS_INVALIDARGS;
+
+	const unsigned char *entry = image->idata + index * IMAGE_ENTRY;
+
+	if (data)
+		*data = image->ddata + array_uint32_le (entry + 0);
+	if (size)
+		*size = array_uint32_le (entry + 4);
+	if (fingerprint)
+		*fingerprint = image->ddata + array_uint32_le (entry + 8);
+	if (fsize)
+		*fsize = array_uint32_le (entry + 12);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_image_foreach (dc_image_t *image, dc_dive_callback_t callback, void *userdata)
+{
+	if (image == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	for (unsigned int i = 0; i < image->count; ++i) {
+		const unsigned char *data = NULL, *fingerprint = NULL;
+		unsigned int size = 0, fsize = 0;
+		dc_image_get_dive (image, i, &data, &size, &fingerprint, &fsize);
+
+		if (callback && !callback (data, size, fingerprint, fsize, userdata))
+			break;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_image_set_info (dc_image_t *image, dc_family_t family, const dc_event_devinfo_t *devinfo, const dc_event_clock_t *clock)
+{
+	if (image == NULL || image->map != NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	image->family = family;
+	if (devinfo)
+		image->devinfo = *devinfo;
+	if (clock)
+		image->clock = *clock;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_image_set_memory (dc_image_t *image, const unsigned char data[], unsigned int size)
+{
+	if (image == NULL || image->map != NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (!dc_buffer_clear (image->memory) ||
+		!dc_buffer_append (image->memory, data, size)) {
+		ERROR (image->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	dc_image_update (image);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_image_add_dive (dc_image_t *image, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize)
+{
+	static const unsigned char padding[IMAGE_ALIGN] = {0};
+
+	if (image == NULL || image->map != NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned int offset = dc_buffer_get_size (image->dives);
+	unsigned int fpoffset = offset + size;
+	unsigned int total = size;
+
+	// Most backends take the fingerprint from the dive data itself. In
+	// that case, there is no need to store it separately.
+	unsigned int inside = fingerprint != NULL && fingerprint >= data &&
+		fsize <= size && (unsigned int) (fingerprint - data) <= size - fsize;
+	if (inside) {
+		fpoffset = offset + (fingerprint - data);
+	} else {
+		total += fsize;
+	}
+
+	if (!dc_buffer_append (image->dives, data, size) ||
+		(!inside && fsize && !dc_buffer_append (image->dives, fingerprint, fsize)) ||
+		!dc_buffer_append (image->dives, padding, ALIGN (total) - total)) {
+		ERROR (image->context, "Failed to allocate memory.");
+		dc_buffer_resize (image->dives, offset);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	unsigned char entry[IMAGE_ENTRY] = {0};
+	array_uint32_le_set (entry + 0, offset);
+	array_uint32_le_set (entry + 4, size);
+	array_uint32_le_set (entry + 8, fpoffset);
+	array_uint32_le_set (entry + 12, fsize);
+	if (!dc_buffer_append (image->index, entry, sizeof (entry))) {
+		ERROR (image->context, "Failed to allocate memory.");
+		dc_buffer_resize (image->dives, offset);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	dc_image_update (image);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_context_t *
+dc_image_get_context (dc_image_t *image)
+{
+	if (image == NULL)
+		return NULL;
+
+	return image->context;
+}
+
+void
+dc_image_free (dc_image_t *image)
+{
+	if (image == NULL)
+		return;
+
+	dc_image_unmap (image);
+	dc_buffer_free (image->memory);
+	dc_buffer_free (image->dives);
+	dc_buffer_free (image->index);
+	free (image);
+}
+
+dc_status_t
+dc_device_set_image (dc_device_t *device, dc_image_t *image)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	// Images opened from a file are read-only.
+	if (image && image->map != NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	device->image = image;
+
+	return DC_STATUS_SUCCESS;
+}
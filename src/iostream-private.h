@@ -32,9 +32,25 @@ extern "C" {
 
 typedef struct dc_iostream_vtable_t dc_iostream_vtable_t;
 
+struct dc_device_t;
+
+typedef struct dc_iovec_t {
+	const void *data;
+	size_t size;
+} dc_iovec_t;
+
 struct dc_iostream_t {
 	const dc_iostream_vtable_t *vtable;
 	dc_context_t *context;
+	// Receive buffer.
+	unsigned char *buffer;
+	size_t capacity;
+	size_t offset;
+	size_t available;
+	// Number of read, write and poll calls into the transport.
+	unsigned int nsyscalls;
+	// Device collecting the transfer statistics.
+	struct dc_device_t *device;
 };
 
 struct dc_iostream_vtable_t {
@@ -60,6 +76,8 @@ struct dc_iostream_vtable_t {
 
 	dc_status_t (*write) (dc_iostream_t *iostream, const void *data, size_t size, size_t *actual);
 
+	dc_status_t (*writev) (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual);
+
 	dc_status_t (*flush) (dc_iostream_t *iostream);
 
 	dc_status_t (*purge) (dc_iostream_t *iostream, dc_direction_t direction);
@@ -78,6 +96,22 @@ dc_iostream_deallocate (dc_iostream_t *iostream);
 int
 dc_iostream_isinstance (dc_iostream_t *iostream, const dc_iostream_vtable_t *vtable);
 
+/*
+ * Write the data from multiple buffers with a single call into the
+ * transport. Transports without native support receive the data
+ * combined into a single buffer.
+ */
+dc_status_t
+dc_iostream_writev (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual);
+
+/*
+ * Skip the first len bytes of the buffers, by moving the index of the
+ * current buffer and the offset within that buffer. Used to resume a
+ * partial vectored write.
+ */
+void
+dc_iovec_advance (const dc_iovec_t iov[], size_t count, size_t *index, size_t *offset, size_t len);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -21,10 +21,12 @@
 
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include "iostream-private.h"
 #include "context-private.h"
+#include "device-private.h"
 
 dc_iostream_t *
 dc_iostream_allocate (dc_context_t *context, const dc_iostream_vtable_t *vtable)
@@ -44,6 +46,12 @@ dc_iostream_allocate (dc_context_t *context, const dc_iostream_vtable_t *vtable)
 	// Initialize the base class.
 	iostream->vtable = vtable;
 	iostream->context = context;
+	iostream->buffer = NULL;
+	iostream->capacity = 0;
+	iostream->offset = 0;
+	iostream->available = 0;
+	iostream->nsyscalls = 0;
+	iostream->device = NULL;
 
 	return iostream;
 }
@@ -51,6 +59,10 @@ dc_iostream_allocate (dc_context_t *context, const dc_iostream_vtable_t *vtable)
 void
 dc_iostream_deallocate (dc_iostream_t *iostream)
 {
+	if (iostream == NULL)
+		return;
+
+	free (iostream->buffer);
 	free (iostream);
 }
 
@@ -130,10 +142,65 @@ dc_iostream_get_lines (dc_iostream_t *iostream, unsigned int *value)
 dc_status_t
 dc_iostream_get_available (dc_iostream_t *iostream, size_t *value)
 {
+	dc_status_t status = DC_STATUS_SUCCESS;
+	size_t available = 0;
+
 	if (iostream == NULL || iostream->vtable->get_available == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	return iostream->vtable->get_available (iostream, value);
+	iostream->nsyscalls++;
+
+	status = iostream->vtable->get_available (iostream, &available);
+
+	// Include the data in the receive buffer.
+	if (status == DC_STATUS_SUCCESS && value)
+		*value = available + iostream->available;
+
+	return status;
+}
+
+dc_status_t
+dc_iostream_set_buffer (dc_iostream_t *iostream, size_t size)
+{
+	if (iostream == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// The buffer can't be shrunk below the amount of buffered data.
+	if (size && size < iostream->available)
+		return DC_STATUS_INVALIDARGS;
+
+	if (size == 0 && iostream->available)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned char *buffer = NULL;
+	if (size) {
+		buffer = (unsigned char *) malloc (size);
+		if (buffer == NULL) {
+			ERROR (iostream->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+
+		if (iostream->available)
+			memcpy (buffer, iostream->buffer + iostream->offset, iostream->available);
+	}
+
+	free (iostream->buffer);
+	iostream->buffer = buffer;
+	iostream->capacity = size;
+	iostream->offset = 0;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_iostream_get_syscalls (dc_iostream_t *iostream, unsigned int *value)
+{
+	if (iostream == NULL || value == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	*value = iostream->nsyscalls;
+
+	return DC_STATUS_SUCCESS;
 }
 
 dc_status_t
@@ -148,6 +215,73 @@ dc_iostream_configure (dc_iostream_t *iostream, unsigned int baudrate, unsigned
 	return iostream->vtable->configure (iostream, baudrate, databits, parity, stopbits, flowcontrol);
 }
 
+static dc_status_t
+dc_iostream_read_buffered (dc_iostream_t *iostream, unsigned char data[], size_t size, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	size_t nbytes = 0;
+
+	while (1) {
+		// Take the data from the receive buffer first.
+		size_t len = size - nbytes;
+		if (len > iostream->available)
+			len = iostream->available;
+		if (len) {
+			memcpy (data + nbytes, iostream->buffer + iostream->offset, len);
+			iostream->offset += len;
+			iostream->available -= len;
+			nbytes += len;
+		}
+
+		if (nbytes == size)
+			break;
+
+		size_t remaining = size - nbytes;
+
+		// Large reads bypass the receive buffer.
+		if (remaining >= iostream->capacity) {
+			iostream->nsyscalls++;
+			status = iostream->vtable->read (iostream, data + nbytes, remaining, &len);
+			nbytes += len;
+			break;
+		}
+
+		// Drain all data that is already available, but don't wait for
+		// more data than requested. This preserves the timeout behaviour
+		// of the unbuffered read.
+		size_t available = 0;
+		if (iostream->vtable->get_available) {
+			iostream->nsyscalls++;
+			if (iostream->vtable->get_available (iostream, &available) != DC_STATUS_SUCCESS)
+				available = 0;
+		}
+		if (available < remaining)
+			available = remaining;
+		if (available > iostream->capacity)
+			available = iostream->capacity;
+
+		iostream->nsyscalls++;
+		iostream->offset = 0;
+		status = iostream->vtable->read (iostream, iostream->buffer, available, &iostream->available);
+		if (status != DC_STATUS_SUCCESS) {
+			// Return the partial data to the caller.
+			len = iostream->available;
+			if (len > remaining)
+				len = remaining;
+			memcpy (data + nbytes, iostream->buffer, len);
+			iostream->offset = len;
+			iostream->available -= len;
+			nbytes += len;
+			break;
+		}
+	}
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
 dc_status_t
 dc_iostream_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actual)
 {
@@ -159,10 +293,17 @@ dc_iostream_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actu
 		goto out;
 	}
 
-	status = iostream->vtable->read (iostream, data, size, &nbytes);
+	if (iostream->buffer) {
+		status = dc_iostream_read_buffered (iostream, data, size, &nbytes);
+	} else {
+		iostream->nsyscalls++;
+		status = iostream->vtable->read (iostream, data, size, &nbytes);
+	}
 
 	HEXDUMP (iostream->context, DC_LOGLEVEL_INFO, "Read", (unsigned char *) data, nbytes);
 
+	device_stats_transfer (iostream->device, DC_DIRECTION_INPUT, nbytes);
+
 out:
 	if (actual)
 		*actual = nbytes;
@@ -181,17 +322,112 @@ dc_iostream_write (dc_iostream_t *iostream, const void *data, size_t size, size_
 		goto out;
 	}
 
+	iostream->nsyscalls++;
 	status = iostream->vtable->write (iostream, data, size, &nbytes);
 
 	HEXDUMP (iostream->context, DC_LOGLEVEL_INFO, "Write", (const unsigned char *) data, nbytes);
 
+	device_stats_transfer (iostream->device, DC_DIRECTION_OUTPUT, nbytes);
+
+out:
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+dc_status_t
+dc_iostream_writev (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned char stack[256];
+	unsigned char *buffer = NULL;
+	size_t nbytes = 0;
+
+	if (iostream == NULL || iostream->vtable->write == NULL) {
+		status = DC_STATUS_UNSUPPORTED;
+		goto out;
+	}
+
+	if (iov == NULL && count) {
+		status = DC_STATUS_INVALIDARGS;
+		goto out;
+	}
+
+	if (iostream->vtable->writev) {
+		iostream->nsyscalls++;
+		status = iostream->vtable->writev (iostream, iov, count, &nbytes);
+	} else {
+		// Combine the buffers, to send the data with a single write. For
+		// the packet based transports, this keeps the data in the same
+		// packet.
+		size_t size = 0;
+		for (size_t i = 0; i < count; ++i) {
+			size += iov[i].size;
+		}
+
+		if (size == 0)
+			goto out;
+
+		buffer = stack;
+		if (size > sizeof (stack)) {
+			buffer = (unsigned char *) malloc (size);
+			if (buffer == NULL) {
+				ERROR (iostream->context, "Failed to allocate memory.");
+				status = DC_STATUS_NOMEMORY;
+				goto out;
+			}
+		}
+
+		size_t offset = 0;
+		for (size_t i = 0; i < count; ++i) {
+			if (iov[i].size) {
+				memcpy (buffer + offset, iov[i].data, iov[i].size);
+				offset += iov[i].size;
+			}
+		}
+
+		iostream->nsyscalls++;
+		status = iostream->vtable->write (iostream, buffer, size, &nbytes);
+	}
+
+	// Log the data that has been written.
+	size_t remaining = nbytes;
+	for (size_t i = 0; i < count && remaining; ++i) {
+		size_t len = iov[i].size < remaining ? iov[i].size : remaining;
+		HEXDUMP (iostream->context, DC_LOGLEVEL_INFO, "Write", (const unsigned char *) iov[i].data, len);
+		remaining -= len;
+	}
+
+	device_stats_transfer (iostream->device, DC_DIRECTION_OUTPUT, nbytes);
+
 out:
+	if (buffer != stack)
+		free (buffer);
+
 	if (actual)
 		*actual = nbytes;
 
 	return status;
 }
 
+void
+dc_iovec_advance (const dc_iovec_t iov[], size_t count, size_t *index, size_t *offset, size_t len)
+{
+	while (*index < count) {
+		size_t remaining = iov[*index].size - *offset;
+		if (len < remaining) {
+			*offset += len;
+			break;
+		}
+
+		// Move to the next buffer.
+		len -= remaining;
+		*index += 1;
+		*offset = 0;
+	}
+}
+
 dc_status_t
 dc_iostream_flush (dc_iostream_t *iostream)
 {
@@ -211,6 +447,12 @@ dc_iostream_purge (dc_iostream_t *iostream, dc_direction_t direction)
 
 	INFO (iostream->context, "Purge: direction=%u", direction);
 
+	// Discard the buffered data.
+	if (direction & DC_DIRECTION_INPUT) {
+		iostream->offset = 0;
+		iostream->available = 0;
+	}
+
 	return iostream->vtable->purge (iostream, direction);
 }
 
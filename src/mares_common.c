@@ -154,6 +154,8 @@ mares_common_transfer (mares_common_device_t *device, const unsigned char comman
 		if (nretries++ >= MAXRETRIES)
 			return rc;
 
+		device_stats_retry ((dc_device_t *) device);
+
 		// Discard any garbage bytes.
 		dc_iostream_sleep (device->iostream, 100);
 		dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
@@ -204,8 +206,10 @@ mares_common_device_read (dc_device_t *abstract, unsigned int address, unsigned
 
 
 dc_status_t
-mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *layout, const unsigned char fingerprint[], const unsigned char data[], dc_dive_callback_t callback, void *userdata)
+mares_common_extract_dives (dc_device_t *device, const mares_common_layout_t *layout, const unsigned char fingerprint[], const unsigned char data[], dc_dive_callback_t callback, void *userdata)
 {
+	dc_context_t *context = device->context;
+
 	assert (layout != NULL);
 
 	// Get the freedive mode for this model.
@@ -222,16 +226,17 @@ mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *
 	}
 
 	// Make the ringbuffer linear, to avoid having to deal
-	// with the wrap point. The buffer has extra space to
-	// store the profile data for the freedives.
-	unsigned char *buffer = (unsigned char *) malloc (
-		layout->rb_profile_end - layout->rb_profile_begin +
-		layout->rb_freedives_end - layout->rb_freedives_begin);
-	if (buffer == NULL) {
+	// with the wrap point. The buffer is registered with the
+	// device, such that the dives can be retained without a copy.
+	dc_membuf_t *membuf = dc_membuf_new (layout->rb_profile_end - layout->rb_profile_begin);
+	if (membuf == NULL) {
 		ERROR (context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
 	}
 
+	device_set_membuf (device, membuf);
+	unsigned char *buffer = dc_membuf_get_data (membuf);
+
 	memcpy (buffer + 0, data + eop, layout->rb_profile_end - eop);
 	memcpy (buffer + layout->rb_profile_end - eop, data + layout->rb_profile_begin, eop - layout->rb_profile_begin);
 
@@ -305,10 +310,13 @@ mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *
 		unsigned int length = array_uint16_le (buffer + offset);
 		if (length != nbytes) {
 			ERROR (context, "Calculated and stored size are not equal (%u %u).", length, nbytes);
-			free (buffer);
+			device_set_membuf (device, NULL);
 			return DC_STATUS_DATAFORMAT;
 		}
 
+		unsigned char *dive = buffer + offset;
+		unsigned char *freedives = NULL;
+
 		// Process the profile data for the most recent freedive entry.
 		// Since we are processing the entries backwards (newest to oldest),
 		// this entry will always be the first one.
@@ -333,30 +341,41 @@ mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *
 			// both values are different, the profile data is incomplete.
 			if (count != nsamples) {
 				ERROR (context, "Unexpected number of freedive sessions (%u %u).", count, nsamples);
-				free (buffer);
+				device_set_membuf (device, NULL);
 				return DC_STATUS_DATAFORMAT;
 			}
 
-			// Append the profile data to the main logbook entry. The
-			// buffer is guaranteed to have enough space, and the dives
-			// that will be overwritten have already been processed.
-			memcpy (buffer + offset + nbytes, data + layout->rb_freedives_begin, idx - layout->rb_freedives_begin);
+			// Append the profile data to a copy of the main logbook entry.
+			// The dives following this entry in the linear buffer may still
+			// be referenced by the application, and can't be overwritten.
+			freedives = (unsigned char *) malloc (nbytes + idx - layout->rb_freedives_begin);
+			if (freedives == NULL) {
+				ERROR (context, "Failed to allocate memory.");
+				device_set_membuf (device, NULL);
+				return DC_STATUS_NOMEMORY;
+			}
+
+			memcpy (freedives, buffer + offset, nbytes);
+			memcpy (freedives + nbytes, data + layout->rb_freedives_begin, idx - layout->rb_freedives_begin);
 			nbytes += idx - layout->rb_freedives_begin;
+			dive = freedives;
 		}
 
-		unsigned int fp_offset = offset + length - extra - FP_OFFSET;
-		if (fingerprint && memcmp (buffer + fp_offset, fingerprint, FP_SIZE) == 0) {
-			free (buffer);
-			return DC_STATUS_SUCCESS;
+		unsigned int fp_offset = length - extra - FP_OFFSET;
+		if (fingerprint && memcmp (dive + fp_offset, fingerprint, FP_SIZE) == 0) {
+			free (freedives);
+			break;
 		}
 
-		if (callback && !callback (buffer + offset, nbytes, buffer + fp_offset, FP_SIZE, userdata)) {
-			free (buffer);
-			return DC_STATUS_SUCCESS;
-		}
+		int proceed = !callback || callback (dive, nbytes, dive + fp_offset, FP_SIZE, userdata);
+
+		free (freedives);
+
+		if (!proceed)
+			break;
 	}
 
-	free (buffer);
+	device_set_membuf (device, NULL);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -255,6 +255,8 @@ mares_darwin_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback,
 	devinfo.serial = array_uint16_be (data + 8);
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
+	device_image_set_memory (abstract, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+
 	rc = mares_darwin_extract_dives (abstract, dc_buffer_get_data (buffer),
 		dc_buffer_get_size (buffer), callback, userdata);
 
@@ -110,6 +110,8 @@ mares_nemo_device_open (dc_device_t **out, dc_context_t *context, const char *na
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (9600 8N1).
 	status = dc_iostream_configure (device->iostream, 9600, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -317,7 +319,9 @@ mares_nemo_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 		break;
 	}
 
-	rc = mares_common_extract_dives (abstract->context, layout, device->fingerprint, data, callback, userdata);
+	device_image_set_memory (abstract, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+
+	rc = mares_common_extract_dives (abstract, layout, device->fingerprint, data, callback, userdata);
 
 	dc_buffer_free (buffer);
 
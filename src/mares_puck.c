@@ -260,7 +260,9 @@ mares_puck_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 	devinfo.serial = array_uint16_be (data + 8);
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
-	rc = mares_common_extract_dives (abstract->context, device->layout, device->fingerprint, data, callback, userdata);
+	device_image_set_memory (abstract, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+
+	rc = mares_common_extract_dives (abstract, device->layout, device->fingerprint, data, callback, userdata);
 
 	dc_buffer_free (buffer);
 
@@ -40,6 +40,9 @@
 #define MAXDELAY   16
 #define INVALID    0xFFFFFFFF
 
+#define NCACHE     8
+#define MAXCACHE   64
+
 #define CMD_INIT      0xA8
 #define CMD_VERSION   0x84
 #define CMD_READ1     0xB1
@@ -52,13 +55,22 @@
 #define ACK 0x5A
 #define NAK 0xA5
 
+typedef struct oceanic_atom2_page_t {
+	unsigned int number;
+	unsigned int timestamp;
+	unsigned char data[256];
+} oceanic_atom2_page_t;
+
 typedef struct oceanic_atom2_device_t {
 	oceanic_common_device_t base;
 	dc_iostream_t *iostream;
 	unsigned int delay;
 	unsigned int bigpage;
-	unsigned char cache[256];
-	unsigned int cached;
+	oceanic_atom2_page_t *cache;
+	unsigned int ncache;
+	unsigned int timestamp;
+	unsigned int hits;
+	unsigned int misses;
 } oceanic_atom2_device_t;
 
 static dc_status_t oceanic_atom2_device_read (dc_device_t *abstract, unsigned int address, unsigned char data[], unsigned int size);
@@ -547,6 +559,8 @@ oceanic_atom2_transfer (oceanic_atom2_device_t *device, const unsigned char comm
 		if (nretries++ >= MAXRETRIES)
 			return rc;
 
+		device_stats_retry ((dc_device_t *) device);
+
 		// Increase the inter packet delay.
 		if (device->delay < MAXDELAY)
 			device->delay++;
@@ -560,6 +574,52 @@ oceanic_atom2_transfer (oceanic_atom2_device_t *device, const unsigned char comm
 }
 
 
+static void
+oceanic_atom2_cache_invalidate (oceanic_atom2_device_t *device)
+{
+	for (unsigned int i = 0; i < device->ncache; ++i) {
+		device->cache[i].number = INVALID;
+		device->cache[i].timestamp = 0;
+	}
+
+	device->timestamp = 0;
+}
+
+
+static oceanic_atom2_page_t *
+oceanic_atom2_cache_lookup (oceanic_atom2_device_t *device, unsigned int number)
+{
+	for (unsigned int i = 0; i < device->ncache; ++i) {
+		if (device->cache[i].number == number) {
+			device->cache[i].timestamp = ++device->timestamp;
+			return device->cache + i;
+		}
+	}
+
+	return NULL;
+}
+
+
+static oceanic_atom2_page_t *
+oceanic_atom2_cache_evict (oceanic_atom2_device_t *device, unsigned int number)
+{
+	if (device->ncache == 0)
+		return NULL;
+
+	// Replace the least recently used page.
+	oceanic_atom2_page_t *page = device->cache;
+	for (unsigned int i = 1; i < device->ncache; ++i) {
+		if (device->cache[i].timestamp < page->timestamp)
+			page = device->cache + i;
+	}
+
+	page->number = number;
+	page->timestamp = ++device->timestamp;
+
+	return page;
+}
+
+
 static dc_status_t
 oceanic_atom2_quit (oceanic_atom2_device_t *device)
 {
@@ -596,8 +656,17 @@ oceanic_atom2_device_open (dc_device_t **out, dc_context_t *context, const char
 	device->iostream = NULL;
 	device->delay = 0;
 	device->bigpage = 1; // no big pages
-	device->cached = INVALID;
-	memset(device->cache, 0, sizeof(device->cache));
+	device->cache = NULL;
+	device->ncache = 0;
+	device->hits = 0;
+	device->misses = 0;
+
+	// Allocate the page cache.
+	status = oceanic_atom2_device_set_cache ((dc_device_t *) device, NCACHE);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to allocate memory.");
+		goto error_free;
+	}
 
 	// Open the device.
 	status = dc_serial_open (&device->iostream, context, name);
@@ -606,6 +675,8 @@ oceanic_atom2_device_open (dc_device_t **out, dc_context_t *context, const char
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Get the correct baudrate.
 	unsigned int baudrate = 38400;
 	if (model == VTX || model == I750TC) {
@@ -722,6 +793,7 @@ oceanic_atom2_device_open (dc_device_t **out, dc_context_t *context, const char
 error_close:
 	dc_iostream_close (device->iostream);
 error_free:
+	free (device->cache);
 	dc_device_deallocate ((dc_device_t *) device);
 	return status;
 }
@@ -734,6 +806,8 @@ oceanic_atom2_device_close (dc_device_t *abstract)
 	oceanic_atom2_device_t *device = (oceanic_atom2_device_t*) abstract;
 	dc_status_t rc = DC_STATUS_SUCCESS;
 
+	INFO (abstract->context, "Cache: hits=%u, misses=%u", device->hits, device->misses);
+
 	// Send the quit command.
 	rc = oceanic_atom2_quit (device);
 	if (rc != DC_STATUS_SUCCESS) {
@@ -746,10 +820,40 @@ oceanic_atom2_device_close (dc_device_t *abstract)
 		dc_status_set_error(&status, rc);
 	}
 
+	free (device->cache);
+
 	return status;
 }
 
 
+dc_status_t
+oceanic_atom2_device_set_cache (dc_device_t *abstract, unsigned int npages)
+{
+	oceanic_atom2_device_t *device = (oceanic_atom2_device_t*) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	if (npages > MAXCACHE)
+		return DC_STATUS_INVALIDARGS;
+
+	oceanic_atom2_page_t *cache = NULL;
+	if (npages) {
+		cache = (oceanic_atom2_page_t *) malloc (npages * sizeof (oceanic_atom2_page_t));
+		if (cache == NULL)
+			return DC_STATUS_NOMEMORY;
+	}
+
+	free (device->cache);
+	device->cache = cache;
+	device->ncache = npages;
+
+	oceanic_atom2_cache_invalidate (device);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 dc_status_t
 oceanic_atom2_device_keepalive (dc_device_t *abstract)
 {
@@ -825,31 +929,44 @@ oceanic_atom2_device_read (dc_device_t *abstract, unsigned int address, unsigned
 
 	unsigned int nbytes = 0;
 	while (nbytes < size) {
-		unsigned int page = address / pagesize;
-		if (page != device->cached) {
+		unsigned int number = address / pagesize;
+		unsigned int offset = address % pagesize;
+		unsigned int length = pagesize - offset;
+		if (nbytes + length > size)
+			length = size - nbytes;
+
+		oceanic_atom2_page_t *page = oceanic_atom2_cache_lookup (device, number);
+		if (page) {
+			device->hits++;
+			memcpy (data, page->data + offset, length);
+		} else {
+			device->misses++;
+
 			// Read the package.
-			unsigned int number = page * device->bigpage; // This is always PAGESIZE, even in big page mode.
-			unsigned char answer[256 + 2] = {0};          // Maximum we support for the known commands.
+			unsigned int first = number * device->bigpage; // This is always PAGESIZE, even in big page mode.
+			unsigned char answer[256 + 2] = {0};           // Maximum we support for the known commands.
 			unsigned char command[4] = {read_cmd,
-					(number >> 8) & 0xFF, // high
-					(number     ) & 0xFF, // low
+					(first >> 8) & 0xFF, // high
+					(first     ) & 0xFF, // low
 					0};
 			dc_status_t rc = oceanic_atom2_transfer (device, command, sizeof (command), answer,  pagesize + crc_size, crc_size);
 			if (rc != DC_STATUS_SUCCESS)
 				return rc;
 
-			// Cache the page.
-			memcpy (device->cache, answer, pagesize);
-			device->cached = page;
+			memcpy (data, answer + offset, length);
+
+			// Cache the page, unless it's entirely consumed as part of a
+			// larger request. Those pages are unlikely to be requested
+			// again, and would only evict the pages that are (e.g. the
+			// ringbuffer pointers).
+			if (length != pagesize || size == pagesize) {
+				page = oceanic_atom2_cache_evict (device, number);
+				if (page) {
+					memcpy (page->data, answer, pagesize);
+				}
+			}
 		}
 
-		unsigned int offset = address % pagesize;
-		unsigned int length = pagesize - offset;
-		if (nbytes + length > size)
-			length = size - nbytes;
-
-		memcpy (data, device->cache + offset, length);
-
 		nbytes += length;
 		address += length;
 		data += length;
@@ -869,7 +986,7 @@ oceanic_atom2_device_write (dc_device_t *abstract, unsigned int address, const u
 		return DC_STATUS_INVALIDARGS;
 
 	// Invalidate the cache.
-	device->cached = INVALID;
+	oceanic_atom2_cache_invalidate (device);
 
 	unsigned int nbytes = 0;
 	while (nbytes < size) {
@@ -129,6 +129,7 @@ static const dc_parser_vtable_t oceanic_atom2_parser_vtable = {
 	oceanic_atom2_parser_get_datetime, /* datetime */
 	oceanic_atom2_parser_get_field, /* fields */
 	oceanic_atom2_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_decode */
 	NULL /* destroy */
 };
 
@@ -574,7 +575,9 @@ oceanic_atom2_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, uns
 			default:
 				return DC_STATUS_UNSUPPORTED;
 			}
-			string->value = strdup(buf);
+			string->value = dc_arena_strdup (&abstract->arena, buf);
+			if (string->value == NULL)
+				return DC_STATUS_NOMEMORY;
 			break;
 		default:
 			return DC_STATUS_UNSUPPORTED;
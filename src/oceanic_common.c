@@ -40,6 +40,8 @@
 
 #define INVALID 0
 
+#define READAHEAD 8
+
 static unsigned int
 get_profile_first (const unsigned char data[], const oceanic_common_layout_t *layout)
 {
@@ -399,22 +401,22 @@ oceanic_common_device_profile (dc_device_t *abstract, dc_event_progress_t *progr
 	progress->maximum -= (layout->rb_profile_end - layout->rb_profile_begin) - rb_profile_size;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
 
-	// Create the ringbuffer stream.
+	// The ringbuffer stream is created on demand, because it needs to be
+	// restarted after dives that are skipped.
 	dc_rbstream_t *rbstream = NULL;
-	rc = dc_rbstream_new (&rbstream, abstract, PAGESIZE, PAGESIZE * device->multipage, layout->rb_profile_begin, layout->rb_profile_end, rb_profile_end);
-	if (rc != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
-		return rc;
-	}
 
-	// Memory buffer for the profile data.
-	unsigned char *profiles = (unsigned char *) malloc (rb_profile_size + rb_logbook_size);
-	if (profiles == NULL) {
+	// Memory buffer for the profile data. The buffer is registered with
+	// the device, such that the dives can be retained without a copy.
+	dc_membuf_t *membuf = dc_membuf_new (rb_profile_size + rb_logbook_size);
+	if (membuf == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
 		dc_rbstream_free (rbstream);
 		return DC_STATUS_NOMEMORY;
 	}
 
+	device_set_membuf (abstract, membuf);
+	unsigned char *profiles = dc_membuf_get_data (membuf);
+
 	// Keep track of the current position.
 	unsigned int offset = rb_profile_size + rb_logbook_size;
 
@@ -440,7 +442,7 @@ oceanic_common_device_profile (dc_device_t *abstract, dc_event_progress_t *progr
 			ERROR (abstract->context, "Invalid ringbuffer pointer detected (0x%06x 0x%06x).",
 				rb_entry_first, rb_entry_last);
 			dc_rbstream_free (rbstream);
-			free (profiles);
+			device_set_membuf (abstract, NULL);
 			return DC_STATUS_DATAFORMAT;
 		}
 
@@ -464,13 +466,47 @@ oceanic_common_device_profile (dc_device_t *abstract, dc_event_progress_t *progr
 		// Move to the start of the current dive.
 		offset -= rb_entry_size + gap;
 
-		// Read the dive.
-		rc = dc_rbstream_read (rbstream, progress, profiles + offset, rb_entry_size + gap);
-		if (rc != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to read the dive.");
+		// Check whether the dive was already downloaded before.
+		int known = device_is_known_dive (abstract, logbooks + entry, layout->rb_logbook_entry_size);
+
+		if (known) {
+			// Skip the dive.
 			dc_rbstream_free (rbstream);
-			free (profiles);
-			return rc;
+			rbstream = NULL;
+
+			// Update and emit a progress event.
+			progress->current += rb_entry_size + gap;
+			device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
+		} else {
+			// Create the ringbuffer stream.
+			if (rbstream == NULL) {
+				rc = dc_rbstream_new (&rbstream, abstract, PAGESIZE, PAGESIZE * device->multipage, layout->rb_profile_begin, layout->rb_profile_end, previous);
+				if (rc != DC_STATUS_SUCCESS) {
+					ERROR (abstract->context, "Failed to create the ringbuffer stream.");
+					device_set_membuf (abstract, NULL);
+					return rc;
+				}
+
+				// The exact amount of profile data is known in advance, so
+				// multiple packets can be requested at once without reading
+				// too much data.
+				rc = dc_rbstream_set_readahead (rbstream, READAHEAD, remaining);
+				if (rc != DC_STATUS_SUCCESS) {
+					ERROR (abstract->context, "Failed to enable the read-ahead mode.");
+					dc_rbstream_free (rbstream);
+					device_set_membuf (abstract, NULL);
+					return rc;
+				}
+			}
+
+			// Read the dive.
+			rc = dc_rbstream_read (rbstream, progress, profiles + offset, rb_entry_size + gap);
+			if (rc != DC_STATUS_SUCCESS) {
+				ERROR (abstract->context, "Failed to read the dive.");
+				dc_rbstream_free (rbstream);
+				device_set_membuf (abstract, NULL);
+				return rc;
+			}
 		}
 
 		remaining -= rb_entry_size + gap;
@@ -481,6 +517,9 @@ oceanic_common_device_profile (dc_device_t *abstract, dc_event_progress_t *progr
 		offset -= layout->rb_logbook_entry_size;
 		memcpy (profiles + offset, logbooks + entry, layout->rb_logbook_entry_size);
 
+		if (known)
+			continue;
+
 		unsigned char *p = profiles + offset;
 		if (callback && !callback (p, rb_entry_size + layout->rb_logbook_entry_size, p, layout->rb_logbook_entry_size, userdata)) {
 			break;
@@ -488,7 +527,7 @@ oceanic_common_device_profile (dc_device_t *abstract, dc_event_progress_t *progr
 	}
 
 	dc_rbstream_free (rbstream);
-	free (profiles);
+	device_set_membuf (abstract, NULL);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -148,6 +148,8 @@ oceanic_veo250_transfer (oceanic_veo250_device_t *device, const unsigned char co
 		if (nretries++ >= MAXRETRIES)
 			return rc;
 
+		device_stats_retry ((dc_device_t *) device);
+
 		// Delay the next attempt.
 		dc_iostream_sleep (device->iostream, 100);
 	}
@@ -258,6 +260,8 @@ oceanic_veo250_device_open (dc_device_t **out, dc_context_t *context, const char
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (9600 8N1).
 	status = dc_iostream_configure (device->iostream, 9600, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -25,22 +25,45 @@
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/parser.h>
 
+#include "arena.h"
+#include "platform.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
 struct dc_parser_t;
 struct dc_parser_vtable_t;
+struct dc_sample_table_t;
 
 typedef struct dc_parser_vtable_t dc_parser_vtable_t;
+typedef struct dc_sample_table_t dc_sample_table_t;
 
 struct dc_parser_t {
 	const dc_parser_vtable_t *vtable;
 	dc_context_t *context;
 	const unsigned char *data;
 	unsigned int size;
+	/* Position of the batch interface: the number of rows returned, and
+	 * the total number of rows (DC_SAMPLE_UNDEFINED until known). */
+	unsigned int samples_next;
+	unsigned int samples_count;
+	/* Memory for strings and caches, reset for every dive. */
+	dc_arena_t arena;
 };
 
+/*
+ * Destination for the decoded samples. Backends implementing the
+ * samples_decode function emit their samples through the sink, which
+ * either forwards them to the callback function of the application, or
+ * stores them directly in the arrays of a columnar sample batch.
+ */
+typedef struct dc_sample_sink_t {
+	dc_sample_callback_t callback;
+	void *userdata;
+	dc_sample_table_t *table;
+} dc_sample_sink_t;
+
 struct dc_parser_vtable_t {
 	size_t size;
 
@@ -54,6 +77,8 @@ struct dc_parser_vtable_t {
 
 	dc_status_t (*samples_foreach) (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata);
 
+	dc_status_t (*samples_decode) (dc_parser_t *parser, const dc_sample_sink_t *sink);
+
 	dc_status_t (*destroy) (dc_parser_t *parser);
 };
 
@@ -66,6 +91,27 @@ dc_parser_deallocate (dc_parser_t *parser);
 int
 dc_parser_isinstance (dc_parser_t *parser, const dc_parser_vtable_t *vtable);
 
+void
+dc_sample_table_add (dc_sample_table_t *table, dc_sample_type_t type, const dc_sample_value_t *value);
+
+/*
+ * Emit a sample through the sink. This is called for every sample value,
+ * and therefore inlined into the decoders. A NULL sink discards the
+ * samples, for decoders which are only run to collect the statistics.
+ */
+static inline void
+dc_sample_sink_emit (const dc_sample_sink_t *sink, dc_sample_type_t type, const dc_sample_value_t *value)
+{
+	if (sink == NULL)
+		return;
+
+	if (sink->table) {
+		dc_sample_table_add (sink->table, type, value);
+	} else if (sink->callback) {
+		sink->callback (type, *value, sink->userdata);
+	}
+}
+
 typedef struct sample_statistics_t {
 	unsigned int divetime;
 	double maxdepth;
@@ -20,6 +20,8 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <assert.h>
 
 #include "suunto_d9.h"
@@ -60,9 +62,41 @@
 #include "context-private.h"
 #include "parser-private.h"
 #include "device-private.h"
+#include "image-private.h"
 
 #define REACTPROWHITE 0x4354
 
+struct dc_sample_table_t {
+	// The rows are stored directly in the arrays of the application.
+	// Only the rows in the window starting at the first row that wasn't
+	// returned yet are stored, all other rows are skipped.
+	dc_sample_batch_t *batch;
+	unsigned int skip;
+	unsigned int nrows;
+	unsigned int gasmix;
+};
+
+// Maximum number of idle parsers in a pool.
+#define POOLSIZE 4
+
+typedef struct dc_parser_pool_entry_t {
+	dc_parser_t *parser;
+	dc_family_t family;
+	unsigned int model;
+	unsigned int serial;
+	unsigned int devtime;
+	dc_ticks_t systime;
+	int busy;
+} dc_parser_pool_entry_t;
+
+struct dc_parser_pool_t {
+	dc_context_t *context;
+	dc_parser_pool_entry_t *entries;
+	unsigned int count;
+	unsigned int capacity;
+	unsigned int nidle;
+};
+
 static dc_status_t
 dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t family, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
 {
@@ -199,6 +233,174 @@ dc_parser_new2 (dc_parser_t **out, dc_context_t *context, dc_descriptor_t *descr
 		devtime, systime);
 }
 
+dc_status_t
+dc_parser_new_image (dc_parser_t **out, dc_image_t *image)
+{
+	dc_event_devinfo_t devinfo;
+	dc_event_clock_t clock;
+
+	if (image == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_image_get_devinfo (image, &devinfo);
+	dc_image_get_clock (image, &clock);
+
+	return dc_parser_new_internal (out, dc_image_get_context (image),
+		dc_image_get_type (image),
+		devinfo.model,
+		devinfo.serial,
+		clock.devtime, clock.systime);
+}
+
+dc_status_t
+dc_parser_pool_new (dc_parser_pool_t **out, dc_context_t *context)
+{
+	dc_parser_pool_t *pool = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	pool = (dc_parser_pool_t *) malloc (sizeof (dc_parser_pool_t));
+	if (pool == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	pool->context = context;
+	pool->entries = NULL;
+	pool->count = 0;
+	pool->capacity = 0;
+	pool->nidle = 0;
+
+	*out = pool;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_parser_pool_acquire_internal (dc_parser_pool_t *pool, dc_parser_t **out, dc_family_t family, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_parser_t *parser = NULL;
+
+	if (pool == NULL || out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Reuse an idle parser with the same parameters.
+	for (unsigned int i = 0; i < pool->count; ++i) {
+		dc_parser_pool_entry_t *entry = pool->entries + i;
+		if (!entry->busy &&
+			entry->family == family &&
+			entry->model == model &&
+			entry->serial == serial &&
+			entry->devtime == devtime &&
+			entry->systime == systime) {
+			entry->busy = 1;
+			pool->nidle--;
+			*out = entry->parser;
+			return DC_STATUS_SUCCESS;
+		}
+	}
+
+	// Grow the array if necessary.
+	if (pool->count >= pool->capacity) {
+		unsigned int capacity = pool->capacity ? pool->capacity * 2 : POOLSIZE;
+		dc_parser_pool_entry_t *entries = (dc_parser_pool_entry_t *) realloc (pool->entries, capacity * sizeof (dc_parser_pool_entry_t));
+		if (entries == NULL) {
+			ERROR (pool->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+		pool->entries = entries;
+		pool->capacity = capacity;
+	}
+
+	status = dc_parser_new_internal (&parser, pool->context, family, model, serial, devtime, systime);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	dc_parser_pool_entry_t *entry = pool->entries + pool->count++;
+	entry->parser = parser;
+	entry->family = family;
+	entry->model = model;
+	entry->serial = serial;
+	entry->devtime = devtime;
+	entry->systime = systime;
+	entry->busy = 1;
+
+	*out = parser;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_parser_pool_acquire (dc_parser_pool_t *pool, dc_parser_t **out, dc_device_t *device)
+{
+	if (device == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	return dc_parser_pool_acquire_internal (pool, out,
+		dc_device_get_type (device),
+		device->devinfo.model,
+		device->devinfo.serial,
+		device->clock.devtime, device->clock.systime);
+}
+
+dc_status_t
+dc_parser_pool_acquire2 (dc_parser_pool_t *pool, dc_parser_t **out, dc_descriptor_t *descriptor, unsigned int devtime, dc_ticks_t systime)
+{
+	return dc_parser_pool_acquire_internal (pool, out,
+		dc_descriptor_get_type (descriptor),
+		dc_descriptor_get_model (descriptor),
+		0,
+		devtime, systime);
+}
+
+dc_status_t
+dc_parser_pool_release (dc_parser_pool_t *pool, dc_parser_t *parser)
+{
+	if (pool == NULL || parser == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	for (unsigned int i = 0; i < pool->count; ++i) {
+		dc_parser_pool_entry_t *entry = pool->entries + i;
+		if (entry->parser != parser)
+			continue;
+
+		if (!entry->busy)
+			return DC_STATUS_INVALIDARGS;
+
+		if (pool->nidle >= POOLSIZE) {
+			// Too many idle parsers. Destroy it.
+			dc_parser_destroy (parser);
+			*entry = pool->entries[--pool->count];
+		} else {
+			entry->busy = 0;
+			pool->nidle++;
+		}
+
+		return DC_STATUS_SUCCESS;
+	}
+
+	ERROR (pool->context, "Parser does not belong to the pool.");
+	return DC_STATUS_INVALIDARGS;
+}
+
+dc_status_t
+dc_parser_pool_free (dc_parser_pool_t *pool)
+{
+	if (pool == NULL)
+		return DC_STATUS_SUCCESS;
+
+	for (unsigned int i = 0; i < pool->count; ++i) {
+		dc_parser_destroy (pool->entries[i].parser);
+	}
+
+	free (pool->entries);
+	free (pool);
+
+	return DC_STATUS_SUCCESS;
+}
+
 dc_parser_t *
 dc_parser_allocate (dc_context_t *context, const dc_parser_vtable_t *vtable)
 {
@@ -219,6 +421,9 @@ dc_parser_allocate (dc_context_t *context, const dc_parser_vtable_t *vtable)
 	parser->context = context;
 	parser->data = NULL;
 	parser->size = 0;
+	parser->samples_next = 0;
+	parser->samples_count = DC_SAMPLE_UNDEFINED;
+	dc_arena_init (&parser->arena);
 
 	return parser;
 }
@@ -226,6 +431,10 @@ dc_parser_allocate (dc_context_t *context, const dc_parser_vtable_t *vtable)
 void
 dc_parser_deallocate (dc_parser_t *parser)
 {
+	if (parser == NULL)
+		return;
+
+	dc_arena_free (&parser->arena);
 	free (parser);
 }
 
@@ -258,6 +467,11 @@ dc_parser_set_data (dc_parser_t *parser, const unsigned char *data, unsigned int
 	if (parser->vtable->set_data == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
+	// Discard the strings of the previous dive, and restart the batches.
+	parser->samples_next = 0;
+	parser->samples_count = DC_SAMPLE_UNDEFINED;
+	dc_arena_reset (&parser->arena);
+
 	parser->data = data;
 	parser->size = size;
 
@@ -296,6 +510,11 @@ dc_parser_samples_foreach (dc_parser_t *parser, dc_sample_callback_t callback, v
 	if (parser == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
+	if (parser->vtable->samples_decode) {
+		dc_sample_sink_t sink = {callback, userdata, NULL};
+		return parser->vtable->samples_decode (parser, &sink);
+	}
+
 	if (parser->vtable->samples_foreach == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
@@ -303,6 +522,194 @@ dc_parser_samples_foreach (dc_parser_t *parser, dc_sample_callback_t callback, v
 }
 
 
+dc_status_t
+dc_parser_get_allocstats (dc_parser_t *parser, unsigned int *nallocs, unsigned int *nbytes)
+{
+	if (parser == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (nallocs)
+		*nallocs = parser->arena.nallocs;
+
+	if (nbytes)
+		*nbytes = parser->arena.nbytes;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+void
+dc_sample_table_add (dc_sample_table_t *table, dc_sample_type_t type, const dc_sample_value_t *value)
+{
+	dc_sample_batch_t *batch = table->batch;
+	unsigned int n = 0;
+
+	if (type == DC_SAMPLE_TIME) {
+		// Start a new row, and skip it if it's outside the window.
+		n = table->nrows++;
+		if (n < table->skip || n - table->skip >= batch->capacity)
+			return;
+
+		n -= table->skip;
+		if (batch->time)
+			batch->time[n] = value->time;
+		if (batch->depth)
+			batch->depth[n] = NAN;
+		if (batch->temperature)
+			batch->temperature[n] = NAN;
+		for (unsigned int i = 0; i < DC_SAMPLE_BATCH_MAXTANKS; ++i) {
+			if (batch->pressure[i])
+				batch->pressure[i][n] = NAN;
+		}
+		if (batch->rbt)
+			batch->rbt[n] = DC_SAMPLE_UNDEFINED;
+		if (batch->heartbeat)
+			batch->heartbeat[n] = DC_SAMPLE_UNDEFINED;
+		if (batch->bearing)
+			batch->bearing[n] = DC_SAMPLE_UNDEFINED;
+		if (batch->setpoint)
+			batch->setpoint[n] = NAN;
+		if (batch->ppo2)
+			batch->ppo2[n] = NAN;
+		if (batch->cns)
+			batch->cns[n] = NAN;
+		if (batch->deco_type)
+			batch->deco_type[n] = DC_SAMPLE_UNDEFINED;
+		if (batch->deco_time)
+			batch->deco_time[n] = DC_SAMPLE_UNDEFINED;
+		if (batch->deco_depth)
+			batch->deco_depth[n] = NAN;
+		if (batch->gasmix)
+			batch->gasmix[n] = table->gasmix;
+		return;
+	}
+
+	// The gas mix remains active until the next gas change, and is
+	// tracked for the skipped rows as well.
+	if (type == DC_SAMPLE_GASMIX)
+		table->gasmix = value->gasmix;
+
+	// Values without a preceding time sample are dropped, and so are
+	// the values of the skipped rows.
+	if (table->nrows == 0)
+		return;
+
+	n = table->nrows - 1;
+	if (n < table->skip || n - table->skip >= batch->capacity)
+		return;
+
+	n -= table->skip;
+
+	switch (type) {
+	case DC_SAMPLE_DEPTH:
+		if (batch->depth)
+			batch->depth[n] = value->depth;
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		if (batch->temperature)
+			batch->temperature[n] = value->temperature;
+		break;
+	case DC_SAMPLE_PRESSURE:
+		if (value->pressure.tank < DC_SAMPLE_BATCH_MAXTANKS && batch->pressure[value->pressure.tank])
+			batch->pressure[value->pressure.tank][n] = value->pressure.value;
+		break;
+	case DC_SAMPLE_RBT:
+		if (batch->rbt)
+			batch->rbt[n] = value->rbt;
+		break;
+	case DC_SAMPLE_HEARTBEAT:
+		if (batch->heartbeat)
+			batch->heartbeat[n] = value->heartbeat;
+		break;
+	case DC_SAMPLE_BEARING:
+		if (batch->bearing)
+			batch->bearing[n] = value->bearing;
+		break;
+	case DC_SAMPLE_SETPOINT:
+		if (batch->setpoint)
+			batch->setpoint[n] = value->setpoint;
+		break;
+	case DC_SAMPLE_PPO2:
+		if (batch->ppo2)
+			batch->ppo2[n] = value->ppo2;
+		break;
+	case DC_SAMPLE_CNS:
+		if (batch->cns)
+			batch->cns[n] = value->cns;
+		break;
+	case DC_SAMPLE_DECO:
+		if (batch->deco_type)
+			batch->deco_type[n] = value->deco.type;
+		if (batch->deco_time)
+			batch->deco_time[n] = value->deco.time;
+		if (batch->deco_depth)
+			batch->deco_depth[n] = value->deco.depth;
+		break;
+	case DC_SAMPLE_GASMIX:
+		if (batch->gasmix)
+			batch->gasmix[n] = value->gasmix;
+		break;
+	default:
+		break;
+	}
+}
+
+
+static void
+dc_sample_table_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	dc_sample_table_t *table = (dc_sample_table_t *) userdata;
+
+	dc_sample_table_add (table, type, &value);
+}
+
+
+dc_status_t
+dc_parser_samples_get_batch (dc_parser_t *parser, dc_sample_batch_t *batch)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (batch == NULL || batch->capacity == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	batch->count = 0;
+
+	// All samples have been returned already.
+	if (parser->samples_next == parser->samples_count)
+		return DC_STATUS_SUCCESS;
+
+	// The decoders can't be suspended, so the samples are decoded again
+	// from the start, and only the rows that fit in the batch of the
+	// caller are stored. No memory is allocated.
+	dc_sample_table_t table = {batch, parser->samples_next, 0, DC_SAMPLE_UNDEFINED};
+	if (parser->vtable->samples_decode) {
+		dc_sample_sink_t sink = {NULL, NULL, &table};
+		status = parser->vtable->samples_decode (parser, &sink);
+	} else if (parser->vtable->samples_foreach) {
+		status = parser->vtable->samples_foreach (parser, dc_sample_table_cb, &table);
+	} else {
+		status = DC_STATUS_UNSUPPORTED;
+	}
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	unsigned int n = 0;
+	if (table.nrows > table.skip)
+		n = table.nrows - table.skip;
+	if (n > batch->capacity)
+		n = batch->capacity;
+
+	parser->samples_count = table.nrows;
+	parser->samples_next += n;
+	batch->count = n;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 dc_status_t
 dc_parser_destroy (dc_parser_t *parser)
 {
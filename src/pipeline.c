@@ -0,0 +1,288 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2018 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdivecomputer/pipeline.h>
+#include <libdivecomputer/divebuf.h>
+
+#include "context-private.h"
+#include "device-private.h"
+#include "thread.h"
+
+typedef struct dc_pipeline_item_t {
+	dc_divebuf_t *dive;
+	const unsigned char *data;
+	unsigned int size;
+	const unsigned char *fingerprint;
+	unsigned int fsize;
+	dc_parser_t *parser;
+	dc_status_t status;
+	unsigned int done;
+} dc_pipeline_item_t;
+
+typedef struct dc_pipeline_t {
+	dc_device_t *device;
+	dc_dive_parse_callback_t parse;
+	dc_dive_complete_callback_t complete;
+	void *userdata;
+	// Queue with the downloaded dives. The items are identified with a
+	// sequence number, and stored at the corresponding position in the
+	// ringbuffer. The dives between the head and the next sequence number
+	// are being parsed, and the ones between the next and the tail
+	// sequence number are waiting for a worker thread.
+	dc_pipeline_item_t *items;
+	unsigned int depth;
+	unsigned int head;
+	unsigned int next;
+	unsigned int tail;
+	unsigned int finished;
+	unsigned int stopped;
+	dc_status_t status;
+	dc_mutex_t mutex;
+	dc_cond_t notempty;
+	dc_cond_t notfull;
+	// Serializes the completion callbacks.
+	dc_mutex_t completion;
+} dc_pipeline_t;
+
+static void
+dc_pipeline_complete (dc_pipeline_t *pipeline)
+{
+	dc_mutex_lock (&pipeline->completion);
+
+	// Complete the dives in the same order as they were downloaded. Dives
+	// that finish out of order are completed by the worker thread that
+	// finishes the oldest one.
+	while (1) {
+		dc_mutex_lock (&pipeline->mutex);
+		dc_pipeline_item_t *item = pipeline->items + pipeline->head % pipeline->depth;
+		if (pipeline->head == pipeline->tail || !item->done) {
+			dc_mutex_unlock (&pipeline->mutex);
+			break;
+		}
+		unsigned int stopped = pipeline->stopped;
+		dc_mutex_unlock (&pipeline->mutex);
+
+		if (!stopped && pipeline->complete &&
+			!pipeline->complete (item->status, item->data, item->size, item->fingerprint, item->fsize, pipeline->userdata)) {
+			dc_mutex_lock (&pipeline->mutex);
+			pipeline->stopped = 1;
+			dc_mutex_unlock (&pipeline->mutex);
+		}
+
+		dc_parser_destroy (item->parser);
+		dc_divebuf_release (item->dive);
+		memset (item, 0, sizeof (*item));
+
+		// Release the slot.
+		dc_mutex_lock (&pipeline->mutex);
+		pipeline->head++;
+		dc_cond_signal (&pipeline->notfull);
+		dc_mutex_unlock (&pipeline->mutex);
+	}
+
+	dc_mutex_unlock (&pipeline->completion);
+}
+
+static void
+dc_pipeline_worker (void *userdata)
+{
+	dc_pipeline_t *pipeline = (dc_pipeline_t *) userdata;
+
+	dc_mutex_lock (&pipeline->mutex);
+	while (1) {
+		// Wait for a dive.
+		while (pipeline->next == pipeline->tail && !pipeline->finished)
+			dc_cond_wait (&pipeline->notempty, &pipeline->mutex);
+
+		// Exit once all dives are taken.
+		if (pipeline->next == pipeline->tail)
+			break;
+
+		dc_pipeline_item_t *item = pipeline->items + pipeline->next % pipeline->depth;
+		pipeline->next++;
+		dc_mutex_unlock (&pipeline->mutex);
+
+		// Parse the dive.
+		dc_status_t status = item->status;
+		if (status == DC_STATUS_SUCCESS) {
+			status = dc_parser_set_data (item->parser, item->data, item->size);
+			if (status == DC_STATUS_SUCCESS) {
+				status = pipeline->parse (item->parser, item->data, item->size, item->fingerprint, item->fsize, pipeline->userdata);
+			}
+		}
+
+		dc_mutex_lock (&pipeline->mutex);
+		item->status = status;
+		item->done = 1;
+		dc_mutex_unlock (&pipeline->mutex);
+
+		dc_pipeline_complete (pipeline);
+
+		dc_mutex_lock (&pipeline->mutex);
+	}
+	dc_mutex_unlock (&pipeline->mutex);
+}
+
+static int
+dc_pipeline_dive_cb (dc_divebuf_t *dive, void *userdata)
+{
+	dc_pipeline_t *pipeline = (dc_pipeline_t *) userdata;
+
+	// Wait for a free slot.
+	dc_mutex_lock (&pipeline->mutex);
+	while (pipeline->tail - pipeline->head == pipeline->depth && !pipeline->stopped)
+		dc_cond_wait (&pipeline->notfull, &pipeline->mutex);
+	unsigned int stopped = pipeline->stopped;
+	dc_mutex_unlock (&pipeline->mutex);
+
+	if (stopped)
+		return 0;
+
+	// The free slot is owned by the download thread, until it's queued.
+	dc_pipeline_item_t *item = pipeline->items + pipeline->tail % pipeline->depth;
+
+	// Retain the dive, because the data is only valid until the callback
+	// returns. Dives that are part of a larger memory image are shared
+	// with the backend instead of copied.
+	item->dive = dc_divebuf_retain (dive);
+	if (item->dive == NULL) {
+		ERROR (pipeline->device->context, "Failed to allocate memory.");
+		pipeline->status = DC_STATUS_NOMEMORY;
+		return 0;
+	}
+
+	item->data = dc_divebuf_get_data (item->dive);
+	item->size = dc_divebuf_get_size (item->dive);
+	item->fingerprint = dc_divebuf_get_fingerprint (item->dive, &item->fsize);
+	item->done = 0;
+
+	// The parser is created here, because it needs the device info that
+	// is only valid on the download thread. A failure is reported
+	// through the completion callback.
+	item->status = dc_parser_new (&item->parser, pipeline->device);
+	if (item->status != DC_STATUS_SUCCESS)
+		item->parser = NULL;
+
+	// Hand the dive to the worker threads.
+	dc_mutex_lock (&pipeline->mutex);
+	pipeline->tail++;
+	dc_cond_signal (&pipeline->notempty);
+	dc_mutex_unlock (&pipeline->mutex);
+
+	return 1;
+}
+
+dc_status_t
+dc_device_foreach_pipelined (dc_device_t *device, unsigned int nthreads, unsigned int depth, dc_dive_parse_callback_t parse, dc_dive_complete_callback_t complete, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_pipeline_t pipeline;
+	dc_thread_t *threads = NULL;
+	unsigned int nstarted = 0;
+
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (nthreads == 0 || depth == 0 || parse == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	memset (&pipeline, 0, sizeof (pipeline));
+	pipeline.device = device;
+	pipeline.parse = parse;
+	pipeline.complete = complete;
+	pipeline.userdata = userdata;
+	pipeline.depth = depth;
+	pipeline.status = DC_STATUS_SUCCESS;
+
+	// Allocate memory.
+	pipeline.items = (dc_pipeline_item_t *) calloc (depth, sizeof (dc_pipeline_item_t));
+	threads = (dc_thread_t *) malloc (nthreads * sizeof (dc_thread_t));
+	if (pipeline.items == NULL || threads == NULL) {
+		ERROR (device->context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_free;
+	}
+
+	status = dc_mutex_init (&pipeline.mutex);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (device->context, "Failed to create the mutex.");
+		goto error_free;
+	}
+
+	status = dc_mutex_init (&pipeline.completion);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (device->context, "Failed to create the mutex.");
+		goto error_mutex_free;
+	}
+
+	status = dc_cond_init (&pipeline.notempty);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (device->context, "Failed to create the condition variable.");
+		goto error_completion_free;
+	}
+
+	status = dc_cond_init (&pipeline.notfull);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (device->context, "Failed to create the condition variable.");
+		goto error_notempty_free;
+	}
+
+	// Start the worker threads.
+	for (nstarted = 0; nstarted < nthreads; ++nstarted) {
+		status = dc_thread_create (threads + nstarted, dc_pipeline_worker, &pipeline);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (device->context, "Failed to create the worker thread.");
+			break;
+		}
+	}
+
+	// Download the dives.
+	if (status == DC_STATUS_SUCCESS) {
+		status = dc_device_foreach_divebuf (device, dc_pipeline_dive_cb, &pipeline);
+		if (status == DC_STATUS_SUCCESS)
+			status = pipeline.status;
+	}
+
+	// Wait until all queued dives are completed.
+	dc_mutex_lock (&pipeline.mutex);
+	pipeline.finished = 1;
+	dc_cond_broadcast (&pipeline.notempty);
+	dc_mutex_unlock (&pipeline.mutex);
+
+	for (unsigned int i = 0; i < nstarted; ++i) {
+		dc_thread_join (threads + i);
+	}
+
+	dc_cond_free (&pipeline.notfull);
+error_notempty_free:
+	dc_cond_free (&pipeline.notempty);
+error_completion_free:
+	dc_mutex_free (&pipeline.completion);
+error_mutex_free:
+	dc_mutex_free (&pipeline.mutex);
+error_free:
+	free (threads);
+	free (pipeline.items);
+	return status;
+}
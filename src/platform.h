@@ -43,6 +43,11 @@ extern "C" {
 // zero vs to even). But for our use-case, that's not a problem.
 #define rint(x) ((x) >= 0.0 ? floor((x) + 0.5): ceil((x) - 0.5))
 #endif
+#if _MSC_VER < 1900 && !defined(__cplusplus)
+// The inline keyword is only available in C mode in MSVC 2015 and later
+// versions.
+#define inline __inline
+#endif
 #endif
 
 #ifdef __cplusplus
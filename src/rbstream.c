@@ -35,7 +35,9 @@ struct dc_rbstream_t {
 	unsigned int address;
 	unsigned int available;
 	unsigned int skip;
-	unsigned char cache[];
+	unsigned int readahead;
+	unsigned int remaining;
+	unsigned char *cache;
 };
 
 static unsigned int
@@ -85,12 +87,19 @@ dc_rbstream_new (dc_rbstream_t **out, dc_device_t *device, unsigned int pagesize
 	}
 
 	// Allocate memory.
-	rbstream = (dc_rbstream_t *) malloc (sizeof(*rbstream) + packetsize);
+	rbstream = (dc_rbstream_t *) malloc (sizeof(*rbstream));
 	if (rbstream == NULL) {
 		ERROR (device->context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
 	}
 
+	rbstream->cache = (unsigned char *) malloc (packetsize);
+	if (rbstream->cache == NULL) {
+		ERROR (device->context, "Failed to allocate memory.");
+		free (rbstream);
+		return DC_STATUS_NOMEMORY;
+	}
+
 	rbstream->device = device;
 	rbstream->pagesize = pagesize;
 	rbstream->packetsize = packetsize;
@@ -99,12 +108,45 @@ dc_rbstream_new (dc_rbstream_t **out, dc_device_t *device, unsigned int pagesize
 	rbstream->address = iceil(address, pagesize);
 	rbstream->available = 0;
 	rbstream->skip = rbstream->address - address;
+	rbstream->readahead = 1;
+	rbstream->remaining = 0;
 
 	*out = rbstream;
 
 	return DC_STATUS_SUCCESS;
 }
 
+dc_status_t
+dc_rbstream_set_readahead (dc_rbstream_t *rbstream, unsigned int npackets, unsigned int size)
+{
+	if (rbstream == NULL || npackets == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	// Never read ahead more than the entire ringbuffer.
+	unsigned int maximum = iceil (rbstream->end - rbstream->begin, rbstream->packetsize) / rbstream->packetsize;
+	if (maximum == 0)
+		maximum = 1;
+	if (npackets > maximum)
+		npackets = maximum;
+
+	// Grow the cache. Any data that is still available in the cache is
+	// preserved by the reallocation.
+	if (npackets > rbstream->readahead) {
+		unsigned char *cache = (unsigned char *) realloc (rbstream->cache, npackets * rbstream->packetsize);
+		if (cache == NULL) {
+			ERROR (rbstream->device->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+
+		rbstream->cache = cache;
+	}
+
+	rbstream->readahead = npackets;
+	rbstream->remaining = size;
+
+	return DC_STATUS_SUCCESS;
+}
+
 dc_status_t
 dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsigned char data[], unsigned int size)
 {
@@ -116,6 +158,7 @@ dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsign
 	unsigned int address = rbstream->address;
 	unsigned int available = rbstream->available;
 	unsigned int skip = rbstream->skip;
+	unsigned int remaining = rbstream->remaining;
 
 	unsigned int nbytes = 0;
 	unsigned int offset = size;
@@ -125,16 +168,31 @@ dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsign
 			if (address == rbstream->begin)
 				address = rbstream->end;
 
+			// Calculate the number of packets to read at once. In
+			// read-ahead mode, as many packets are requested as needed
+			// for the remaining data, up to the size of the cache.
+			unsigned int npackets = 1;
+			if (rbstream->readahead > 1) {
+				unsigned int needed = size - nbytes;
+				if (needed < remaining)
+					needed = remaining;
+				npackets = iceil (needed + skip, rbstream->packetsize) / rbstream->packetsize;
+				if (npackets > rbstream->readahead)
+					npackets = rbstream->readahead;
+				if (npackets == 0)
+					npackets = 1;
+			}
+
 			// Calculate the packet size.
-			unsigned int len = rbstream->packetsize;
+			unsigned int len = rbstream->packetsize * npackets;
 			if (rbstream->begin + len > address)
 				len = address - rbstream->begin;
 
 			// Move to the begin of the current packet.
 			address -= len;
 
-			// Read the packet into the cache.
-			rc = dc_device_read (rbstream->device, address, rbstream->cache, rbstream->packetsize);
+			// Read the packet(s) into the cache.
+			rc = dc_device_read (rbstream->device, address, rbstream->cache, iceil (len, rbstream->packetsize));
 			if (rc != DC_STATUS_SUCCESS)
 				return rc;
 
@@ -160,9 +218,15 @@ dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsign
 		nbytes += length;
 	}
 
+	if (remaining > size)
+		remaining -= size;
+	else
+		remaining = 0;
+
 	rbstream->address = address;
 	rbstream->available = available;
 	rbstream->skip = skip;
+	rbstream->remaining = remaining;
 
 	return rc;
 }
@@ -170,6 +234,10 @@ dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsign
 dc_status_t
 dc_rbstream_free (dc_rbstream_t *rbstream)
 {
+	if (rbstream == NULL)
+		return DC_STATUS_SUCCESS;
+
+	free (rbstream->cache);
 	free (rbstream);
 
 	return DC_STATUS_SUCCESS;
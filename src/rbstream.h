@@ -49,6 +49,25 @@ typedef struct dc_rbstream_t dc_rbstream_t;
 dc_status_t
 dc_rbstream_new (dc_rbstream_t **rbstream, dc_device_t *device, unsigned int pagesize, unsigned int packetsize, unsigned int begin, unsigned int end, unsigned int address);
 
+/**
+ * Enable the read-ahead mode of the ringbuffer stream.
+ *
+ * In read-ahead mode, multiple packets are requested from the device
+ * with a single read operation, instead of one packet at a time. To
+ * avoid transferring more data than necessary, the number of packets
+ * is limited by the total amount of data that will be read from the
+ * stream. Read-ahead is disabled again by setting the number of packets
+ * to one.
+ *
+ * @param[in]  rbstream  A valid ringbuffer stream.
+ * @param[in]  npackets  The maximum number of packets to read at once.
+ * @param[in]  size      The total number of bytes that will be read.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_rbstream_set_readahead (dc_rbstream_t *rbstream, unsigned int npackets, unsigned int size);
+
 /**
  * Read data from the ringbuffer stream.
  *
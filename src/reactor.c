@@ -0,0 +1,580 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2018 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h> // malloc, free
+#include <errno.h>	// errno
+
+#ifdef HAVE_SYS_EPOLL_H
+#define REACTOR
+#include <unistd.h>	// close
+#include <sys/epoll.h>
+#endif
+
+#include <libdivecomputer/reactor.h>
+
+#include "context-private.h"
+#include "iostream-private.h"
+#include "serial.h"
+#include "timer.h"
+
+#define MAXEVENTS 32
+
+#define INFINITE ((dc_usecs_t) -1)
+
+#ifdef REACTOR
+// Error and hangup conditions are always reported by epoll, even without
+// any events enabled. Idle streams are therefore registered in one-shot
+// mode, to report such a condition only once.
+#define IDLE EPOLLONESHOT
+#endif
+
+typedef enum dc_reactor_op_t {
+	DC_REACTOR_NONE,
+	DC_REACTOR_READ,
+	DC_REACTOR_WRITE,
+} dc_reactor_op_t;
+
+typedef struct dc_reactor_entry_t {
+	struct dc_reactor_entry_t *next;
+	dc_iostream_t *iostream;
+	int fd;
+	// The events registered with epoll.
+	unsigned int events;
+	unsigned int removed;
+	unsigned int expired;
+	unsigned int buffered;
+	// The pending operation.
+	dc_reactor_op_t op;
+	unsigned char *data;
+	size_t size;
+	size_t nbytes;
+	dc_usecs_t deadline;
+	dc_reactor_callback_t callback;
+	void *userdata;
+} dc_reactor_entry_t;
+
+struct dc_reactor_t {
+	dc_context_t *context;
+	int fd;
+	dc_timer_t *timer;
+	dc_reactor_entry_t *entries;
+	// Entries that are removed while the events are dispatched. They
+	// are released once the dispatching is finished.
+	dc_reactor_entry_t *removed;
+	unsigned int npending;
+	unsigned int dispatching;
+};
+
+#ifdef REACTOR
+static dc_reactor_entry_t *
+dc_reactor_lookup (dc_reactor_t *reactor, dc_iostream_t *iostream)
+{
+	dc_reactor_entry_t *entry = reactor->entries;
+	while (entry) {
+		if (entry->iostream == iostream)
+			return entry;
+		entry = entry->next;
+	}
+
+	return NULL;
+}
+
+static dc_status_t
+dc_reactor_update (dc_reactor_t *reactor, dc_reactor_entry_t *entry, unsigned int events)
+{
+	// The file descriptor remains registered with the previous events
+	// until they are changed, which saves a system call when the same
+	// type of operation is queued again.
+	if (entry->events == events)
+		return DC_STATUS_SUCCESS;
+
+	struct epoll_event ev;
+	ev.events = events;
+	ev.data.ptr = entry;
+	if (epoll_ctl (reactor->fd, EPOLL_CTL_MOD, entry->fd, &ev) != 0) {
+		int errcode = errno;
+		SYSERROR (reactor->context, errcode);
+		return DC_STATUS_IO;
+	}
+
+	entry->events = events;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+dc_reactor_complete (dc_reactor_t *reactor, dc_reactor_entry_t *entry, dc_status_t status)
+{
+	dc_reactor_callback_t callback = entry->callback;
+	void *userdata = entry->userdata;
+
+	// The operation is finished before invoking the callback, such that
+	// a new operation can be queued from inside the callback.
+	entry->op = DC_REACTOR_NONE;
+	entry->expired = 0;
+	entry->callback = NULL;
+	entry->userdata = NULL;
+	reactor->npending--;
+
+	if (callback)
+		callback (entry->iostream, status, entry->nbytes, userdata);
+}
+
+static void
+dc_reactor_transfer (dc_reactor_t *reactor, dc_reactor_entry_t *entry, unsigned int events)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	size_t nbytes = 0;
+
+	if (entry->op == DC_REACTOR_READ) {
+		status = dc_iostream_read (entry->iostream, entry->data + entry->nbytes, entry->size - entry->nbytes, &nbytes);
+	} else {
+		status = dc_iostream_write (entry->iostream, entry->data + entry->nbytes, entry->size - entry->nbytes, &nbytes);
+	}
+
+	entry->nbytes += nbytes;
+
+	if (status == DC_STATUS_TIMEOUT) {
+		// Wait for more data, unless the connection is broken.
+		if (nbytes || !(events & (EPOLLERR | EPOLLHUP)))
+			return;
+		status = DC_STATUS_IO;
+	}
+
+	dc_reactor_complete (reactor, entry, status);
+}
+
+static dc_status_t
+dc_reactor_queue (dc_reactor_t *reactor, dc_iostream_t *iostream, dc_reactor_op_t op, void *data, size_t size, int timeout, dc_reactor_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (reactor == NULL || iostream == NULL || (data == NULL && size))
+		return DC_STATUS_INVALIDARGS;
+
+	dc_reactor_entry_t *entry = dc_reactor_lookup (reactor, iostream);
+	if (entry == NULL || entry->op != DC_REACTOR_NONE)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_usecs_t deadline = INFINITE;
+	if (timeout >= 0) {
+		dc_usecs_t now = 0;
+		status = dc_timer_now (reactor->timer, &now);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+		deadline = now + (dc_usecs_t) timeout * 1000;
+	}
+
+	status = dc_reactor_update (reactor, entry, op == DC_REACTOR_READ ? EPOLLIN : EPOLLOUT);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	entry->op = op;
+	entry->data = (unsigned char *) data;
+	entry->size = size;
+	entry->nbytes = 0;
+	entry->deadline = deadline;
+	entry->expired = 0;
+	entry->callback = callback;
+	entry->userdata = userdata;
+	reactor->npending++;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static int
+dc_reactor_timeout (dc_reactor_t *reactor, dc_usecs_t now)
+{
+	dc_usecs_t deadline = INFINITE;
+
+	dc_reactor_entry_t *entry = reactor->entries;
+	while (entry) {
+		if (entry->op != DC_REACTOR_NONE && entry->deadline < deadline)
+			deadline = entry->deadline;
+		entry = entry->next;
+	}
+
+	if (deadline == INFINITE)
+		return -1;
+
+	if (deadline <= now)
+		return 0;
+
+	// Round up, to avoid waking up just before the deadline.
+	dc_usecs_t timeout = (deadline - now + 999) / 1000;
+	if (timeout > 0x7FFFFFFF)
+		timeout = 0x7FFFFFFF;
+
+	return (int) timeout;
+}
+
+static unsigned int
+dc_reactor_poll_buffered (dc_reactor_t *reactor)
+{
+	unsigned int count = 0;
+
+	// Data that is already in the receive buffer of the I/O stream is
+	// not reported by epoll, so the pending reads need to check for it
+	// before waiting on the file descriptor.
+	dc_reactor_entry_t *entry = reactor->entries;
+	while (entry) {
+		size_t available = 0;
+		if (entry->op == DC_REACTOR_READ &&
+			dc_iostream_get_available (entry->iostream, &available) == DC_STATUS_SUCCESS &&
+			available) {
+			entry->buffered = 1;
+			count++;
+		}
+		entry = entry->next;
+	}
+
+	return count;
+}
+
+static void
+dc_reactor_transfer_buffered (dc_reactor_t *reactor)
+{
+	// The list can be modified by the callbacks, so the search restarts
+	// after every transfer.
+	dc_reactor_entry_t *entry = reactor->entries;
+	while (entry) {
+		if (entry->buffered) {
+			entry->buffered = 0;
+			if (entry->op == DC_REACTOR_READ)
+				dc_reactor_transfer (reactor, entry, 0);
+			entry = reactor->entries;
+			continue;
+		}
+		entry = entry->next;
+	}
+}
+
+static void
+dc_reactor_expire (dc_reactor_t *reactor, dc_usecs_t now)
+{
+	// Mark the expired operations first. The callbacks can queue new
+	// operations, which should not expire before they are polled.
+	dc_reactor_entry_t *entry = reactor->entries;
+	while (entry) {
+		if (entry->op != DC_REACTOR_NONE && entry->deadline <= now)
+			entry->expired = 1;
+		entry = entry->next;
+	}
+
+	// The list can be modified by the callbacks, so the search restarts
+	// after every completion.
+	entry = reactor->entries;
+	while (entry) {
+		if (entry->expired) {
+			dc_reactor_complete (reactor, entry, DC_STATUS_TIMEOUT);
+			entry = reactor->entries;
+			continue;
+		}
+		entry = entry->next;
+	}
+}
+#endif
+
+dc_status_t
+dc_reactor_new (dc_reactor_t **out, dc_context_t *context)
+{
+#ifdef REACTOR
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_reactor_t *reactor = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Allocate memory.
+	reactor = (dc_reactor_t *) malloc (sizeof (dc_reactor_t));
+	if (reactor == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	reactor->context = context;
+	reactor->entries = NULL;
+	reactor->removed = NULL;
+	reactor->npending = 0;
+	reactor->dispatching = 0;
+
+	// Create a high resolution timer.
+	status = dc_timer_new (&reactor->timer);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create a high resolution timer.");
+		goto error_free;
+	}
+
+	reactor->fd = epoll_create1 (EPOLL_CLOEXEC);
+	if (reactor->fd == -1) {
+		int errcode = errno;
+		SYSERROR (context, errcode);
+		status = DC_STATUS_IO;
+		goto error_timer_free;
+	}
+
+	*out = reactor;
+
+	return DC_STATUS_SUCCESS;
+
+error_timer_free:
+	dc_timer_free (reactor->timer);
+error_free:
+	free (reactor);
+	return status;
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+dc_status_t
+dc_reactor_add (dc_reactor_t *reactor, dc_iostream_t *iostream)
+{
+#ifdef REACTOR
+	dc_status_t status = DC_STATUS_SUCCESS;
+	int fd = -1;
+
+	if (reactor == NULL || iostream == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (dc_reactor_lookup (reactor, iostream) != NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	status = dc_serial_get_fd (iostream, &fd);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	dc_reactor_entry_t *entry = (dc_reactor_entry_t *) malloc (sizeof (dc_reactor_entry_t));
+	if (entry == NULL) {
+		ERROR (reactor->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	entry->iostream = iostream;
+	entry->fd = fd;
+	entry->events = IDLE;
+	entry->removed = 0;
+	entry->expired = 0;
+	entry->buffered = 0;
+	entry->op = DC_REACTOR_NONE;
+	entry->data = NULL;
+	entry->size = 0;
+	entry->nbytes = 0;
+	entry->deadline = INFINITE;
+	entry->callback = NULL;
+	entry->userdata = NULL;
+
+	// Register the file descriptor without any events. The events are
+	// enabled once an operation is queued.
+	struct epoll_event ev;
+	ev.events = IDLE;
+	ev.data.ptr = entry;
+	if (epoll_ctl (reactor->fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+		int errcode = errno;
+		SYSERROR (reactor->context, errcode);
+		free (entry);
+		return DC_STATUS_IO;
+	}
+
+	dc_serial_set_nonblocking (iostream, 1);
+
+	entry->next = reactor->entries;
+	reactor->entries = entry;
+
+	return DC_STATUS_SUCCESS;
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+dc_status_t
+dc_reactor_remove (dc_reactor_t *reactor, dc_iostream_t *iostream)
+{
+#ifdef REACTOR
+	if (reactor == NULL || iostream == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Unlink the entry.
+	dc_reactor_entry_t **link = &reactor->entries;
+	while (*link && (*link)->iostream != iostream)
+		link = &(*link)->next;
+
+	dc_reactor_entry_t *entry = *link;
+	if (entry == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	*link = entry->next;
+
+	if (epoll_ctl (reactor->fd, EPOLL_CTL_DEL, entry->fd, NULL) != 0) {
+		int errcode = errno;
+		SYSERROR (reactor->context, errcode);
+	}
+
+	dc_serial_set_nonblocking (iostream, 0);
+
+	if (entry->op != DC_REACTOR_NONE) {
+		dc_reactor_complete (reactor, entry, DC_STATUS_CANCELLED);
+	}
+
+	// Events for this entry may still be waiting to be dispatched.
+	if (reactor->dispatching) {
+		entry->removed = 1;
+		entry->next = reactor->removed;
+		reactor->removed = entry;
+	} else {
+		free (entry);
+	}
+
+	return DC_STATUS_SUCCESS;
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+dc_status_t
+dc_reactor_read (dc_reactor_t *reactor, dc_iostream_t *iostream, void *data, size_t size, int timeout, dc_reactor_callback_t callback, void *userdata)
+{
+#ifdef REACTOR
+	return dc_reactor_queue (reactor, iostream, DC_REACTOR_READ, data, size, timeout, callback, userdata);
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+dc_status_t
+dc_reactor_write (dc_reactor_t *reactor, dc_iostream_t *iostream, const void *data, size_t size, int timeout, dc_reactor_callback_t callback, void *userdata)
+{
+#ifdef REACTOR
+	return dc_reactor_queue (reactor, iostream, DC_REACTOR_WRITE, (void *) data, size, timeout, callback, userdata);
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+dc_status_t
+dc_reactor_run (dc_reactor_t *reactor)
+{
+#ifdef REACTOR
+	dc_status_t status = DC_STATUS_SUCCESS;
+	struct epoll_event events[MAXEVENTS];
+
+	if (reactor == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (reactor->dispatching)
+		return DC_STATUS_INVALIDARGS;
+
+	while (reactor->npending) {
+		dc_usecs_t now = 0;
+		status = dc_timer_now (reactor->timer, &now);
+		if (status != DC_STATUS_SUCCESS)
+			break;
+
+		// Wait until the nearest deadline, unless there is buffered data.
+		int timeout = 0;
+		if (dc_reactor_poll_buffered (reactor) == 0)
+			timeout = dc_reactor_timeout (reactor, now);
+
+		int n = epoll_wait (reactor->fd, events, MAXEVENTS, timeout);
+		if (n < 0) {
+			int errcode = errno;
+			if (errcode == EINTR)
+				continue; // Retry.
+			SYSERROR (reactor->context, errcode);
+			status = DC_STATUS_IO;
+			break;
+		}
+
+		reactor->dispatching = 1;
+
+		for (int i = 0; i < n; ++i) {
+			dc_reactor_entry_t *entry = (dc_reactor_entry_t *) events[i].data.ptr;
+			if (entry->removed)
+				continue;
+
+			if (entry->op == DC_REACTOR_NONE) {
+				// Stop polling an idle stream.
+				dc_reactor_update (reactor, entry, IDLE);
+				continue;
+			}
+
+			dc_reactor_transfer (reactor, entry, events[i].events);
+		}
+
+		dc_reactor_transfer_buffered (reactor);
+
+		status = dc_timer_now (reactor->timer, &now);
+		if (status == DC_STATUS_SUCCESS)
+			dc_reactor_expire (reactor, now);
+
+		reactor->dispatching = 0;
+
+		// Release the entries that were removed by the callbacks.
+		while (reactor->removed) {
+			dc_reactor_entry_t *entry = reactor->removed;
+			reactor->removed = entry->next;
+			free (entry);
+		}
+
+		if (status != DC_STATUS_SUCCESS)
+			break;
+	}
+
+	return status;
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+dc_status_t
+dc_reactor_free (dc_reactor_t *reactor)
+{
+#ifdef REACTOR
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (reactor == NULL)
+		return DC_STATUS_SUCCESS;
+
+	while (reactor->entries) {
+		dc_reactor_entry_t *entry = reactor->entries;
+		reactor->entries = entry->next;
+		dc_serial_set_nonblocking (entry->iostream, 0);
+		free (entry);
+	}
+
+	if (close (reactor->fd) != 0) {
+		int errcode = errno;
+		SYSERROR (reactor->context, errcode);
+		status = DC_STATUS_IO;
+	}
+
+	dc_timer_free (reactor->timer);
+	free (reactor);
+
+	return status;
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
@@ -100,6 +100,8 @@ reefnet_sensusultra_device_open (dc_device_t **out, dc_context_t *context, const
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -325,6 +327,8 @@ reefnet_sensusultra_page (reefnet_sensusultra_device_t *device, unsigned char *d
 		if (nretries++ >= MAXRETRIES)
 			return rc;
 
+		device_stats_retry ((dc_device_t *) device);
+
 		// Reject the packet.
 		rc = reefnet_sensusultra_send_uchar (device, REJECT);
 		if (rc != DC_STATUS_SUCCESS)
@@ -361,6 +365,8 @@ reefnet_sensusultra_send (reefnet_sensusultra_device_t *device, unsigned short c
 		if (nretries++ >= MAXRETRIES)
 			return rc;
 
+		device_stats_retry ((dc_device_t *) device);
+
 		// According to the developers guide, a 250 ms delay is suggested to
 		// guarantee that the prompt byte sent after the handshake packet is
 		// not accidentally buffered by the host and (mis)interpreted as part
@@ -428,6 +428,8 @@ scubapro_g2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback,
 		return rc;
 	}
 
+	device_image_set_memory (abstract, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+
 	rc = scubapro_g2_extract_dives (abstract,
 		dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), callback, userdata);
 
@@ -19,14 +19,15 @@
  * MA 02110-1301 USA
  */
 
-#ifndef DC_SERIAL_H
-#define DC_SERIAL_H
+#ifndef SERIAL_H
+#define SERIAL_H
 
 #include <libdivecomputer/common.h>
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/iostream.h>
 #include <libdivecomputer/iterator.h>
 #include <libdivecomputer/descriptor.h>
+#include <libdivecomputer/serial.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -65,19 +66,36 @@ dc_serial_device_free (dc_serial_device_t *device);
 dc_status_t
 dc_serial_iterator_new (dc_iterator_t **iterator, dc_context_t *context, dc_descriptor_t *descriptor);
 
+#ifndef _WIN32
 /**
- * Open a serial connection.
+ * Enable or disable the non-blocking mode.
  *
- * @param[out]  iostream A location to store the serial connection.
- * @param[in]   context  A valid context object.
- * @param[in]   name     The name of the device node.
+ * In non-blocking mode, the read and write functions transfer as much
+ * data as possible without waiting, and return #DC_STATUS_TIMEOUT if
+ * not all data could be transferred. The timeout setting is ignored,
+ * and writes do not wait until the data has been transmitted.
+ *
+ * @param[in]  iostream  A valid serial connection.
+ * @param[in]  value     Non-zero to enable the non-blocking mode.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_serial_set_nonblocking (dc_iostream_t *iostream, unsigned int value);
+
+/**
+ * Get the file descriptor of the serial connection.
+ *
+ * @param[in]  iostream  A valid serial connection.
+ * @param[out] fd        A location to store the file descriptor.
  * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
  * on failure.
  */
 dc_status_t
-dc_serial_open (dc_iostream_t **iostream, dc_context_t *context, const char *name);
+dc_serial_get_fd (dc_iostream_t *iostream, int *fd);
+#endif
 
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
-#endif /* DC_SERIAL_H */
+#endif /* SERIAL_H */
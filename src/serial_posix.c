@@ -30,6 +30,8 @@
 #include <fcntl.h>	// fcntl
 #include <termios.h>	// tcgetattr, tcsetattr, cfsetispeed, cfsetospeed, tcflush, tcsendbreak
 #include <sys/ioctl.h>	// ioctl
+#include <sys/uio.h>	// writev
+#include <limits.h>	// IOV_MAX
 #include <time.h>	// nanosleep
 #ifdef HAVE_LINUX_SERIAL_H
 #include <linux/serial.h>
@@ -63,6 +65,14 @@
 
 #define DIRNAME "/dev"
 
+#if defined(IOV_MAX) && IOV_MAX < 64
+#define MAXIOV IOV_MAX
+#else
+#define MAXIOV 64
+#endif
+
+#define ISINSTANCE(device) dc_iostream_isinstance((device), &dc_serial_vtable)
+
 static dc_status_t dc_serial_iterator_next (dc_iterator_t *iterator, void *item);
 static dc_status_t dc_serial_iterator_free (dc_iterator_t *iterator);
 
@@ -76,6 +86,7 @@ static dc_status_t dc_serial_get_available (dc_iostream_t *iostream, size_t *val
 static dc_status_t dc_serial_configure (dc_iostream_t *iostream, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
 static dc_status_t dc_serial_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actual);
 static dc_status_t dc_serial_write (dc_iostream_t *iostream, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_serial_writev (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual);
 static dc_status_t dc_serial_flush (dc_iostream_t *iostream);
 static dc_status_t dc_serial_purge (dc_iostream_t *iostream, dc_direction_t direction);
 static dc_status_t dc_serial_sleep (dc_iostream_t *iostream, unsigned int milliseconds);
@@ -98,6 +109,7 @@ typedef struct dc_serial_t {
 	 */
 	int fd;
 	int timeout;
+	unsigned int nonblocking;
 	dc_timer_t *timer;
 	/*
 	 * Serial port settings are saved into this variable immediately
@@ -125,6 +137,7 @@ static const dc_iostream_vtable_t dc_serial_vtable = {
 	dc_serial_configure, /* configure */
 	dc_serial_read, /* read */
 	dc_serial_write, /* write */
+	dc_serial_writev, /* writev */
 	dc_serial_flush, /* flush */
 	dc_serial_purge, /* purge */
 	dc_serial_sleep, /* sleep */
@@ -283,6 +296,7 @@ dc_serial_open (dc_iostream_t **out, dc_context_t *context, const char *name)
 
 	// Default to blocking reads.
 	device->timeout = -1;
+	device->nonblocking = 0;
 
 	// Create a high resolution timer.
 	status = dc_timer_new (&device->timer);
@@ -667,6 +681,79 @@ dc_serial_set_latency (dc_iostream_t *abstract, unsigned int milliseconds)
 	return DC_STATUS_SUCCESS;
 }
 
+dc_status_t
+dc_serial_set_nonblocking (dc_iostream_t *abstract, unsigned int value)
+{
+	dc_serial_t *device = (dc_serial_t *) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_UNSUPPORTED;
+
+	device->nonblocking = value;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_serial_get_fd (dc_iostream_t *abstract, int *fd)
+{
+	dc_serial_t *device = (dc_serial_t *) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_UNSUPPORTED;
+
+	if (fd == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	*fd = device->fd;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_transfer_nonblocking (dc_iostream_t *abstract, void *data, size_t size, size_t *actual, int output)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_serial_t *device = (dc_serial_t *) abstract;
+	size_t nbytes = 0;
+
+	// The file descriptor is opened with O_NONBLOCK, so the data can be
+	// transferred directly, without waiting for the port to become ready
+	// first. The transfer stops as soon as the port would block.
+	while (nbytes < size) {
+		ssize_t n = 0;
+		if (output) {
+			n = write (device->fd, (const char *) data + nbytes, size - nbytes);
+		} else {
+			n = read (device->fd, (char *) data + nbytes, size - nbytes);
+		}
+		if (n < 0) {
+			int errcode = errno;
+			if (errcode == EINTR)
+				continue; // Retry.
+			if (errcode == EAGAIN || errcode == EWOULDBLOCK)
+				break; // Would block.
+			SYSERROR (abstract->context, errcode);
+			status = syserror (errcode);
+			goto out;
+		} else if (n == 0) {
+			break; // EOF.
+		}
+
+		nbytes += n;
+	}
+
+	if (nbytes != size) {
+		status = DC_STATUS_TIMEOUT;
+	}
+
+out:
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
 static dc_status_t
 dc_serial_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
 {
@@ -674,6 +761,9 @@ dc_serial_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual
 	dc_serial_t *device = (dc_serial_t *) abstract;
 	size_t nbytes = 0;
 
+	if (device->nonblocking)
+		return dc_serial_transfer_nonblocking (abstract, data, size, actual, 0);
+
 	// The absolute target time.
 	dc_usecs_t target = 0;
 
@@ -754,6 +844,27 @@ out:
 	return status;
 }
 
+static dc_status_t
+dc_serial_drain (dc_iostream_t *abstract)
+{
+	dc_serial_t *device = (dc_serial_t *) abstract;
+
+#ifdef __ANDROID__
+	/* Android is missing tcdrain, so use ioctl version instead */
+	while (ioctl (device->fd, TCSBRK, 1) != 0) {
+#else
+	while (tcdrain (device->fd) != 0) {
+#endif
+		int errcode = errno;
+		if (errcode != EINTR ) {
+			SYSERROR (abstract->context, errcode);
+			return syserror (errcode);
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 dc_serial_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual)
 {
@@ -761,6 +872,10 @@ dc_serial_write (dc_iostream_t *abstract, const void *data, size_t size, size_t
 	dc_serial_t *device = (dc_serial_t *) abstract;
 	size_t nbytes = 0;
 
+	// In non-blocking mode, the data is only queued for transmission.
+	if (device->nonblocking)
+		return dc_serial_transfer_nonblocking (abstract, (void *) data, size, actual, 1);
+
 	while (nbytes < size) {
 		fd_set fds;
 		FD_ZERO (&fds);
@@ -794,20 +909,90 @@ dc_serial_write (dc_iostream_t *abstract, const void *data, size_t size, size_t
 	}
 
 	// Wait until all data has been transmitted.
-#ifdef __ANDROID__
-	/* Android is missing tcdrain, so use ioctl version instead */
-	while (ioctl (device->fd, TCSBRK, 1) != 0) {
-#else
-	while (tcdrain (device->fd) != 0) {
-#endif
-		int errcode = errno;
-		if (errcode != EINTR ) {
+	status = dc_serial_drain (abstract);
+
+out:
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_serial_writev (dc_iostream_t *abstract, const dc_iovec_t iov[], size_t count, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_serial_t *device = (dc_serial_t *) abstract;
+	size_t nbytes = 0, size = 0;
+
+	for (size_t i = 0; i < count; ++i) {
+		size += iov[i].size;
+	}
+
+	// Skip the empty buffers at the start.
+	size_t index = 0, offset = 0;
+	dc_iovec_advance (iov, count, &index, &offset, 0);
+
+	while (index < count) {
+		if (!device->nonblocking) {
+			fd_set fds;
+			FD_ZERO (&fds);
+			FD_SET (device->fd, &fds);
+
+			int rc = select (device->fd + 1, NULL, &fds, NULL, NULL);
+			if (rc < 0) {
+				int errcode = errno;
+				if (errcode == EINTR)
+					continue; // Retry.
+				SYSERROR (abstract->context, errcode);
+				status = syserror (errcode);
+				goto out;
+			} else if (rc == 0) {
+				break; // Timeout.
+			}
+		}
+
+		// Resume at the current position.
+		struct iovec vec[MAXIOV];
+		int nvec = 0;
+		for (size_t i = index; i < count && nvec < MAXIOV; ++i) {
+			size_t skip = (i == index ? offset : 0);
+			vec[nvec].iov_base = (char *) iov[i].data + skip;
+			vec[nvec].iov_len = iov[i].size - skip;
+			nvec++;
+		}
+
+		ssize_t n = writev (device->fd, vec, nvec);
+		if (n < 0) {
+			int errcode = errno;
+			if (errcode == EINTR)
+				continue; // Retry.
+			if (errcode == EAGAIN || errcode == EWOULDBLOCK) {
+				if (device->nonblocking)
+					break; // Would block.
+				continue; // Retry.
+			}
 			SYSERROR (abstract->context, errcode);
 			status = syserror (errcode);
 			goto out;
+		} else if (n == 0) {
+			break; // EOF.
 		}
+
+		nbytes += n;
+		dc_iovec_advance (iov, count, &index, &offset, n);
 	}
 
+	// In non-blocking mode, the data is only queued for transmission.
+	if (device->nonblocking) {
+		if (nbytes != size)
+			status = DC_STATUS_TIMEOUT;
+		goto out;
+	}
+
+	// Wait until all data has been transmitted.
+	status = dc_serial_drain (abstract);
+
 out:
 	if (actual)
 		*actual = nbytes;
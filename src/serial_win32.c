@@ -95,6 +95,7 @@ static const dc_iostream_vtable_t dc_serial_vtable = {
 	dc_serial_configure, /* configure */
 	dc_serial_read, /* read */
 	dc_serial_write, /* write */
+	NULL, /* writev */
 	dc_serial_flush, /* flush */
 	dc_serial_purge, /* purge */
 	dc_serial_sleep, /* sleep */
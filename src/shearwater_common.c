@@ -25,21 +25,35 @@
 #include "shearwater_common.h"
 
 #include "context-private.h"
+#include "iostream-private.h"
 #include "array.h"
 
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
 #define SZ_PACKET  254
 
+#define CHECKPOINT_SIZE 0x1000
+
 // SLIP special character codes
 #define END       0xC0
 #define ESC       0xDB
 #define ESC_END   0xDC
 #define ESC_ESC   0xDD
 
+typedef struct shearwater_common_decoder_t {
+	unsigned long long bits;
+	unsigned int nbits;
+	unsigned int done;
+} shearwater_common_decoder_t;
+
 dc_status_t
 shearwater_common_open (shearwater_common_device_t *device, dc_context_t *context, const char *name)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 
+	// Set the default values.
+	device->window = 1;
+
 	// Open the device.
 	status = dc_serial_open (&device->iostream, context, name);
 	if (status != DC_STATUS_SUCCESS) {
@@ -47,6 +61,8 @@ shearwater_common_open (shearwater_common_device_t *device, dc_context_t *contex
 		return status;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -62,6 +78,14 @@ shearwater_common_open (shearwater_common_device_t *device, dc_context_t *contex
 		goto error_close;
 	}
 
+	// Enable the receive buffer, to avoid reading the SLIP encoded
+	// packets byte by byte from the serial port.
+	status = dc_iostream_set_buffer (device->iostream, 1024);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to enable the receive buffer.");
+		goto error_close;
+	}
+
 	// Make sure everything is in a sane state.
 	dc_iostream_sleep (device->iostream, 300);
 	dc_iostream_purge (device->iostream, DC_DIRECTION_ALL);
@@ -82,60 +106,100 @@ shearwater_common_close (shearwater_common_device_t *device)
 }
 
 
-static int
-shearwater_common_decompress_lre (unsigned char *data, unsigned int size, dc_buffer_t *buffer, unsigned int *isfinal)
+static void
+shearwater_common_decoder_init (shearwater_common_decoder_t *decoder)
 {
-	// The RLE decompression algorithm does interpret the binary data as a
-	// stream of 9 bit values. Therefore, the total number of bits needs to be
-	// a multiple of 9 bits.
-	unsigned int nbits = size * 8;
-	if (nbits % 9 != 0)
-		return -1;
+	decoder->bits = 0;
+	decoder->nbits = 0;
+	decoder->done = 0;
+}
+
 
+static int
+shearwater_common_decompress (shearwater_common_decoder_t *decoder, const unsigned char data[], unsigned int size, dc_buffer_t *buffer)
+{
+	// The compressed data is decoded in a single pass, with both the LRE
+	// and the XOR phase applied at once. The data can be passed in
+	// pieces of any size, with the incomplete bits carried over to the
+	// next call.
+	//
+	// The LRE algorithm interprets the binary data as a stream of 9 bit
+	// values. The 9th bit indicates whether the remaining 8 bits
+	// represent a run of zero bytes or not. If the bit is set, the value
+	// is not a run and doesn’t need expansion. If the bit is not set,
+	// the value contains the number of zero bytes in the run. A
+	// zero-length run indicates the end of the compressed stream.
+	//
+	// Each block of 32 bytes of the decompressed data is XOR'ed with the
+	// previous block, except for the first block, which is passed
+	// through unchanged. Because the previous block has already been
+	// decoded, this is applied while writing the output.
+	unsigned long long bits = decoder->bits;
+	unsigned int nbits = decoder->nbits;
 	unsigned int offset = 0;
-	while (offset + 9 <= nbits) {
+
+	if (decoder->done)
+		return 0;
+
+	// The output is written directly into the buffer, which is grown in
+	// steps of 1024 bytes and trimmed to the actual size afterwards.
+	size_t length = dc_buffer_get_size (buffer);
+	size_t available = length;
+	unsigned char *out = dc_buffer_get_data (buffer);
+
+	while (1) {
+		// Refill the bit window.
+		while (nbits <= 56 && offset < size) {
+			bits = (bits << 8) | data[offset++];
+			nbits += 8;
+		}
+
+		if (nbits < 9)
+			break;
+
+		// Make sure there is room for the longest possible run.
+		if (available - length < 255) {
+			available = length + 1024;
+			if (!dc_buffer_resize (buffer, available))
+				return -1;
+			out = dc_buffer_get_data (buffer);
+		}
+
 		// Extract the 9 bit value.
-		unsigned int byte = offset / 8;
-		unsigned int bit  = offset % 8;
-		unsigned int shift = 16 - (bit + 9);
-		unsigned int value = (array_uint16_be (data + byte) >> shift) & 0x1FF;
-
-		// The 9th bit indicates whether the remaining 8 bits represent
-		// a run of zero bytes or not. If the bit is set, the value is
-		// not a run and doesn’t need expansion. If the bit is not set,
-		// the value contains the number of zero bytes in the run. A
-		// zero-length run indicates the end of the compressed stream.
+		unsigned int value = (bits >> (nbits - 9)) & 0x1FF;
+		nbits -= 9;
+
 		if (value & 0x100) {
 			// Append the data byte directly.
 			unsigned char c = value & 0xFF;
-			if (!dc_buffer_append (buffer, &c, 1))
-				return -1;
+			out[length] = (length >= 32 ? c ^ out[length - 32] : c);
+			length++;
 		} else if (value == 0) {
 			// Reached the end of the compressed stream.
-			if (isfinal)
-				*isfinal = 1;
+			decoder->done = 1;
 			break;
 		} else {
-			// Expand the run with zero bytes.
-			if (!dc_buffer_resize (buffer, dc_buffer_get_size (buffer) + value))
-				return -1;
+			// Expand the run with zero bytes, which are XOR'ed with the
+			// previous block, and become a copy of that block.
+			unsigned int n = value;
+			while (n && length < 32) {
+				out[length++] = 0;
+				n--;
+			}
+			while (n) {
+				unsigned int len = (n < 32 ? n : 32);
+				memcpy (out + length, out + length - 32, len);
+				length += len;
+				n -= len;
+			}
 		}
-
-		offset += 9;
 	}
 
-	return 0;
-}
-
+	decoder->bits = bits;
+	decoder->nbits = nbits;
 
-static int
-shearwater_common_decompress_xor (unsigned char *data, unsigned int size)
-{
-	// Each block of 32 bytes is XOR'ed (in-place) with the previous block,
-	// except for the first block, which is passed through unchanged.
-	for (unsigned int i = 32; i < size; ++i) {
-		data[i] ^= data[i - 32];
-	}
+	if (!dc_buffer_resize (buffer, length))
+		return -1;
 
 	return 0;
 }
@@ -148,8 +212,9 @@ shearwater_common_slip_write (shearwater_common_device_t *device, const unsigned
 	const unsigned char end[] = {END};
 	const unsigned char esc_end[] = {ESC, ESC_END};
 	const unsigned char esc_esc[] = {ESC, ESC_ESC};
-	unsigned char buffer[32];
-	unsigned int nbytes = 0;
+	dc_iovec_t iov[32];
+	unsigned int niov = 0;
+	unsigned int start = 0;
 
 #if 0
 	// Send an initial END character to flush out any data that may have
@@ -160,48 +225,61 @@ shearwater_common_slip_write (shearwater_common_device_t *device, const unsigned
 	}
 #endif
 
+	// The frame is described as a list of buffers, with the unescaped
+	// characters taken directly from the input data, and sent with a
+	// single write.
 	for (unsigned int i = 0; i < size; ++i) {
 		const unsigned char *seq = NULL;
-		unsigned int len = 0;
 		switch (data[i]) {
 		case END:
 			// Escape the END character.
 			seq = esc_end;
-			len = sizeof (esc_end);
 			break;
 		case ESC:
 			// Escape the ESC character.
 			seq = esc_esc;
-			len = sizeof (esc_esc);
 			break;
 		default:
 			// Normal character.
-			seq = data + i;
-			len = 1;
-			break;
+			continue;
 		}
 
-		// Flush the buffer if necessary.
-		if (nbytes + len + sizeof(end) > sizeof(buffer)) {
-			status = dc_iostream_write (device->iostream, buffer, nbytes, NULL);
+		// Flush the list if necessary.
+		if (niov + 4 > C_ARRAY_SIZE(iov)) {
+			status = dc_iostream_writev (device->iostream, iov, niov, NULL);
 			if (status != DC_STATUS_SUCCESS) {
 				return status;
 			}
 
-			nbytes = 0;
+			niov = 0;
+		}
+
+		// Append the normal characters and the escape sequence.
+		if (i > start) {
+			iov[niov].data = data + start;
+			iov[niov].size = i - start;
+			niov++;
 		}
+		iov[niov].data = seq;
+		iov[niov].size = 2;
+		niov++;
 
-		// Append the escaped character.
-		memcpy(buffer + nbytes, seq, len);
-		nbytes += len;
+		start = i + 1;
+	}
+
+	// Append the remaining characters.
+	if (size > start) {
+		iov[niov].data = data + start;
+		iov[niov].size = size - start;
+		niov++;
 	}
 
 	// Append the END character to indicate the end of the packet.
-	memcpy(buffer + nbytes, end, sizeof(end));
-	nbytes += sizeof(end);
+	iov[niov].data = end;
+	iov[niov].size = sizeof (end);
+	niov++;
 
-	// Flush the buffer.
-	status = dc_iostream_write (device->iostream, buffer, nbytes, NULL);
+	status = dc_iostream_writev (device->iostream, iov, niov, NULL);
 	if (status != DC_STATUS_SUCCESS) {
 		return status;
 	}
@@ -279,20 +357,16 @@ done:
 }
 
 
-dc_status_t
-shearwater_common_transfer (shearwater_common_device_t *device, const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize, unsigned int *actual)
+static dc_status_t
+shearwater_common_send (shearwater_common_device_t *device, const unsigned char input[], unsigned int isize)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
 	unsigned char packet[SZ_PACKET + 4];
-	unsigned int n = 0;
 
-	if (isize > SZ_PACKET || osize > SZ_PACKET)
+	if (isize > SZ_PACKET)
 		return DC_STATUS_INVALIDARGS;
 
-	if (device_is_cancelled (abstract))
-		return DC_STATUS_CANCELLED;
-
 	// Setup the request packet.
 	packet[0] = 0xFF;
 	packet[1] = 0x01;
@@ -307,12 +381,20 @@ shearwater_common_transfer (shearwater_common_device_t *device, const unsigned c
 		return status;
 	}
 
-	// Return early if no response packet is requested.
-	if (osize == 0) {
-		if (actual)
-			*actual = 0;
-		return DC_STATUS_SUCCESS;
-	}
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+shearwater_common_receive (shearwater_common_device_t *device, unsigned char output[], unsigned int osize, unsigned int *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_device_t *abstract = (dc_device_t *) device;
+	unsigned char packet[SZ_PACKET + 4];
+	unsigned int n = 0;
+
+	if (osize > SZ_PACKET)
+		return DC_STATUS_INVALIDARGS;
 
 	// Receive the response packet.
 	status = shearwater_common_slip_read (device, packet, sizeof (packet), &n);
@@ -343,7 +425,66 @@ shearwater_common_transfer (shearwater_common_device_t *device, const unsigned c
 
 
 dc_status_t
-shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buffer, unsigned int address, unsigned int size, unsigned int compression, dc_event_progress_t *progress)
+shearwater_common_transfer (shearwater_common_device_t *device, const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize, unsigned int *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_device_t *abstract = (dc_device_t *) device;
+
+	if (isize > SZ_PACKET || osize > SZ_PACKET)
+		return DC_STATUS_INVALIDARGS;
+
+	if (device_is_cancelled (abstract))
+		return DC_STATUS_CANCELLED;
+
+	// Send the request packet.
+	status = shearwater_common_send (device, input, isize);
+	if (status != DC_STATUS_SUCCESS) {
+		return status;
+	}
+
+	// Return early if no response packet is requested.
+	if (osize == 0) {
+		if (actual)
+			*actual = 0;
+		return DC_STATUS_SUCCESS;
+	}
+
+	// Receive the response packet.
+	return shearwater_common_receive (device, output, osize, actual);
+}
+
+
+dc_status_t
+shearwater_common_set_window (shearwater_common_device_t *device, unsigned int window)
+{
+	if (window == 0 || window > MAXWINDOW)
+		return DC_STATUS_INVALIDARGS;
+
+	device->window = window;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static void
+shearwater_common_abort (shearwater_common_device_t *device)
+{
+	unsigned char req_quit[] = {0x37};
+	unsigned char response[SZ_PACKET];
+
+	// Discard the responses to the outstanding requests, and terminate
+	// the download. Errors are ignored, because the device is already
+	// in an unknown state.
+	dc_iostream_sleep (device->iostream, 300);
+	dc_iostream_purge (device->iostream, DC_DIRECTION_ALL);
+	shearwater_common_transfer (device, req_quit, sizeof (req_quit), response, 2, NULL);
+	dc_iostream_sleep (device->iostream, 300);
+	dc_iostream_purge (device->iostream, DC_DIRECTION_ALL);
+}
+
+
+dc_status_t
+shearwater_common_download_stream (shearwater_common_device_t *device, dc_buffer_t *buffer, unsigned int address, unsigned int size, unsigned int compression, dc_event_progress_t *progress, shearwater_common_stream_t callback, void *userdata)
 {
 	dc_device_t *abstract = (dc_device_t *) device;
 	dc_status_t rc = DC_STATUS_SUCCESS;
@@ -377,6 +518,56 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 		device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
 	}
 
+	// Look for the data of an interrupted download. A compressed stream
+	// can only be restored once it's complete, because the state of the
+	// decoder isn't stored. An uncompressed transfer resumes from the
+	// last checkpoint. Transfers smaller than the checkpoint interval
+	// are cheap enough to repeat and never stored.
+	unsigned char key[12] = {0};
+	array_uint32_le_set (key + 0, address);
+	array_uint32_le_set (key + 4, size);
+	array_uint32_le_set (key + 8, compression);
+
+	const unsigned char *cpdata = NULL;
+	unsigned int cpsize = 0, cpflags = 0, resume = 0;
+	if (device_checkpoint_lookup (abstract, key, sizeof (key), &cpdata, &cpsize, &cpflags)) {
+		if ((cpflags & DC_CHECKPOINT_COMPLETE) && (compression || cpsize == size)) {
+			INFO (abstract->context, "Restored %u bytes from the checkpoint.", cpsize);
+			if (!dc_buffer_append (buffer, cpdata, cpsize)) {
+				ERROR (abstract->context, "Insufficient buffer space available.");
+				return DC_STATUS_NOMEMORY;
+			}
+
+			if (progress) {
+				progress->current = initial + STEP (maximum, maximum);
+				device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
+			}
+
+			if (callback) {
+				callback (dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), userdata);
+			}
+
+			return DC_STATUS_SUCCESS;
+		} else if (!compression && cpsize <= size) {
+			resume = cpsize - cpsize % CHECKPOINT_SIZE;
+		}
+	}
+
+	if (resume) {
+		INFO (abstract->context, "Resuming the download at offset %u.", resume);
+		if (!dc_buffer_append (buffer, cpdata, resume)) {
+			ERROR (abstract->context, "Insufficient buffer space available.");
+			return DC_STATUS_NOMEMORY;
+		}
+
+		req_init[3] = ((address + resume) >> 24) & 0xFF;
+		req_init[4] = ((address + resume) >> 16) & 0xFF;
+		req_init[5] = ((address + resume) >>  8) & 0xFF;
+		req_init[6] = ((address + resume)      ) & 0xFF;
+		array_uint24_be_set (req_init + 7, size - resume);
+		current += resume;
+	}
+
 	// Transfer the init request.
 	rc = shearwater_common_transfer (device, req_init, sizeof (req_init), response, 3, &n);
 	if (rc != DC_STATUS_SUCCESS) {
@@ -396,21 +587,68 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 		device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
 	}
 
+	// In windowed mode, several block requests are kept outstanding, to
+	// hide the round-trip latency of the (Bluetooth) connection. The
+	// device keeps sending while the received blocks are decompressed.
+	// The number of requests is limited by the number of blocks left.
+	// In compressed mode the end of the data is not known in advance,
+	// and the limit is based on the worst case size of the remaining
+	// data instead (9 bits per byte, plus the 9 bit end marker). The
+	// responses to the superfluous requests are discarded afterwards.
+	unsigned int window = device->window;
+	unsigned int blocksize = response[2];
+
+	shearwater_common_decoder_t decoder;
+	shearwater_common_decoder_init (&decoder);
+
 	unsigned int done = 0;
-	unsigned char block = 1;
-	unsigned int nbytes = 0;
+	unsigned int block = 1, requested = 1;
+	unsigned int nbytes = resume, nrequested = resume;
+	unsigned int checkpoint = resume, finished = 1;
 	while (nbytes < size && !done) {
-		// Transfer the block request.
-		req_block[1] = block;
-		rc = shearwater_common_transfer (device, req_block, sizeof (req_block), response, sizeof (response), &n);
-		if (rc != DC_STATUS_SUCCESS) {
-			return rc;
+		// Calculate the (maximum) number of bytes left.
+		unsigned int remaining = size - nbytes;
+		if (compression) {
+			unsigned int output = dc_buffer_get_size (buffer);
+			unsigned int left = output < size ? size - output : 0;
+			remaining = (unsigned int) (((unsigned long long) left * 9 + 9 + 7) / 8);
+		}
+
+		// Transfer the block requests.
+		while (requested == block || (requested - block < window && nrequested - nbytes < remaining)) {
+			if (device_is_cancelled (abstract))
+				return DC_STATUS_CANCELLED;
+
+			req_block[1] = requested & 0xFF;
+			rc = shearwater_common_send (device, req_block, sizeof (req_block));
+			if (rc != DC_STATUS_SUCCESS) {
+				return rc;
+			}
+
+			nrequested += blocksize;
+			requested++;
 		}
 
-		// Verify the block header.
-		if (n < 2 || response[0] != 0x76 || response[1] != block) {
+		// Receive the block response.
+		rc = shearwater_common_receive (device, response, sizeof (response), &n);
+		if (rc == DC_STATUS_SUCCESS && (n < 2 || response[0] != 0x76 || response[1] != (block & 0xFF))) {
 			ERROR (abstract->context, "Unexpected response packet.");
-			return DC_STATUS_PROTOCOL;
+			rc = DC_STATUS_PROTOCOL;
+		}
+		if (rc != DC_STATUS_SUCCESS) {
+			if (window > 1) {
+				// Fall back to a single outstanding request, and
+				// restart the download from the beginning.
+				WARNING (abstract->context, "Windowed download failed. Retrying without.");
+				shearwater_common_abort (device);
+				device_stats_retry (abstract);
+				device->window = 1;
+				if (progress) {
+					progress->current = initial;
+				}
+				return shearwater_common_download_stream (device, buffer, address, size, compression, progress, callback, userdata);
+			}
+			return rc;
 		}
 
 		// Verify the block length.
@@ -428,10 +666,13 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 		}
 
 		if (compression) {
-			if (shearwater_common_decompress_lre (response + 2, length, buffer, &done) != 0) {
-				ERROR (abstract->context, "Decompression error (LRE phase).");
+			// The total number of bits needs to be a multiple of 9 bits.
+			if ((length * 8) % 9 != 0 ||
+				shearwater_common_decompress (&decoder, response + 2, length, buffer) != 0) {
+				ERROR (abstract->context, "Decompression error.");
 				return DC_STATUS_PROTOCOL;
 			}
+			done = decoder.done;
 		} else {
 			if (!dc_buffer_append (buffer, response + 2, length)) {
 				ERROR (abstract->context, "Insufficient buffer space available.");
@@ -441,13 +682,36 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 
 		nbytes += length;
 		block++;
+
+		// Store the data received since the previous checkpoint. Failures
+		// are not fatal, the download merely can't be resumed.
+		if (!compression && size >= CHECKPOINT_SIZE && nbytes - checkpoint >= CHECKPOINT_SIZE) {
+			unsigned int end = nbytes - nbytes % CHECKPOINT_SIZE;
+			device_checkpoint_store (abstract, key, sizeof (key), checkpoint,
+				dc_buffer_get_data (buffer) + checkpoint, end - checkpoint, 0);
+			checkpoint = end;
+		}
+
+		// Pass the data received so far to the stream callback. If the
+		// callback is not interested in the remaining data, the download
+		// is finished early.
+		if (callback && !callback (dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), userdata)) {
+			current = maximum - 1;
+			finished = 0;
+			break;
+		}
 	}
 
-	if (compression) {
-		if (shearwater_common_decompress_xor (dc_buffer_get_data (buffer), dc_buffer_get_size (buffer)) != 0) {
-			ERROR (abstract->context, "Decompression error (XOR phase).");
-			return DC_STATUS_PROTOCOL;
+	// Discard the responses to the outstanding block requests.
+	while (block != requested) {
+		rc = shearwater_common_receive (device, response, sizeof (response), &n);
+		if (rc != DC_STATUS_SUCCESS) {
+			WARNING (abstract->context, "Failed to receive the outstanding block responses.");
+			dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
+			break;
 		}
+
+		block++;
 	}
 
 	// Transfer the quit request.
@@ -462,6 +726,15 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 		return DC_STATUS_PROTOCOL;
 	}
 
+	// Mark the transfer as complete.
+	if (finished && compression) {
+		device_checkpoint_store (abstract, key, sizeof (key), 0,
+			dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), DC_CHECKPOINT_COMPLETE);
+	} else if (finished && size >= CHECKPOINT_SIZE) {
+		device_checkpoint_store (abstract, key, sizeof (key), checkpoint,
+			dc_buffer_get_data (buffer) + checkpoint, nbytes - checkpoint, DC_CHECKPOINT_COMPLETE);
+	}
+
 	// Update and emit a progress event.
 	if (progress) {
 		current += 1;
@@ -473,6 +746,13 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 }
 
 
+dc_status_t
+shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buffer, unsigned int address, unsigned int size, unsigned int compression, dc_event_progress_t *progress)
+{
+	return shearwater_common_download_stream (device, buffer, address, size, compression, progress, NULL, NULL);
+}
+
+
 dc_status_t
 shearwater_common_identifier (shearwater_common_device_t *device, dc_buffer_t *buffer, unsigned int id)
 {
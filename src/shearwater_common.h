@@ -43,9 +43,14 @@ extern "C" {
 #define NSTEPS    10000
 #define STEP(i,n) ((NSTEPS * (i) + (n) / 2) / (n))
 
+#define MAXWINDOW 8
+
+typedef int (*shearwater_common_stream_t) (const unsigned char data[], unsigned int size, void *userdata);
+
 typedef struct shearwater_common_device_t {
 	dc_device_t base;
 	dc_iostream_t *iostream;
+	unsigned int window;
 } shearwater_common_device_t;
 
 dc_status_t
@@ -57,9 +62,15 @@ shearwater_common_close (shearwater_common_device_t *device);
 dc_status_t
 shearwater_common_transfer (shearwater_common_device_t *device, const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize, unsigned int *actual);
 
+dc_status_t
+shearwater_common_set_window (shearwater_common_device_t *device, unsigned int window);
+
 dc_status_t
 shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buffer, unsigned int address, unsigned int size, unsigned int compression, dc_event_progress_t *progress);
 
+dc_status_t
+shearwater_common_download_stream (shearwater_common_device_t *device, dc_buffer_t *buffer, unsigned int address, unsigned int size, unsigned int compression, dc_event_progress_t *progress, shearwater_common_stream_t callback, void *userdata);
+
 dc_status_t
 shearwater_common_identifier (shearwater_common_device_t *device, dc_buffer_t *buffer, unsigned int id);
 
@@ -105,6 +105,18 @@ shearwater_predator_device_close (dc_device_t *abstract)
 }
 
 
+dc_status_t
+shearwater_predator_device_set_window (dc_device_t *abstract, unsigned int window)
+{
+	shearwater_common_device_t *device = (shearwater_common_device_t *) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	return shearwater_common_set_window (device, window);
+}
+
+
 static dc_status_t
 shearwater_predator_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size)
 {
@@ -142,26 +154,220 @@ shearwater_predator_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 }
 
 
+/*
+ * Because the Petrel does reorder the internal ringbuffer before sending
+ * the data, the most recent dive is always the first one. Therefore the
+ * dives can be extracted incrementally, while the data is still being
+ * downloaded. The extractor keeps track of its position in the data
+ * stream, and can be fed repeatedly with a growing amount of data.
+ */
+typedef struct shearwater_predator_extractor_t {
+	shearwater_predator_device_t *device;
+	dc_context_t *context;
+	dc_dive_callback_t callback;
+	void *userdata;
+	// The final block, which is appended to every dive.
+	const unsigned char *final;
+	// Memory for the profiles.
+	unsigned char *buffer;
+	// Current position in the data stream.
+	unsigned int offset;
+	unsigned int header;
+	unsigned int have_header;
+	unsigned int done;
+	dc_status_t status;
+} shearwater_predator_extractor_t;
+
+static dc_status_t
+shearwater_predator_extractor_init (shearwater_predator_extractor_t *extractor, dc_device_t *abstract, const unsigned char final[], dc_dive_callback_t callback, void *userdata)
+{
+	// Allocate memory for the profiles.
+	extractor->buffer = (unsigned char *) malloc (RB_PROFILE_END - RB_PROFILE_BEGIN + SZ_BLOCK);
+	if (extractor->buffer == NULL) {
+		return DC_STATUS_NOMEMORY;
+	}
+
+	extractor->device = (shearwater_predator_device_t *) abstract;
+	extractor->context = (abstract ? abstract->context : NULL);
+	extractor->callback = callback;
+	extractor->userdata = userdata;
+	extractor->final = final;
+	extractor->offset = RB_PROFILE_BEGIN;
+	extractor->header = 0;
+	extractor->have_header = 0;
+	extractor->done = 0;
+	extractor->status = DC_STATUS_SUCCESS;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static int
+shearwater_predator_extractor_feed (const unsigned char data[], unsigned int size, void *userdata)
+{
+	shearwater_predator_extractor_t *extractor = (shearwater_predator_extractor_t *) userdata;
+	shearwater_predator_device_t *device = extractor->device;
+	unsigned char *buffer = extractor->buffer;
+
+	if (size > RB_PROFILE_END)
+		size = RB_PROFILE_END;
+
+	// Search the ringbuffer to locate matching header and footer markers.
+	while (!extractor->done && extractor->offset + SZ_BLOCK <= size) {
+		unsigned int offset = extractor->offset;
+
+		if (array_isequal (data + offset, SZ_BLOCK, 0xFF)) {
+			// Ignore empty blocks explicitly, because otherwise they are
+			// incorrectly recognized as header markers.
+			extractor->done = 1;
+			break;
+		} else if (data[offset + 0] == 0xFF && data[offset + 1] == 0xFF) {
+			// Remember the header marker.
+			extractor->header = offset;
+			extractor->have_header = 1;
+		} else if (data[offset + 0] == 0xFF && data[offset + 1] == 0xFE && extractor->have_header) {
+			unsigned int header = extractor->header;
+
+			// The dive number in the header and footer should be identical.
+			if (memcmp (data + header + 2, data + offset + 2, 2) != 0) {
+				ERROR (extractor->context, "Unexpected dive number.");
+				extractor->status = DC_STATUS_DATAFORMAT;
+				extractor->done = 1;
+				break;
+			}
+
+			// Append the final block.
+			unsigned int length = offset + SZ_BLOCK - header;
+			memcpy (buffer, data + header, length);
+			memcpy (buffer + length, extractor->final, SZ_BLOCK);
+
+			// Check the fingerprint data.
+			if (device && memcmp (buffer + 12, device->fingerprint, sizeof (device->fingerprint)) == 0) {
+				extractor->done = 1;
+				break;
+			}
+
+			if (extractor->callback && !extractor->callback (buffer, length + SZ_BLOCK, buffer + 12, sizeof (device->fingerprint), extractor->userdata)) {
+				extractor->done = 1;
+				break;
+			}
+
+			// Reset the header marker.
+			extractor->have_header = 0;
+		}
+
+		extractor->offset += SZ_BLOCK;
+	}
+
+	if (extractor->offset + SZ_BLOCK > RB_PROFILE_END)
+		extractor->done = 1;
+
+	return !extractor->done;
+}
+
+static void
+shearwater_predator_extractor_free (shearwater_predator_extractor_t *extractor)
+{
+	free (extractor->buffer);
+}
+
+
+static void
+shearwater_predator_emit_devinfo (dc_device_t *abstract, const unsigned char final[])
+{
+	// Emit a device info event.
+	dc_event_devinfo_t devinfo;
+	devinfo.model = final[0x0D];
+	devinfo.firmware = bcd2dec (final[0x0A]);
+	devinfo.serial = array_uint32_be (final + 0x02);
+	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
+}
+
+
+static dc_status_t
+shearwater_predator_device_stream (dc_device_t *abstract, const unsigned char final[], dc_dive_callback_t callback, void *userdata)
+{
+	shearwater_common_device_t *device = (shearwater_common_device_t *) abstract;
+
+	dc_buffer_t *buffer = dc_buffer_new (SZ_MEMORY);
+	if (buffer == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	shearwater_predator_extractor_t extractor;
+	dc_status_t rc = shearwater_predator_extractor_init (&extractor, abstract, final, callback, userdata);
+	if (rc != DC_STATUS_SUCCESS) {
+		dc_buffer_free (buffer);
+		return rc;
+	}
+
+	// Enable progress notifications.
+	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+	progress.current = 0;
+	progress.maximum = NSTEPS;
+
+	// The dives are passed to the application while the download is
+	// still in progress, and the download stops as soon as no more dives
+	// are needed.
+	rc = shearwater_common_download_stream (device, buffer, 0xDD000000, SZ_MEMORY, 0, &progress,
+		shearwater_predator_extractor_feed, &extractor);
+	if (rc == DC_STATUS_SUCCESS)
+		rc = extractor.status;
+
+	// The memory image is only available if the download wasn't stopped
+	// early.
+	if (rc == DC_STATUS_SUCCESS && dc_buffer_get_size (buffer) == SZ_MEMORY) {
+		device_image_set_memory (abstract, dc_buffer_get_data (buffer), SZ_MEMORY);
+	}
+
+	shearwater_predator_extractor_free (&extractor);
+	dc_buffer_free (buffer);
+
+	return rc;
+}
+
+
 static dc_status_t
 shearwater_predator_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
+	shearwater_common_device_t *device = (shearwater_common_device_t *) abstract;
+
 	dc_buffer_t *buffer = dc_buffer_new (SZ_MEMORY);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
-	dc_status_t rc = shearwater_predator_device_dump (abstract, buffer);
+	// Read the final block first. It contains the model number, which
+	// determines the layout of the data, and it's appended to every dive.
+	// The serial number is also needed before the main download starts,
+	// to locate the checkpoint of an interrupted download.
+	unsigned int devinfo = 0;
+	dc_status_t rc = shearwater_common_download (device, buffer, 0xDD000000 + SZ_MEMORY - SZ_BLOCK, SZ_BLOCK, 0, NULL);
+	if (rc == DC_STATUS_SUCCESS && dc_buffer_get_size (buffer) == SZ_BLOCK) {
+		unsigned char final[SZ_BLOCK];
+		memcpy (final, dc_buffer_get_data (buffer), SZ_BLOCK);
+		shearwater_predator_emit_devinfo (abstract, final);
+		devinfo = 1;
+		if (final[0x0D] == PETREL) {
+			dc_buffer_free (buffer);
+			return shearwater_predator_device_stream (abstract, final, callback, userdata);
+		}
+	} else if (rc != DC_STATUS_CANCELLED) {
+		WARNING (abstract->context, "Failed to read the final block.");
+	} else {
+		dc_buffer_free (buffer);
+		return rc;
+	}
+
+	rc = shearwater_predator_device_dump (abstract, buffer);
 	if (rc != DC_STATUS_SUCCESS) {
 		dc_buffer_free (buffer);
 		return rc;
 	}
 
-	// Emit a device info event.
 	unsigned char *data = dc_buffer_get_data (buffer);
-	dc_event_devinfo_t devinfo;
-	devinfo.model = data[0x2000D];
-	devinfo.firmware = bcd2dec (data[0x2000A]);
-	devinfo.serial = array_uint32_be (data + 0x20002);
-	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
+	if (!devinfo) {
+		shearwater_predator_emit_devinfo (abstract, data + SZ_MEMORY - SZ_BLOCK);
+	}
+
+	device_image_set_memory (abstract, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
 
 	rc = shearwater_predator_extract_dives (abstract, data, SZ_MEMORY, callback, userdata);
 
@@ -283,62 +489,16 @@ shearwater_predator_extract_predator (dc_device_t *abstract, const unsigned char
 static dc_status_t
 shearwater_predator_extract_petrel (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
 {
-	shearwater_predator_device_t *device = (shearwater_predator_device_t*) abstract;
-	dc_context_t *context = (abstract ? abstract->context : NULL);
-
-	// Allocate memory for the profiles.
-	unsigned char *buffer = (unsigned char *) malloc (RB_PROFILE_END - RB_PROFILE_BEGIN + SZ_BLOCK);
-	if (buffer == NULL) {
-		return DC_STATUS_NOMEMORY;
-	}
-
-	// Search the ringbuffer to locate matching header and footer
-	// markers. Because the Petrel does reorder the internal ringbuffer
-	// before sending the data, the most recent dive is always the first
-	// one. Therefore, there is no need to search for it, as we have to
-	// do for the Predator.
-	unsigned int header = 0;
-	unsigned int have_header = 0;
-	unsigned int offset = RB_PROFILE_BEGIN;
-	while (offset != RB_PROFILE_END) {
-		if (array_isequal (data + offset, SZ_BLOCK, 0xFF)) {
-			// Ignore empty blocks explicitly, because otherwise they are
-			// incorrectly recognized as header markers.
-			break;
-		} else if (data[offset + 0] == 0xFF && data[offset + 1] == 0xFF) {
-			// Remember the header marker.
-			header = offset;
-			have_header = 1;
-		} else if (data[offset + 0] == 0xFF && data[offset + 1] == 0xFE && have_header) {
-			// The dive number in the header and footer should be identical.
-			if (memcmp (data + header + 2, data + offset + 2, 2) != 0) {
-				ERROR (context, "Unexpected dive number.");
-				free (buffer);
-				return DC_STATUS_DATAFORMAT;
-			}
-
-			// Append the final block.
-			unsigned int length = offset + SZ_BLOCK - header;
-			memcpy (buffer, data + header, length);
-			memcpy (buffer + length, data + SZ_MEMORY - SZ_BLOCK, SZ_BLOCK);
-
-			// Check the fingerprint data.
-			if (device && memcmp (buffer + 12, device->fingerprint, sizeof (device->fingerprint)) == 0)
-				break;
-
-			if (callback && !callback (buffer, length + SZ_BLOCK, buffer + 12, sizeof (device->fingerprint), userdata))
-				break;
-
-			// Reset the header marker.
-			have_header = 0;
-		}
+	shearwater_predator_extractor_t extractor;
+	dc_status_t rc = shearwater_predator_extractor_init (&extractor, abstract, data + SZ_MEMORY - SZ_BLOCK, callback, userdata);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
 
-		offset += SZ_BLOCK;
-	}
+	shearwater_predator_extractor_feed (data, size, &extractor);
 
-	free (buffer);
+	shearwater_predator_extractor_free (&extractor);
 
-	return DC_STATUS_SUCCESS;
+	return extractor.status;
 }
 
 
@@ -25,6 +25,7 @@
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/device.h>
 #include <libdivecomputer/parser.h>
+#include <libdivecomputer/shearwater_predator.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -86,7 +86,7 @@ struct shearwater_predator_parser_t {
 static dc_status_t shearwater_predator_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
 static dc_status_t shearwater_predator_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t shearwater_predator_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
-static dc_status_t shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t shearwater_predator_parser_samples_decode (dc_parser_t *abstract, const dc_sample_sink_t *sink);
 
 static const dc_parser_vtable_t shearwater_predator_parser_vtable = {
 	sizeof(shearwater_predator_parser_t),
@@ -94,7 +94,8 @@ static const dc_parser_vtable_t shearwater_predator_parser_vtable = {
 	shearwater_predator_parser_set_data, /* set_data */
 	shearwater_predator_parser_get_datetime, /* datetime */
 	shearwater_predator_parser_get_field, /* fields */
-	shearwater_predator_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_foreach */
+	shearwater_predator_parser_samples_decode, /* samples_decode */
 	NULL /* destroy */
 };
 
@@ -104,7 +105,8 @@ static const dc_parser_vtable_t shearwater_petrel_parser_vtable = {
 	shearwater_predator_parser_set_data, /* set_data */
 	shearwater_predator_parser_get_datetime, /* datetime */
 	shearwater_predator_parser_get_field, /* fields */
-	shearwater_predator_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_foreach */
+	shearwater_predator_parser_samples_decode, /* samples_decode */
 	NULL /* destroy */
 };
 
@@ -250,7 +252,7 @@ add_string(shearwater_predator_parser_t *parser, const char *desc, const char *v
 		if (str->desc)
 			continue;
 		str->desc = desc;
-		str->value = strdup(value);
+		str->value = dc_arena_strdup(&parser->base.arena, value);
 		break;
 	}
 }
@@ -604,7 +606,7 @@ shearwater_predator_parser_get_field (dc_parser_t *abstract, dc_field_type_t typ
 
 
 static dc_status_t
-shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+shearwater_predator_parser_samples_decode (dc_parser_t *abstract, const dc_sample_sink_t *sink)
 {
 	shearwater_predator_parser_t *parser = (shearwater_predator_parser_t *) abstract;
 
@@ -638,7 +640,7 @@ shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_cal
 		// Time (seconds).
 		time += 10;
 		sample.time = time;
-		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+		dc_sample_sink_emit (sink, DC_SAMPLE_TIME, &sample);
 
 		// Depth (1/10 m or ft).
 		unsigned int depth = array_uint16_be (data + offset);
@@ -646,7 +648,7 @@ shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_cal
 			sample.depth = depth * FEET / 10.0;
 		else
 			sample.depth = depth / 10.0;
-		if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+		dc_sample_sink_emit (sink, DC_SAMPLE_DEPTH, &sample);
 
 		// Temperature (°C or °F).
 		int temperature = (signed char) data[offset + 13];
@@ -661,7 +663,7 @@ shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_cal
 			sample.temperature = (temperature - 32.0) * (5.0 / 9.0);
 		else
 			sample.temperature = temperature;
-		if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
+		dc_sample_sink_emit (sink, DC_SAMPLE_TEMPERATURE, &sample);
 
 		// Status flags.
 		unsigned int status = data[offset + 11];
@@ -671,16 +673,16 @@ shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_cal
 			if ((status & PPO2_EXTERNAL) == 0) {
 #ifdef SENSOR_AVERAGE
 				sample.ppo2 = data[offset + 6] / 100.0;
-				if (callback) callback (DC_SAMPLE_PPO2, sample, userdata);
+				dc_sample_sink_emit (sink, DC_SAMPLE_PPO2, &sample);
 #else
 				sample.ppo2 = data[offset + 12] * parser->calibration[0];
-				if (callback && (parser->calibrated & 0x01)) callback (DC_SAMPLE_PPO2, sample, userdata);
+				if (parser->calibrated & 0x01) dc_sample_sink_emit (sink, DC_SAMPLE_PPO2, &sample);
 
 				sample.ppo2 = data[offset + 14] * parser->calibration[1];
-				if (callback && (parser->calibrated & 0x02)) callback (DC_SAMPLE_PPO2, sample, userdata);
+				if (parser->calibrated & 0x02) dc_sample_sink_emit (sink, DC_SAMPLE_PPO2, &sample);
 
 				sample.ppo2 = data[offset + 15] * parser->calibration[2];
-				if (callback && (parser->calibrated & 0x04)) callback (DC_SAMPLE_PPO2, sample, userdata);
+				if (parser->calibrated & 0x04) dc_sample_sink_emit (sink, DC_SAMPLE_PPO2, &sample);
 #endif
 			}
 
@@ -694,13 +696,13 @@ shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_cal
 					sample.setpoint = data[17] / 100.0;
 				}
 			}
-			if (callback) callback (DC_SAMPLE_SETPOINT, sample, userdata);
+			dc_sample_sink_emit (sink, DC_SAMPLE_SETPOINT, &sample);
 		}
 
 		// CNS
 		if (parser->petrel) {
 			sample.cns = data[offset + 22] / 100.0;
-			if (callback) callback (DC_SAMPLE_CNS, sample, userdata);
+			dc_sample_sink_emit (sink, DC_SAMPLE_CNS, &sample);
 		}
 
 		// Gaschange.
@@ -714,7 +716,7 @@ shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_cal
 			}
 
 			sample.gasmix = idx;
-			if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
+			dc_sample_sink_emit (sink, DC_SAMPLE_GASMIX, &sample);
 			o2_previous = o2;
 			he_previous = he;
 		}
@@ -732,7 +734,7 @@ shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_cal
 			sample.deco.depth = 0.0;
 		}
 		sample.deco.time = data[offset + 9] * 60;
-		if (callback) callback (DC_SAMPLE_DECO, sample, userdata);
+		dc_sample_sink_emit (sink, DC_SAMPLE_DECO, &sample);
 
 		// for logversion 7 and newer (introduced for Perdix AI)
 		// detect tank pressure
@@ -751,14 +753,14 @@ shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_cal
 				pressure &= 0x0FFF;
 				sample.pressure.tank = 0;
 				sample.pressure.value = pressure * 2 * PSI / BAR;
-				if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
+				dc_sample_sink_emit (sink, DC_SAMPLE_PRESSURE, &sample);
 			}
 			pressure = array_uint16_be (data + offset + 19);
 			if (pressure < 0xFFF0) {
 				pressure &= 0x0FFF;
 				sample.pressure.tank = 1;
 				sample.pressure.value = pressure * 2 * PSI / BAR;
-				if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
+				dc_sample_sink_emit (sink, DC_SAMPLE_PRESSURE, &sample);
 			}
 
 			// Gas time remaining in minutes
@@ -770,7 +772,7 @@ shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_cal
 			//    0xFB Tank size or max pressure haven’t been set up
 			if (data[offset + 21] < 0xF0) {
 				sample.rbt = data[offset + 21];
-				if (callback) callback (DC_SAMPLE_RBT, sample, userdata);
+				dc_sample_sink_emit (sink, DC_SAMPLE_RBT, &sample);
 			}
 		}
 
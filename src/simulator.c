@@ -0,0 +1,973 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2018 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // posix_openpt, grantpt, unlockpt, ptsname
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h> // malloc, free
+#include <string.h> // memcpy, memcmp, memset, strdup
+
+#if defined(ENABLE_PTY) && !defined(_WIN32)
+#define HAVE_SIMULATOR
+#include <errno.h>	// errno
+#include <unistd.h>	// read, write, close, pipe
+#include <fcntl.h>	// open, fcntl
+#include <termios.h>	// tcgetattr, tcsetattr, cfmakeraw
+#include <poll.h>	// poll
+#endif
+
+#include <libdivecomputer/simulator.h>
+#include <libdivecomputer/buffer.h>
+
+#include "context-private.h"
+#include "thread.h"
+#include "timer.h"
+#include "array.h"
+#include "checksum.h"
+
+#define MAXPENDING 64
+#define SZ_VERSION 64
+
+// Oceanic Atom 2
+#define OCEANIC_PAGESIZE      0x10
+#define OCEANIC_CMD_VERSION   0x84
+#define OCEANIC_CMD_READ1     0xB1
+#define OCEANIC_CMD_READ8     0xB4
+#define OCEANIC_CMD_READ16    0xB8
+#define OCEANIC_CMD_WRITE     0xB2
+#define OCEANIC_CMD_KEEPALIVE 0x91
+#define OCEANIC_CMD_QUIT      0x6A
+#define OCEANIC_ACK 0x5A
+#define OCEANIC_NAK 0xA5
+
+// Suunto Vyper2 and D9
+#define SUUNTO_SZ_PACKET 0xFF
+#define SUUNTO_CMD_READ     0x05
+#define SUUNTO_CMD_WRITE    0x06
+#define SUUNTO_CMD_VERSION  0x0F
+#define SUUNTO_CMD_RESET    0x20
+
+// Heinrichs Weikamp OSTC3
+#define OSTC3_SZ_HEADER       256
+#define OSTC3_SZ_COMPACT      16
+#define OSTC3_SZ_HARDWARE2    5
+#define OSTC3_RB_LOGBOOK_COUNT 256
+#define OSTC3_RB_PROFILE_BEGIN 0x200000
+#define OSTC3_RB_PROFILE_END   0x400000
+#define OSTC3_S_BLOCK_READ 0x20
+#define OSTC3_S_READY      0x4C
+#define OSTC3_READY        0x4D
+#define OSTC3_HARDWARE2    0x60
+#define OSTC3_HEADER       0x61
+#define OSTC3_CLOCK        0x62
+#define OSTC3_CUSTOMTEXT   0x63
+#define OSTC3_DIVE         0x66
+#define OSTC3_IDENTITY     0x69
+#define OSTC3_HARDWARE     0x6A
+#define OSTC3_COMPACT      0x6D
+#define OSTC3_DISPLAY      0x6E
+#define OSTC3_INIT         0xBB
+#define OSTC3_EXIT         0xFF
+#define OSTC3_MODEL        0x0A
+
+// Shearwater Predator
+#define SHEARWATER_SZ_PACKET 254
+#define SHEARWATER_SZ_BLOCK  0xEA
+#define SHEARWATER_BASE      0xDD000000
+#define SHEARWATER_END     0xC0
+#define SHEARWATER_ESC     0xDB
+#define SHEARWATER_ESC_END 0xDC
+#define SHEARWATER_ESC_ESC 0xDD
+#define SHEARWATER_CMD_INIT  0x35
+#define SHEARWATER_CMD_BLOCK 0x36
+#define SHEARWATER_CMD_QUIT  0x37
+
+typedef enum dc_simulator_state_t {
+	STATE_OPEN,
+	STATE_DOWNLOAD,
+	STATE_SERVICE,
+} dc_simulator_state_t;
+
+typedef struct dc_simulator_pending_t {
+	size_t end;
+	dc_usecs_t due;
+} dc_simulator_pending_t;
+
+// Process the received data, and return the number of bytes consumed,
+// or zero if more data is needed.
+typedef unsigned int (*dc_simulator_process_t) (dc_simulator_t *simulator, const unsigned char data[], unsigned int size);
+
+struct dc_simulator_t {
+	dc_context_t *context;
+	dc_family_t family;
+	dc_simulator_process_t process;
+	unsigned char *memory;
+	unsigned int size;
+	unsigned char version[SZ_VERSION];
+	unsigned int vsize;
+	unsigned int packet_latency;
+	unsigned int byte_latency;
+	dc_mutex_t mutex;
+	int master;
+	int slave;
+	int wakeup[2];
+	char *name;
+	dc_thread_t thread;
+	dc_timer_t *timer;
+	/* Received data, which isn't processed yet. */
+	dc_buffer_t *input;
+	/* Responses, which aren't transmitted yet. */
+	dc_buffer_t *output;
+	size_t nwritten;
+	dc_simulator_pending_t pending[MAXPENDING];
+	unsigned int npending;
+	dc_usecs_t arrival;
+	dc_usecs_t finish;
+	/* Protocol state. */
+	dc_simulator_state_t state;
+	unsigned int command;
+	unsigned int address;
+};
+
+#ifdef HAVE_SIMULATOR
+static const unsigned char oceanic_atom2_version[OCEANIC_PAGESIZE] = "OCE VT3 R01 512K";
+static const unsigned char suunto_d9_version[4] = {0x0E, 0x01, 0x02, 0x03};
+static const unsigned char suunto_vyper2_version[4] = {0x10, 0x01, 0x02, 0x03};
+static const unsigned char hw_ostc3_version[4] = {0xD2, 0x04, 0x02, 0x00};
+static const unsigned char hw_ostc3_hardware[OSTC3_SZ_HARDWARE2] = {0x00, OSTC3_MODEL, 0x00, 0x00, 0x00};
+
+static unsigned int dc_simulator_oceanic_atom2 (dc_simulator_t *simulator, const unsigned char data[], unsigned int size);
+static unsigned int dc_simulator_suunto_common2 (dc_simulator_t *simulator, const unsigned char data[], unsigned int size);
+static unsigned int dc_simulator_hw_ostc3 (dc_simulator_t *simulator, const unsigned char data[], unsigned int size);
+static unsigned int dc_simulator_shearwater_predator (dc_simulator_t *simulator, const unsigned char data[], unsigned int size);
+
+static void
+dc_simulator_respond (dc_simulator_t *simulator, const unsigned char data[], unsigned int size)
+{
+	// The response becomes available after the packet latency, but is
+	// transmitted only after the previous response.
+	dc_usecs_t start = simulator->arrival + simulator->packet_latency;
+	if (start < simulator->finish)
+		start = simulator->finish;
+	simulator->finish = start + (dc_usecs_t) size * simulator->byte_latency;
+
+	if (!dc_buffer_append (simulator->output, data, size)) {
+		ERROR (simulator->context, "Failed to allocate memory.");
+		return;
+	}
+
+	// When the queue is full, the response is merged with the last one.
+	if (simulator->npending == MAXPENDING)
+		simulator->npending--;
+
+	dc_simulator_pending_t *pending = simulator->pending + simulator->npending++;
+	pending->end = dc_buffer_get_size (simulator->output);
+	pending->due = simulator->finish;
+}
+
+static void
+dc_simulator_read (dc_simulator_t *simulator, unsigned int address, unsigned char data[], unsigned int size)
+{
+	// Reading beyond the end of the memory returns erased memory.
+	unsigned int available = 0;
+	if (address < simulator->size)
+		available = simulator->size - address;
+	if (available > size)
+		available = size;
+
+	memcpy (data, simulator->memory + address, available);
+	memset (data + available, 0xFF, size - available);
+}
+
+static void
+dc_simulator_write (dc_simulator_t *simulator, unsigned int address, const unsigned char data[], unsigned int size)
+{
+	if (address >= simulator->size)
+		return;
+
+	if (size > simulator->size - address)
+		size = simulator->size - address;
+
+	memcpy (simulator->memory + address, data, size);
+}
+
+static unsigned int
+dc_simulator_oceanic_atom2 (dc_simulator_t *simulator, const unsigned char data[], unsigned int size)
+{
+	unsigned char answer[1 + 16 * OCEANIC_PAGESIZE + 2] = {0};
+
+	if (simulator->command == OCEANIC_CMD_WRITE) {
+		// Receive the page, with the checksum and a padding byte.
+		if (size < OCEANIC_PAGESIZE + 2)
+			return 0;
+
+		answer[0] = OCEANIC_NAK;
+		if (data[OCEANIC_PAGESIZE] == checksum_add_uint8 (data, OCEANIC_PAGESIZE, 0x00)) {
+			dc_simulator_write (simulator, simulator->address, data, OCEANIC_PAGESIZE);
+			answer[0] = OCEANIC_ACK;
+		}
+
+		dc_simulator_respond (simulator, answer, 1);
+		simulator->command = 0;
+		return OCEANIC_PAGESIZE + 2;
+	}
+
+	unsigned int npages = 0;
+	switch (data[0]) {
+	case OCEANIC_CMD_VERSION:
+		if (size < 2)
+			return 0;
+		answer[0] = OCEANIC_ACK;
+		memcpy (answer + 1, simulator->version, OCEANIC_PAGESIZE);
+		answer[1 + OCEANIC_PAGESIZE] = checksum_add_uint8 (answer + 1, OCEANIC_PAGESIZE, 0x00);
+		dc_simulator_respond (simulator, answer, 1 + OCEANIC_PAGESIZE + 1);
+		return 2;
+	case OCEANIC_CMD_READ1:
+	case OCEANIC_CMD_READ8:
+	case OCEANIC_CMD_READ16:
+		if (size < 4)
+			return 0;
+		npages = (data[0] == OCEANIC_CMD_READ1 ? 1 : (data[0] == OCEANIC_CMD_READ8 ? 8 : 16));
+		answer[0] = OCEANIC_ACK;
+		dc_simulator_read (simulator, array_uint16_be (data + 1) * OCEANIC_PAGESIZE, answer + 1, npages * OCEANIC_PAGESIZE);
+		if (npages == 16) {
+			// The big pages have a 16 bit checksum.
+			unsigned short crc = checksum_add_uint16 (answer + 1, npages * OCEANIC_PAGESIZE, 0x0000);
+			answer[1 + npages * OCEANIC_PAGESIZE + 0] = (crc     ) & 0xFF;
+			answer[1 + npages * OCEANIC_PAGESIZE + 1] = (crc >> 8) & 0xFF;
+			dc_simulator_respond (simulator, answer, 1 + npages * OCEANIC_PAGESIZE + 2);
+		} else {
+			answer[1 + npages * OCEANIC_PAGESIZE] = checksum_add_uint8 (answer + 1, npages * OCEANIC_PAGESIZE, 0x00);
+			dc_simulator_respond (simulator, answer, 1 + npages * OCEANIC_PAGESIZE + 1);
+		}
+		return 4;
+	case OCEANIC_CMD_WRITE:
+		if (size < 4)
+			return 0;
+		simulator->command = OCEANIC_CMD_WRITE;
+		simulator->address = array_uint16_be (data + 1) * OCEANIC_PAGESIZE;
+		answer[0] = OCEANIC_ACK;
+		dc_simulator_respond (simulator, answer, 1);
+		return 4;
+	case OCEANIC_CMD_KEEPALIVE:
+	case OCEANIC_CMD_QUIT:
+		if (size < 4)
+			return 0;
+		answer[0] = (data[0] == OCEANIC_CMD_QUIT ? OCEANIC_NAK : OCEANIC_ACK);
+		dc_simulator_respond (simulator, answer, 1);
+		return 4;
+	default:
+		// Unknown data is ignored.
+		return 1;
+	}
+}
+
+static unsigned int
+dc_simulator_suunto_common2 (dc_simulator_t *simulator, const unsigned char data[], unsigned int size)
+{
+	unsigned char answer[SUUNTO_SZ_PACKET + 7] = {0};
+
+	if (size < 3)
+		return 0;
+
+	// The header contains the length of the parameters.
+	unsigned int length = 3 + array_uint16_be (data + 1) + 1;
+	if (length > sizeof (answer))
+		return 1;
+	if (size < length)
+		return 0;
+
+	// Commands with an invalid checksum are ignored.
+	if (data[length - 1] != checksum_xor_uint8 (data, length - 1, 0x00))
+		return length;
+
+	unsigned int n = 0;
+	switch (data[0]) {
+	case SUUNTO_CMD_VERSION:
+		answer[n++] = data[0];
+		answer[n++] = 0x00;
+		answer[n++] = 0x04;
+		memcpy (answer + n, simulator->version, 4);
+		n += 4;
+		break;
+	case SUUNTO_CMD_READ:
+		if (length != 7)
+			return length;
+		answer[n++] = data[0];
+		answer[n++] = ((data[5] + 3) >> 8) & 0xFF;
+		answer[n++] = ((data[5] + 3)     ) & 0xFF;
+		memcpy (answer + n, data + 3, 3);
+		n += 3;
+		dc_simulator_read (simulator, array_uint16_be (data + 3), answer + n, data[5]);
+		n += data[5];
+		break;
+	case SUUNTO_CMD_WRITE:
+		if (length != 7U + data[5])
+			return length;
+		dc_simulator_write (simulator, array_uint16_be (data + 3), data + 6, data[5]);
+		answer[n++] = data[0];
+		answer[n++] = 0x00;
+		answer[n++] = 0x03;
+		memcpy (answer + n, data + 3, 3);
+		n += 3;
+		break;
+	case SUUNTO_CMD_RESET:
+		answer[n++] = data[0];
+		answer[n++] = 0x00;
+		answer[n++] = 0x00;
+		break;
+	default:
+		return length;
+	}
+
+	answer[n] = checksum_xor_uint8 (answer, n, 0x00);
+	n++;
+
+	// The D9 interface echoes the command.
+	if (simulator->family == DC_FAMILY_SUUNTO_D9)
+		dc_simulator_respond (simulator, data, length);
+
+	dc_simulator_respond (simulator, answer, n);
+
+	return length;
+}
+
+static void
+dc_simulator_hw_ostc3_dive (dc_simulator_t *simulator, unsigned int idx)
+{
+	unsigned char header[OSTC3_SZ_HEADER] = {0};
+	dc_simulator_read (simulator, idx * OSTC3_SZ_HEADER, header, sizeof (header));
+	dc_simulator_respond (simulator, header, sizeof (header));
+
+	// The profile is stored in the ringbuffer, at the begin address in
+	// the header. The length in the header includes the 3 byte length
+	// field itself, which is not transmitted.
+	unsigned int address = array_uint24_le (header + 2);
+	unsigned int length = array_uint24_le (header + 9);
+	if (length < 3 || length - 3 > OSTC3_RB_PROFILE_END - OSTC3_RB_PROFILE_BEGIN ||
+		address < OSTC3_RB_PROFILE_BEGIN || address >= OSTC3_RB_PROFILE_END)
+		return;
+
+	unsigned char *profile = (unsigned char *) malloc (length - 3);
+	if (profile == NULL) {
+		ERROR (simulator->context, "Failed to allocate memory.");
+		return;
+	}
+
+	unsigned int nbytes = 0;
+	while (nbytes < length - 3) {
+		unsigned int len = OSTC3_RB_PROFILE_END - address;
+		if (len > length - 3 - nbytes)
+			len = length - 3 - nbytes;
+
+		dc_simulator_read (simulator, address, profile + nbytes, len);
+
+		nbytes += len;
+		address += len;
+		if (address == OSTC3_RB_PROFILE_END)
+			address = OSTC3_RB_PROFILE_BEGIN;
+	}
+
+	dc_simulator_respond (simulator, profile, length - 3);
+
+	free (profile);
+}
+
+static void
+dc_simulator_hw_ostc3_compact (dc_simulator_t *simulator)
+{
+	unsigned char compact[OSTC3_SZ_COMPACT * OSTC3_RB_LOGBOOK_COUNT] = {0};
+
+	// The compact headers contain the profile length, date, maximum
+	// depth, divetime, dive number and profile version of the full
+	// headers.
+	for (unsigned int i = 0; i < OSTC3_RB_LOGBOOK_COUNT; ++i) {
+		unsigned char header[OSTC3_SZ_HEADER] = {0};
+		dc_simulator_read (simulator, i * OSTC3_SZ_HEADER, header, sizeof (header));
+
+		unsigned char *p = compact + i * OSTC3_SZ_COMPACT;
+		memcpy (p + 0, header + 9, 3);
+		memcpy (p + 3, header + 12, 5);
+		memcpy (p + 8, header + 17, 2);
+		memcpy (p + 10, header + 19, 3);
+		memcpy (p + 13, header + 80, 2);
+		p[15] = header[8];
+	}
+
+	dc_simulator_respond (simulator, compact, sizeof (compact));
+}
+
+static unsigned int
+dc_simulator_hw_ostc3 (dc_simulator_t *simulator, const unsigned char data[], unsigned int size)
+{
+	static const unsigned char service[] = {0xAA, 0xAB, 0xCD, 0xEF};
+	unsigned char ready[1] = {simulator->state == STATE_SERVICE ? OSTC3_S_READY : OSTC3_READY};
+	unsigned char answer[5] = {0};
+
+	if (simulator->command) {
+		// Receive the input data of the command.
+		unsigned int isize = 0;
+		switch (simulator->command) {
+		case OSTC3_DIVE:
+			isize = 1;
+			break;
+		case OSTC3_CLOCK:
+		case OSTC3_S_BLOCK_READ:
+			isize = 6;
+			break;
+		case OSTC3_DISPLAY:
+			isize = 16;
+			break;
+		case OSTC3_CUSTOMTEXT:
+			isize = 60;
+			break;
+		}
+		if (size < isize)
+			return 0;
+
+		if (simulator->command == OSTC3_DIVE) {
+			dc_simulator_hw_ostc3_dive (simulator, data[0]);
+		} else if (simulator->command == OSTC3_S_BLOCK_READ) {
+			unsigned int address = array_uint24_be (data + 0);
+			unsigned int length = array_uint24_be (data + 3);
+			unsigned char *block = (unsigned char *) malloc (length ? length : 1);
+			if (block != NULL) {
+				dc_simulator_read (simulator, address, block, length);
+				dc_simulator_respond (simulator, block, length);
+				free (block);
+			} else {
+				ERROR (simulator->context, "Failed to allocate memory.");
+			}
+		}
+
+		dc_simulator_respond (simulator, ready, sizeof (ready));
+		simulator->command = 0;
+		return isize;
+	}
+
+	if (simulator->state == STATE_OPEN) {
+		// Only the commands to enter download or service mode are
+		// accepted, everything else is ignored.
+		if (data[0] == service[0]) {
+			if (size < sizeof (service))
+				return 0;
+			if (memcmp (data, service, sizeof (service)) != 0)
+				return 1;
+			answer[0] = 0x4B;
+			memcpy (answer + 1, service + 1, 3);
+			answer[4] = OSTC3_S_READY;
+			dc_simulator_respond (simulator, answer, 5);
+			simulator->state = STATE_SERVICE;
+			return sizeof (service);
+		} else if (data[0] == OSTC3_INIT) {
+			answer[0] = OSTC3_INIT;
+			answer[1] = OSTC3_READY;
+			dc_simulator_respond (simulator, answer, 2);
+			simulator->state = STATE_DOWNLOAD;
+		}
+		return 1;
+	}
+
+	switch (data[0]) {
+	case OSTC3_EXIT:
+		dc_simulator_respond (simulator, data, 1);
+		simulator->state = STATE_OPEN;
+		return 1;
+	case OSTC3_IDENTITY:
+		dc_simulator_respond (simulator, data, 1);
+		dc_simulator_respond (simulator, simulator->version, SZ_VERSION);
+		break;
+	case OSTC3_HARDWARE2:
+		dc_simulator_respond (simulator, data, 1);
+		dc_simulator_respond (simulator, hw_ostc3_hardware, sizeof (hw_ostc3_hardware));
+		break;
+	case OSTC3_HARDWARE:
+		dc_simulator_respond (simulator, data, 1);
+		dc_simulator_respond (simulator, hw_ostc3_hardware + 1, 1);
+		break;
+	case OSTC3_COMPACT:
+		dc_simulator_respond (simulator, data, 1);
+		dc_simulator_hw_ostc3_compact (simulator);
+		break;
+	case OSTC3_HEADER:
+		if (simulator->size < OSTC3_SZ_HEADER * OSTC3_RB_LOGBOOK_COUNT) {
+			dc_simulator_respond (simulator, ready, sizeof (ready));
+			return 1;
+		}
+		dc_simulator_respond (simulator, data, 1);
+		dc_simulator_respond (simulator, simulator->memory, OSTC3_SZ_HEADER * OSTC3_RB_LOGBOOK_COUNT);
+		break;
+	case OSTC3_S_BLOCK_READ:
+		if (simulator->state != STATE_SERVICE)
+			break;
+		// Fall-through
+	case OSTC3_DIVE:
+	case OSTC3_CLOCK:
+	case OSTC3_DISPLAY:
+	case OSTC3_CUSTOMTEXT:
+		// The input data is sent after the echo.
+		dc_simulator_respond (simulator, data, 1);
+		simulator->command = data[0];
+		return 1;
+	default:
+		// Unsupported commands are answered with the ready byte
+		// instead of the echo.
+		break;
+	}
+
+	dc_simulator_respond (simulator, ready, sizeof (ready));
+
+	return 1;
+}
+
+static void
+dc_simulator_shearwater_respond (dc_simulator_t *simulator, const unsigned char data[], unsigned int size)
+{
+	unsigned char packet[2 * (4 + SHEARWATER_SZ_PACKET) + 1];
+	unsigned int n = 0;
+
+	// The packet header is SLIP encoded together with the payload, but
+	// never contains any special characters itself.
+	packet[n++] = 0x01;
+	packet[n++] = 0xFF;
+	packet[n++] = size + 1;
+	packet[n++] = 0x00;
+	for (unsigned int i = 0; i < size; ++i) {
+		if (data[i] == SHEARWATER_END) {
+			packet[n++] = SHEARWATER_ESC;
+			packet[n++] = SHEARWATER_ESC_END;
+		} else if (data[i] == SHEARWATER_ESC) {
+			packet[n++] = SHEARWATER_ESC;
+			packet[n++] = SHEARWATER_ESC_ESC;
+		} else {
+			packet[n++] = data[i];
+		}
+	}
+	packet[n++] = SHEARWATER_END;
+
+	dc_simulator_respond (simulator, packet, n);
+}
+
+static unsigned int
+dc_simulator_shearwater_predator (dc_simulator_t *simulator, const unsigned char data[], unsigned int size)
+{
+	unsigned char packet[4 + SHEARWATER_SZ_PACKET];
+	unsigned char answer[2 + SHEARWATER_SZ_BLOCK];
+	unsigned int n = 0, i = 0;
+
+	// Decode a complete SLIP packet. Packets that don't fit are dropped.
+	while (i < size && data[i] != SHEARWATER_END) {
+		unsigned char c = data[i++];
+		if (c == SHEARWATER_ESC) {
+			if (i == size)
+				return 0;
+			c = data[i++];
+			if (c == SHEARWATER_ESC_END)
+				c = SHEARWATER_END;
+			else if (c == SHEARWATER_ESC_ESC)
+				c = SHEARWATER_ESC;
+		}
+		if (n < sizeof (packet))
+			packet[n] = c;
+		n++;
+	}
+	if (i == size)
+		return 0;
+
+	// Packets with an invalid header are ignored.
+	if (n < 5 || n > sizeof (packet) ||
+		packet[0] != 0xFF || packet[1] != 0x01 || packet[2] != n - 3 || packet[3] != 0x00)
+		return i + 1;
+
+	const unsigned char *payload = packet + 4;
+	unsigned int length = n - 4;
+
+	switch (payload[0]) {
+	case SHEARWATER_CMD_INIT:
+		// Only uncompressed transfers are supported.
+		if (length != 10 || payload[1] != 0x00)
+			break;
+		simulator->address = array_uint32_be (payload + 3) - SHEARWATER_BASE;
+		simulator->command = array_uint24_be (payload + 7);
+		simulator->state = STATE_DOWNLOAD;
+		answer[0] = 0x75;
+		answer[1] = 0x10;
+		answer[2] = SHEARWATER_SZ_BLOCK;
+		dc_simulator_shearwater_respond (simulator, answer, 3);
+		break;
+	case SHEARWATER_CMD_BLOCK:
+		if (length != 2 || simulator->state != STATE_DOWNLOAD)
+			break;
+		n = (simulator->command < SHEARWATER_SZ_BLOCK ? simulator->command : SHEARWATER_SZ_BLOCK);
+		answer[0] = 0x76;
+		answer[1] = payload[1];
+		dc_simulator_read (simulator, simulator->address, answer + 2, n);
+		dc_simulator_shearwater_respond (simulator, answer, 2 + n);
+		simulator->address += n;
+		simulator->command -= n;
+		break;
+	case SHEARWATER_CMD_QUIT:
+		simulator->state = STATE_OPEN;
+		answer[0] = 0x77;
+		answer[1] = 0x00;
+		dc_simulator_shearwater_respond (simulator, answer, 2);
+		break;
+	default:
+		// Unsupported commands are ignored.
+		break;
+	}
+
+	return i + 1;
+}
+
+static void
+dc_simulator_run (void *userdata)
+{
+	dc_simulator_t *simulator = (dc_simulator_t *) userdata;
+	unsigned char buffer[1024];
+
+	while (1) {
+		dc_usecs_t now = 0;
+		dc_timer_now (simulator->timer, &now);
+
+		// Find the responses which are due for transmission, and the
+		// time until the next one.
+		int timeout = -1;
+		size_t end = simulator->nwritten;
+		for (unsigned int i = 0; i < simulator->npending; ++i) {
+			if (simulator->pending[i].due > now) {
+				timeout = (simulator->pending[i].due - now) / 1000;
+				break;
+			}
+			end = simulator->pending[i].end;
+		}
+
+		struct pollfd fds[2] = {
+			{simulator->wakeup[0], POLLIN, 0},
+			{simulator->master, POLLIN, 0},
+		};
+		if (end > simulator->nwritten)
+			fds[1].events |= POLLOUT;
+
+		if (poll (fds, 2, timeout) < 0) {
+			int errcode = errno;
+			if (errcode == EINTR)
+				continue;
+			SYSERROR (simulator->context, errcode);
+			break;
+		}
+
+		// Stop the simulator.
+		if (fds[0].revents)
+			break;
+
+		if (fds[1].revents & POLLIN) {
+			ssize_t n = read (simulator->master, buffer, sizeof (buffer));
+			if (n < 0) {
+				int errcode = errno;
+				if (errcode != EINTR && errcode != EAGAIN) {
+					SYSERROR (simulator->context, errcode);
+					break;
+				}
+			} else if (n > 0) {
+				dc_timer_now (simulator->timer, &simulator->arrival);
+
+				dc_mutex_lock (&simulator->mutex);
+				dc_buffer_append (simulator->input, buffer, n);
+				const unsigned char *data = dc_buffer_get_data (simulator->input);
+				size_t size = dc_buffer_get_size (simulator->input);
+				size_t offset = 0;
+				while (offset < size) {
+					unsigned int len = simulator->process (simulator, data + offset, size - offset);
+					if (len == 0)
+						break;
+					offset += len;
+				}
+				dc_buffer_slice (simulator->input, offset, size - offset);
+				dc_mutex_unlock (&simulator->mutex);
+			}
+		}
+
+		if ((fds[1].revents & POLLOUT) && end > simulator->nwritten) {
+			const unsigned char *data = dc_buffer_get_data (simulator->output);
+			ssize_t n = write (simulator->master, data + simulator->nwritten, end - simulator->nwritten);
+			if (n < 0) {
+				int errcode = errno;
+				if (errcode != EINTR && errcode != EAGAIN) {
+					SYSERROR (simulator->context, errcode);
+					break;
+				}
+			} else {
+				simulator->nwritten += n;
+
+				// Remove the responses which are transmitted.
+				unsigned int ndone = 0;
+				while (ndone < simulator->npending && simulator->pending[ndone].end <= simulator->nwritten)
+					ndone++;
+				memmove (simulator->pending, simulator->pending + ndone, (simulator->npending - ndone) * sizeof (simulator->pending[0]));
+				simulator->npending -= ndone;
+
+				if (simulator->npending == 0) {
+					dc_buffer_clear (simulator->output);
+					simulator->nwritten = 0;
+				}
+			}
+		}
+	}
+}
+#endif
+
+dc_status_t
+dc_simulator_new (dc_simulator_t **out, dc_context_t *context, dc_family_t family, const unsigned char data[], unsigned int size)
+{
+#ifdef HAVE_SIMULATOR
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_simulator_t *simulator = NULL;
+
+	if (out == NULL || (data == NULL && size))
+		return DC_STATUS_INVALIDARGS;
+
+	dc_simulator_process_t process = NULL;
+	const unsigned char *version = NULL;
+	unsigned int vsize = 0;
+	switch (family) {
+	case DC_FAMILY_OCEANIC_ATOM2:
+		process = dc_simulator_oceanic_atom2;
+		version = oceanic_atom2_version;
+		vsize = sizeof (oceanic_atom2_version);
+		break;
+	case DC_FAMILY_SUUNTO_VYPER2:
+		process = dc_simulator_suunto_common2;
+		version = suunto_vyper2_version;
+		vsize = sizeof (suunto_vyper2_version);
+		break;
+	case DC_FAMILY_SUUNTO_D9:
+		process = dc_simulator_suunto_common2;
+		version = suunto_d9_version;
+		vsize = sizeof (suunto_d9_version);
+		break;
+	case DC_FAMILY_HW_OSTC3:
+		process = dc_simulator_hw_ostc3;
+		version = hw_ostc3_version;
+		vsize = SZ_VERSION;
+		break;
+	case DC_FAMILY_SHEARWATER_PREDATOR:
+		// There is no version command.
+		process = dc_simulator_shearwater_predator;
+		break;
+	default:
+		ERROR (context, "Unsupported device family.");
+		return DC_STATUS_UNSUPPORTED;
+	}
+
+	simulator = (dc_simulator_t *) malloc (sizeof (dc_simulator_t));
+	if (simulator == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	memset (simulator, 0, sizeof (dc_simulator_t));
+	simulator->context = context;
+	simulator->family = family;
+	simulator->process = process;
+	simulator->size = size;
+	simulator->vsize = vsize;
+	simulator->state = STATE_OPEN;
+	simulator->master = -1;
+	simulator->slave = -1;
+	simulator->wakeup[0] = -1;
+	simulator->wakeup[1] = -1;
+
+	// The OSTC3 identity block is padded with spaces.
+	if (family == DC_FAMILY_HW_OSTC3)
+		memset (simulator->version, 0x20, sizeof (simulator->version));
+	if (version != NULL)
+		memcpy (simulator->version, version, family == DC_FAMILY_HW_OSTC3 ? sizeof (hw_ostc3_version) : vsize);
+
+	// Copy the memory image.
+	simulator->memory = (unsigned char *) malloc (size ? size : 1);
+	simulator->input = dc_buffer_new (0);
+	simulator->output = dc_buffer_new (0);
+	if (simulator->memory == NULL || simulator->input == NULL || simulator->output == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_free;
+	}
+
+	if (size)
+		memcpy (simulator->memory, data, size);
+
+	status = dc_timer_new (&simulator->timer);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create a high resolution timer.");
+		goto error_free;
+	}
+
+	status = dc_mutex_init (&simulator->mutex);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create the mutex.");
+		goto error_timer_free;
+	}
+
+	// Create the pseudo terminal.
+	simulator->master = posix_openpt (O_RDWR | O_NOCTTY);
+	if (simulator->master == -1 ||
+		grantpt (simulator->master) != 0 ||
+		unlockpt (simulator->master) != 0) {
+		SYSERROR (context, errno);
+		status = DC_STATUS_IO;
+		goto error_close;
+	}
+
+	const char *name = ptsname (simulator->master);
+	simulator->name = name ? strdup (name) : NULL;
+	if (simulator->name == NULL) {
+		ERROR (context, "Failed to get the name of the pseudo terminal.");
+		status = DC_STATUS_IO;
+		goto error_close;
+	}
+
+	// Keep the slave side open, to avoid a hangup whenever the device
+	// is closed. It's also put into raw mode, to avoid echoing the
+	// responses before the device is configured.
+	simulator->slave = open (simulator->name, O_RDWR | O_NOCTTY);
+	if (simulator->slave == -1) {
+		SYSERROR (context, errno);
+		status = DC_STATUS_IO;
+		goto error_close;
+	}
+
+	struct termios tty;
+	if (tcgetattr (simulator->slave, &tty) == 0) {
+		cfmakeraw (&tty);
+		tcsetattr (simulator->slave, TCSANOW, &tty);
+	}
+
+	if (fcntl (simulator->master, F_SETFL, O_NONBLOCK) != 0 ||
+		pipe (simulator->wakeup) != 0) {
+		SYSERROR (context, errno);
+		status = DC_STATUS_IO;
+		goto error_close;
+	}
+
+	status = dc_thread_create (&simulator->thread, dc_simulator_run, simulator);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create the simulator thread.");
+		goto error_close;
+	}
+
+	INFO (context, "Simulator: family=%08x, name=%s", family, simulator->name);
+
+	*out = simulator;
+
+	return DC_STATUS_SUCCESS;
+
+error_close:
+	if (simulator->wakeup[0] != -1)
+		close (simulator->wakeup[0]);
+	if (simulator->wakeup[1] != -1)
+		close (simulator->wakeup[1]);
+	if (simulator->slave != -1)
+		close (simulator->slave);
+	if (simulator->master != -1)
+		close (simulator->master);
+	free (simulator->name);
+	dc_mutex_free (&simulator->mutex);
+error_timer_free:
+	dc_timer_free (simulator->timer);
+error_free:
+	dc_buffer_free (simulator->output);
+	dc_buffer_free (simulator->input);
+	free (simulator->memory);
+	free (simulator);
+	return status;
+#else
+	ERROR (context, "The simulator requires pseudo terminal support.");
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+dc_status_t
+dc_simulator_set_version (dc_simulator_t *simulator, const unsigned char data[], unsigned int size)
+{
+	if (simulator == NULL || data == NULL || size != simulator->vsize)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_mutex_lock (&simulator->mutex);
+	memcpy (simulator->version, data, size);
+	dc_mutex_unlock (&simulator->mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_simulator_set_latency (dc_simulator_t *simulator, unsigned int packet_latency, unsigned int byte_latency)
+{
+	if (simulator == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_mutex_lock (&simulator->mutex);
+	simulator->packet_latency = packet_latency;
+	simulator->byte_latency = byte_latency;
+	dc_mutex_unlock (&simulator->mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+const char *
+dc_simulator_get_name (dc_simulator_t *simulator)
+{
+	if (simulator == NULL)
+		return NULL;
+
+	return simulator->name;
+}
+
+void
+dc_simulator_free (dc_simulator_t *simulator)
+{
+#ifdef HAVE_SIMULATOR
+	if (simulator == NULL)
+		return;
+
+	// Stop the simulator thread.
+	const unsigned char stop = 0;
+	if (write (simulator->wakeup[1], &stop, sizeof (stop)) == sizeof (stop))
+		dc_thread_join (&simulator->thread);
+
+	close (simulator->wakeup[0]);
+	close (simulator->wakeup[1]);
+	close (simulator->slave);
+	close (simulator->master);
+	free (simulator->name);
+	dc_mutex_free (&simulator->mutex);
+	dc_timer_free (simulator->timer);
+	dc_buffer_free (simulator->output);
+	dc_buffer_free (simulator->input);
+	free (simulator->memory);
+	free (simulator);
+#endif
+}
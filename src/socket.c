@@ -24,6 +24,8 @@
 #include "common-private.h"
 #include "context-private.h"
 
+#define MAXIOV 16
+
 dc_status_t
 dc_socket_syserror (s_errcode_t errcode)
 {
@@ -333,6 +335,91 @@ out:
 	return status;
 }
 
+dc_status_t
+dc_socket_writev (dc_iostream_t *abstract, const dc_iovec_t iov[], size_t count, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_socket_t *socket = (dc_socket_t *) abstract;
+	size_t nbytes = 0, size = 0;
+
+	for (size_t i = 0; i < count; ++i) {
+		size += iov[i].size;
+	}
+
+	// Skip the empty buffers at the start.
+	size_t index = 0, offset = 0;
+	dc_iovec_advance (iov, count, &index, &offset, 0);
+
+	while (index < count) {
+		fd_set fds;
+		FD_ZERO (&fds);
+		FD_SET (socket->fd, &fds);
+
+		int rc = select (socket->fd + 1, NULL, &fds, NULL, NULL);
+		if (rc < 0) {
+			s_errcode_t errcode = S_ERRNO;
+			if (errcode == S_EINTR)
+				continue; // Retry.
+			SYSERROR (abstract->context, errcode);
+			status = dc_socket_syserror(errcode);
+			goto out;
+		} else if (rc == 0) {
+			break; // Timeout.
+		}
+
+		// Resume at the current position.
+#ifdef _WIN32
+		WSABUF vec[MAXIOV];
+#else
+		struct iovec vec[MAXIOV];
+#endif
+		unsigned int nvec = 0;
+		for (size_t i = index; i < count && nvec < MAXIOV; ++i) {
+			size_t skip = (i == index ? offset : 0);
+#ifdef _WIN32
+			vec[nvec].buf = (char *) iov[i].data + skip;
+			vec[nvec].len = iov[i].size - skip;
+#else
+			vec[nvec].iov_base = (char *) iov[i].data + skip;
+			vec[nvec].iov_len = iov[i].size - skip;
+#endif
+			nvec++;
+		}
+
+#ifdef _WIN32
+		DWORD sent = 0;
+		s_ssize_t n = WSASend (socket->fd, vec, nvec, &sent, 0, NULL, NULL);
+		if (n == 0)
+			n = sent;
+#else
+		s_ssize_t n = writev (socket->fd, vec, nvec);
+#endif
+		if (n < 0) {
+			s_errcode_t errcode = S_ERRNO;
+			if (errcode == S_EINTR || errcode == S_EAGAIN)
+				continue; // Retry.
+			SYSERROR (abstract->context, errcode);
+			status = dc_socket_syserror(errcode);
+			goto out;
+		} else if (n == 0) {
+			break; // EOF.
+		}
+
+		nbytes += n;
+		dc_iovec_advance (iov, count, &index, &offset, n);
+	}
+
+	if (nbytes != size) {
+		status = DC_STATUS_TIMEOUT;
+	}
+
+out:
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
 dc_status_t
 dc_socket_flush (dc_iostream_t *abstract)
 {
@@ -33,6 +33,7 @@
 #include <sys/socket.h> // socket, getsockopt
 #include <sys/select.h> // select
 #include <sys/ioctl.h>  // ioctl
+#include <sys/uio.h>    // struct iovec
 #include <sys/time.h>
 #endif
 
@@ -131,6 +132,9 @@ dc_socket_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actual
 dc_status_t
 dc_socket_write (dc_iostream_t *iostream, const void *data, size_t size, size_t *actual);
 
+dc_status_t
+dc_socket_writev (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual);
+
 dc_status_t
 dc_socket_flush (dc_iostream_t *iostream);
 
@@ -76,6 +76,8 @@ suunto_common2_transfer (dc_device_t *abstract, const unsigned char command[], u
 		// Abort if the maximum number of retries is reached.
 		if (nretries++ >= MAXRETRIES)
 			return rc;
+
+		device_stats_retry (abstract);
 	}
 
 	return rc;
@@ -20,7 +20,7 @@
  */
 
 #include <stdlib.h>
-#include <string.h>	// memcmp, strdup
+#include <string.h>	// memcmp
 #include <stdio.h>	// snprintf
 
 #include "suunto_d9.h"
@@ -103,6 +103,7 @@ static const dc_parser_vtable_t suunto_d9_parser_vtable = {
 	suunto_d9_parser_get_datetime, /* datetime */
 	suunto_d9_parser_get_field, /* fields */
 	suunto_d9_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_decode */
 	NULL /* destroy */
 };
 
@@ -404,7 +405,9 @@ suunto_d9_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigne
 			default:
 				return DC_STATUS_UNSUPPORTED;
 			}
-			string->value = strdup(buf);
+			string->value = dc_arena_strdup (&abstract->arena, buf);
+			if (string->value == NULL)
+				return DC_STATUS_NOMEMORY;
 			break;
 		default:
 			return DC_STATUS_UNSUPPORTED;
@@ -93,6 +93,8 @@ suunto_eon_device_open (dc_device_t **out, dc_context_t *context, const char *na
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (1200 8N2).
 	status = dc_iostream_configure (device->iostream, 1200, 8, DC_PARITY_NONE, DC_STOPBITS_TWO, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -240,6 +242,8 @@ suunto_eon_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 	}
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
+	device_image_set_memory (abstract, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+
 	rc = suunto_common_extract_dives (device, &suunto_eon_layout, data, callback, userdata);
 
 	dc_buffer_free (buffer);
@@ -34,6 +34,14 @@
 #define EONSTEEL 0
 #define EONCORE  1
 
+#define ISINSTANCE(device) dc_device_isinstance((device), &suunto_eonsteel_device_vtable)
+
+// The number of BLE GATT packets to transfer at once
+#define MAXPACKETS 16
+
+// The maximum number of outstanding file read requests
+#define MAXREADS 4
+
 typedef struct suunto_eonsteel_device_t {
 	dc_device_t base;
 	unsigned int model;
@@ -41,6 +49,12 @@ typedef struct suunto_eonsteel_device_t {
 	unsigned short seq;
 	unsigned char version[0x30];
 	unsigned char fingerprint[4];
+	// Number of file read requests to send ahead.
+	unsigned int window;
+	// BLE GATT packets that are received, but not processed yet.
+	unsigned char packets[MAXPACKETS][32];
+	size_t sizes[MAXPACKETS];
+	unsigned int npackets, ipacket;
 } suunto_eonsteel_device_t;
 
 // The EON Steel implements a small filesystem
@@ -50,6 +64,7 @@ typedef struct suunto_eonsteel_device_t {
 struct directory_entry {
 	struct directory_entry *next;
 	int type;
+	unsigned int time;
 	int namelen;
 	char name[1];
 };
@@ -114,6 +129,9 @@ static struct directory_entry *alloc_dirent(int type, int len, const char *name)
 		res->namelen = len;
 		memcpy(res->name, name, len);
 		res->name[len] = 0;
+		/* The dive files are named after their timestamp */
+		if (type != DIRTYPE_FILE || sscanf(res->name, "%x.LOG", &res->time) != 1)
+			res->time = 0;
 	}
 	return res;
 }
@@ -184,16 +202,38 @@ static int fill_ble_buffer(dc_custom_io_t *io, suunto_eonsteel_device_t *eon, un
 	unsigned int crc;
 
 	for (;;) {
-		unsigned char packet[32];
-		dc_status_t rc = DC_STATUS_SUCCESS;
+		unsigned char *packet;
 		size_t transferred = 0;
 		int i;
 
-		rc = io->packet_read(io, packet, sizeof(packet), &transferred);
-		if (rc != DC_STATUS_SUCCESS) {
-			ERROR(eon->base.context, "BLE GATT read transfer failed");
-			return -1;
+		// Read all packets that are available at once. The packets
+		// following the end of the stream are kept for the next call.
+		if (eon->ipacket == eon->npackets) {
+			dc_custom_packet_t packets[MAXPACKETS];
+			dc_status_t rc = DC_STATUS_SUCCESS;
+			size_t npackets = 0;
+
+			for (i = 0; i < MAXPACKETS; i++) {
+				packets[i].data = eon->packets[i];
+				packets[i].size = sizeof(eon->packets[i]);
+			}
+
+			rc = dc_custom_io_packet_read_multi(eon->base.context, packets, MAXPACKETS, &npackets);
+			if (rc != DC_STATUS_SUCCESS || npackets == 0) {
+				ERROR(eon->base.context, "BLE GATT read transfer failed");
+				return -1;
+			}
+
+			for (i = 0; i < npackets; i++)
+				eon->sizes[i] = packets[i].size;
+			eon->npackets = npackets;
+			eon->ipacket = 0;
 		}
+
+		packet = eon->packets[eon->ipacket];
+		transferred = eon->sizes[eon->ipacket];
+		eon->ipacket++;
+
 		for (i = 0; i < transferred; i++) {
 			unsigned char c = packet[i];
 
@@ -378,18 +418,28 @@ static int send_cmd(suunto_eonsteel_device_t *eon,
 
 		hdlc_len = hdlc_reencode(hdlc, buf+2, buf[1]);
 
+		// Split the stream into packets, and send them at once.
+		dc_custom_packet_t packets[sizeof(hdlc) / 20 + 1];
+		size_t npackets = 0;
+
 		ptr = hdlc;
 		do {
 			int len = hdlc_len;
 
 			if (len > io->packet_size)
 				len = io->packet_size;
-			rc = io->packet_write(io, ptr, len, &transferred);
-			if (rc != DC_STATUS_SUCCESS)
-				break;
+			packets[npackets].data = ptr;
+			packets[npackets].size = len;
+			npackets++;
 			ptr += len;
 			hdlc_len -= len;
-		} while (hdlc_len);
+		} while (hdlc_len && npackets < sizeof(packets) / sizeof(packets[0]));
+
+		rc = dc_custom_io_packet_write_multi(eon->base.context, packets, npackets, &transferred);
+		if (rc == DC_STATUS_SUCCESS && hdlc_len) {
+			ERROR(eon->base.context, "BLE GATT packet size too small (%d)", io->packet_size);
+			rc = DC_STATUS_PROTOCOL;
+		}
 	} else {
 		rc = io->packet_write(io, buf, sizeof(buf), &transferred);
 	}
@@ -478,21 +528,36 @@ static int receive_data(suunto_eonsteel_device_t *eon, unsigned char *buffer, in
  * send_cmd() side. The offsets are the same in the actual raw
  * packet.
  */
-static int send_receive(suunto_eonsteel_device_t *eon,
-	unsigned short cmd,
-	unsigned int len_out, const unsigned char *out,
+static int receive_reply(suunto_eonsteel_device_t *eon,
+	unsigned short cmd, unsigned short seq,
 	unsigned int len_in, unsigned char *in)
 {
 	int len, actual;
 	struct eon_hdr hdr;
 
-	if (send_cmd(eon, cmd, len_out, out) < 0)
-		return -1;
+	for (;;) {
+		/* Get the header and the first part of the data */
+		len = receive_header(eon, &hdr, in, len_in);
+		if (len < 0)
+			return -1;
 
-	/* Get the header and the first part of the data */
-	len = receive_header(eon, &hdr, in, len_in);
-	if (len < 0)
-		return -1;
+		/*
+		 * Replies to requests that were abandoned after an error
+		 * can still arrive late. They have an older sequence
+		 * number, and are simply thrown away.
+		 */
+		if ((short) (seq - hdr.seq) <= 0)
+			break;
+
+		WARNING(eon->base.context, "discarding stale reply (seq %d)", hdr.seq);
+		actual = hdr.len - len;
+		while (actual > 0) {
+			int n = receive_data(eon, in, actual < len_in ? actual : len_in);
+			if (n <= 0)
+				return -1;
+			actual -= n;
+		}
+	}
 
 	/* Verify the header data */
 	if (hdr.cmd != cmd) {
@@ -503,7 +568,7 @@ static int send_receive(suunto_eonsteel_device_t *eon,
 		ERROR(eon->base.context, "command reply doesn't match magic (got %08x, expected %08x)", hdr.magic, eon->magic + 5);
 		return -1;
 	}
-	if (hdr.seq != eon->seq) {
+	if (hdr.seq != seq) {
 		ERROR(eon->base.context, "command reply doesn't match sequence number");
 		return -1;
 	}
@@ -524,57 +589,92 @@ static int send_receive(suunto_eonsteel_device_t *eon,
 		return -1;
 	}
 
+	return len;
+}
+
+static int send_receive(suunto_eonsteel_device_t *eon,
+	unsigned short cmd,
+	unsigned int len_out, const unsigned char *out,
+	unsigned int len_in, unsigned char *in)
+{
+	int len;
+
+	if (send_cmd(eon, cmd, len_out, out) < 0)
+		return -1;
+
+	len = receive_reply(eon, cmd, eon->seq, len_in, in);
+	if (len < 0)
+		return -1;
+
 	// Successful command - increment sequence number
 	eon->seq++;
 	return len;
 }
 
-static int read_file(suunto_eonsteel_device_t *eon, const char *filename, dc_buffer_t *buf)
+dc_status_t
+suunto_eonsteel_device_set_window(dc_device_t *abstract, unsigned int window)
+{
+	suunto_eonsteel_device_t *eon = (suunto_eonsteel_device_t *) abstract;
+
+	if (!ISINSTANCE(abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	if (window == 0 || window > MAXREADS)
+		return DC_STATUS_INVALIDARGS;
+
+	eon->window = window;
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Read the contents of the open file.
+ *
+ * The read requests carry no file offset: the device simply returns the
+ * next part of the file for every request. Since every reply echoes the
+ * sequence number of its request, several requests can be sent ahead
+ * without waiting for the replies, which hides the round-trip latency
+ * of the transport.
+ */
+static int read_file_data(suunto_eonsteel_device_t *eon, const char *filename, unsigned int size, dc_buffer_t *buf)
 {
 	unsigned char result[2560];
 	unsigned char cmdbuf[64];
-	unsigned int size, offset;
-	int rc, len;
+	unsigned short seqs[MAXREADS];
+	unsigned int asks[MAXREADS];
+	unsigned int head = 0, count = 0;
+	unsigned int requested = 0, offset = 0;
+	int eof = 0, rc;
 
 	memset(cmdbuf, 0, sizeof(cmdbuf));
-	len = strlen(filename) + 1;
-	if (len + 4 > sizeof(cmdbuf)) {
-		ERROR(eon->base.context, "too long filename: %s", filename);
-		return -1;
-	}
-	memcpy(cmdbuf+4, filename, len);
-	rc = send_receive(eon, CMD_FILE_OPEN,
-		len+4, cmdbuf,
-		sizeof(result), result);
-	if (rc < 0) {
-		ERROR(eon->base.context, "unable to look up %s", filename);
-		return -1;
-	}
-	HEXDUMP (eon->base.context, DC_LOGLEVEL_DEBUG, "lookup", result, rc);
 
-	rc = send_receive(eon, CMD_FILE_STAT,
-		0, NULL,
-		sizeof(result), result);
-	if (rc < 0) {
-		ERROR(eon->base.context, "unable to stat %s", filename);
-		return -1;
-	}
-	HEXDUMP (eon->base.context, DC_LOGLEVEL_DEBUG, "stat", result, rc);
+	while (offset < size && !eof) {
+		unsigned int ask, got, at;
 
-	size = array_uint32_le(result+4);
-	offset = 0;
+		// Keep the requested number of reads outstanding.
+		while (count < eon->window && requested < size) {
+			unsigned int idx = (head + count) % MAXREADS;
+
+			ask = size - requested;
+			if (ask > 1024)
+				ask = 1024;
+			put_le32(1234, cmdbuf+0);	// Not file offset, after all
+			put_le32(ask, cmdbuf+4);	// Size of read
+			if (send_cmd(eon, CMD_FILE_READ, 8, cmdbuf) < 0) {
+				ERROR(eon->base.context, "unable to read %s", filename);
+				return -1;
+			}
 
-	while (size > 0) {
-		unsigned int ask, got, at;
+			seqs[idx] = eon->seq++;
+			asks[idx] = ask;
+			requested += ask;
+			count++;
+		}
 
-		ask = size;
-		if (ask > 1024)
-			ask = 1024;
-		put_le32(1234, cmdbuf+0);	// Not file offset, after all
-		put_le32(ask, cmdbuf+4);	// Size of read
-		rc = send_receive(eon, CMD_FILE_READ,
-			8, cmdbuf,
-			sizeof(result), result);
+		ask = asks[head];
+		rc = receive_reply(eon, CMD_FILE_READ, seqs[head], sizeof(result), result);
+		head = (head + 1) % MAXREADS;
+		count--;
 		if (rc < 0) {
 			ERROR(eon->base.context, "unable to read %s", filename);
 			return -1;
@@ -593,26 +693,93 @@ static int read_file(suunto_eonsteel_device_t *eon, const char *filename, dc_buf
 
 		// Number of bytes actually read
 		got = array_uint32_le(result+4);
-		if (!got)
-			break;
+		if (!got) {
+			eof = 1;
+			continue;
+		}
 		if (rc < 8 + got) {
 			ERROR(eon->base.context, "odd read size reply for offset %d of file %s", offset, filename);
 			return -1;
 		}
 
-		if (got > size)
-			got = size;
+		if (got > size - offset)
+			got = size - offset;
 		if (!dc_buffer_append (buf, result + 8, got)) {
 			ERROR (eon->base.context, "Insufficient buffer space available.");
 			return -1;
 		}
 		offset += got;
-		size -= got;
+
+		// Request the missing data again after a short read.
+		if (got < ask)
+			requested -= ask - got;
+	}
+
+	// Collect the replies to the requests that are still outstanding.
+	while (count) {
+		rc = receive_reply(eon, CMD_FILE_READ, seqs[head], sizeof(result), result);
+		head = (head + 1) % MAXREADS;
+		count--;
+		if (rc < 0) {
+			ERROR(eon->base.context, "unable to read %s", filename);
+			return -1;
+		}
 	}
 
+	return offset;
+}
+
+static int read_file(suunto_eonsteel_device_t *eon, const char *filename, dc_buffer_t *buf)
+{
+	unsigned char result[2560];
+	unsigned char cmdbuf[64];
+	unsigned int size, start;
+	int rc, len, offset;
+
+	memset(cmdbuf, 0, sizeof(cmdbuf));
+	len = strlen(filename) + 1;
+	if (len + 4 > sizeof(cmdbuf)) {
+		ERROR(eon->base.context, "too long filename: %s", filename);
+		return -1;
+	}
+	memcpy(cmdbuf+4, filename, len);
+	rc = send_receive(eon, CMD_FILE_OPEN,
+		len+4, cmdbuf,
+		sizeof(result), result);
+	if (rc < 0) {
+		ERROR(eon->base.context, "unable to look up %s", filename);
+		return -1;
+	}
+	HEXDUMP (eon->base.context, DC_LOGLEVEL_DEBUG, "lookup", result, rc);
+
+	rc = send_receive(eon, CMD_FILE_STAT,
+		0, NULL,
+		sizeof(result), result);
+	if (rc < 0) {
+		ERROR(eon->base.context, "unable to stat %s", filename);
+		return -1;
+	}
+	HEXDUMP (eon->base.context, DC_LOGLEVEL_DEBUG, "stat", result, rc);
+
+	size = array_uint32_le(result+4);
+	start = dc_buffer_get_size(buf);
+
+	offset = read_file_data(eon, filename, size, buf);
+
 	rc = send_receive(eon, CMD_FILE_CLOSE,
 		0, NULL,
 		sizeof(result), result);
+
+	// If the device fails to keep up with the outstanding read requests,
+	// fall back to a single request at a time, and read the file again.
+	if (offset < 0 && eon->window > 1) {
+		WARNING(eon->base.context, "Disabling the pipelined file reads.");
+		device_stats_retry(&eon->base);
+		eon->window = 1;
+		dc_buffer_resize(buf, start);
+		return read_file(eon, filename, buf);
+	}
+
 	if (rc < 0) {
 		ERROR(eon->base.context, "cmd CMD_FILE_CLOSE failed");
 		return -1;
@@ -626,13 +793,24 @@ static int read_file(suunto_eonsteel_device_t *eon, const char *filename, dc_buf
  * NOTE! This will create the list of dirent's in reverse order,
  * with the last dirent first. That's intentional: for dives,
  * we will want to look up the last dive first.
+ *
+ * The dive files are sorted on the timestamp in their name, and
+ * not on the name itself, because the hexadecimal timestamps do
+ * not necessarily have the same number of digits.
  */
+static int compare_dirent(const struct directory_entry *a, const struct directory_entry *b)
+{
+	if (a->time != b->time)
+		return a->time > b->time ? 1 : -1;
+	return strcmp(a->name, b->name);
+}
+
 static struct directory_entry *add_dirent(struct directory_entry *new, struct directory_entry *list)
 {
 	struct directory_entry **pp = &list, *p;
 
 	/* Skip any entries that are later than the new one */
-	while ((p = *pp) != NULL && strcmp(p->name, new->name) > 0)
+	while ((p = *pp) != NULL && compare_dirent(p, new) > 0)
 		pp = &p->next;
 
 	/* Add the new one to that location and return the new list pointer */
@@ -759,8 +937,11 @@ suunto_eonsteel_device_open(dc_device_t **out, dc_context_t *context, const char
 	eon->model = model;
 	eon->magic = INIT_MAGIC;
 	eon->seq = INIT_SEQ;
+	eon->npackets = 0;
+	eon->ipacket = 0;
 	memset (eon->version, 0, sizeof (eon->version));
 	memset (eon->fingerprint, 0, sizeof (eon->fingerprint));
+	eon->window = 1;
 
 	dc_custom_io_t *io = _dc_context_custom_io(eon->base.context);
 	if (io && io->packet_open)
@@ -828,7 +1009,7 @@ suunto_eonsteel_device_foreach(dc_device_t *abstract, dc_dive_callback_t callbac
 	suunto_eonsteel_device_t *eon = (suunto_eonsteel_device_t *) abstract;
 	dc_buffer_t *file;
 	char pathname[64];
-	unsigned int time;
+	unsigned int last = array_uint32_le(eon->fingerprint);
 	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
 
 	// Emit a device info event.
@@ -872,15 +1053,27 @@ suunto_eonsteel_device_foreach(dc_device_t *abstract, dc_dive_callback_t callbac
 		case DIRTYPE_FILE:
 			if (skip)
 				break;
-			if (sscanf(de->name, "%x.LOG", &time) != 1)
+			if (de->time == 0)
 				break;
+
+			// The dives are sorted newest first, so there is no need to
+			// open any file which is not newer than the fingerprint.
+			if (last && de->time <= last) {
+				skip = 1;
+				break;
+			}
+
 			len = snprintf(pathname, sizeof(pathname), "%s/%s", dive_directory, de->name);
 			if (len >= sizeof(pathname))
 				break;
 
+			// Don't read dives that were already downloaded before.
+			put_le32(de->time, buf);
+			if (device_is_known_dive(abstract, buf, sizeof(buf)))
+				break;
+
 			// Reset the membuffer, put the 4-byte length at the head.
 			dc_buffer_clear(file);
-			put_le32(time, buf);
 			dc_buffer_append(file, buf, 4);
 
 			// Then read the filename into the rest of the buffer
@@ -891,11 +1084,6 @@ suunto_eonsteel_device_foreach(dc_device_t *abstract, dc_dive_callback_t callbac
 			data = dc_buffer_get_data(file);
 			size = dc_buffer_get_size(file);
 
-			if (memcmp (data, eon->fingerprint, sizeof (eon->fingerprint)) == 0) {
-				skip = 1;
-				break;
-			}
-
 			if (callback && !callback(data, size, data, sizeof(eon->fingerprint), userdata))
 				skip = 1;
 		}
@@ -25,6 +25,7 @@
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/device.h>
 #include <libdivecomputer/parser.h>
+#include <libdivecomputer/suunto_eonsteel.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,6 +37,7 @@
 #include "parser-private.h"
 #include "array.h"
 #include "platform.h"
+#include "thread.h"
 
 #define C_ARRAY_SIZE(a) (sizeof(a) / sizeof(*(a)))
 
@@ -81,9 +82,33 @@ struct type_desc {
 #define MAXGASES 16
 #define MAXSTRINGS 32
 
+/*
+ * Every dive contains the full set of type descriptors, but they are
+ * identical for all dives recorded with the same firmware. The parsed
+ * descriptors are therefore interned in a process wide hash table,
+ * keyed by the raw descriptor text, so they only need to be parsed and
+ * allocated once. The interned entries are never freed. Once the table
+ * is full, new descriptors are owned by the parser instead.
+ */
+#define NBUCKETS 256
+#define MAXINTERNED 4096
+
+struct type_entry {
+	struct type_entry *next;
+	unsigned int hash;
+	unsigned int length;
+	const char *text;
+	struct type_desc desc;
+};
+
+static dc_mutex_t type_cache_lock = DC_MUTEX_INITIALIZER;
+static struct type_entry *type_cache[NBUCKETS];
+static unsigned int type_cache_count = 0;
+
 typedef struct suunto_eonsteel_parser_t {
 	dc_parser_t base;
 	struct type_desc type_desc[MAXTYPE];
+	struct type_entry *type_owned[MAXTYPE];
 	// field cache
 	struct {
 		unsigned int initialized;
@@ -281,83 +306,159 @@ static int fill_in_desc_details(suunto_eonsteel_parser_t *eon, struct type_desc
 	return 0;
 }
 
-static void
-desc_free (struct type_desc desc[], unsigned int count)
+static int is_group_desc(const struct type_desc *desc)
 {
-	for (unsigned int i = 0; i < count; ++i) {
-		free((void *)desc[i].desc);
-		free((void *)desc[i].format);
-		free((void *)desc[i].mod);
+	return desc->desc && isdigit(desc->desc[0]);
+}
+
+static unsigned int type_text_hash(const char *text, unsigned int length)
+{
+	// FNV-1a
+	unsigned int hash = 2166136261u;
+	for (unsigned int i = 0; i < length; ++i) {
+		hash ^= (unsigned char) text[i];
+		hash *= 16777619u;
 	}
+	return hash;
 }
 
-static int record_type(suunto_eonsteel_parser_t *eon, unsigned short type, const char *name, int namelen)
+static struct type_entry *type_cache_lookup(const char *text, unsigned int length, unsigned int hash)
 {
-	struct type_desc desc;
-	const char *next;
+	struct type_entry *entry;
+
+	for (entry = type_cache[hash % NBUCKETS]; entry; entry = entry->next) {
+		if (entry->hash == hash && entry->length == length &&
+			!memcmp(entry->text, text, length))
+			return entry;
+	}
+	return NULL;
+}
 
-	memset(&desc, 0, sizeof(desc));
-	do {
-		int len;
-		char *p;
+/*
+ * Parse the raw descriptor text into a new entry. The entry and all its
+ * strings are stored in a single allocation. Group descriptors can only
+ * be resolved against the other descriptors of the same dive, so only
+ * the base types are resolved here.
+ */
+static struct type_entry *parse_type_entry(suunto_eonsteel_parser_t *eon, const char *text, unsigned int length, unsigned int hash)
+{
+	struct type_entry *entry;
+	const char *name = text, *end = text + length;
+	char *buffer;
 
-		next = strchr(name, '\n');
-		if (next) {
-			len = next - name;
-			next++;
-		} else {
-			len = strlen(name);
-			if (!len)
-				break;
-		}
+	entry = (struct type_entry *) malloc(sizeof(*entry) + 2 * (length + 1));
+	if (!entry) {
+		ERROR(eon->base.context, "out of memory");
+		return NULL;
+	}
+	memset(entry, 0, sizeof(*entry));
+	buffer = (char *) (entry + 1);
+	memcpy(buffer, text, length);
+	buffer[length] = 0;
+	entry->text = buffer;
+	entry->length = length;
+	entry->hash = hash;
+	buffer += length + 1;
+
+	while (name < end) {
+		const char *next = (const char *) memchr(name, '\n', end - name);
+		int len = next ? next - name : end - name;
 
 		if (len < 5 || name[0] != '<' || name[4] != '>') {
 			ERROR(eon->base.context, "Unexpected type description: %.*s", len, name);
-			return -1;
+			free(entry);
+			return NULL;
 		}
-		p = (char *) malloc(len-4);
-		if (!p) {
-			ERROR(eon->base.context, "out of memory");
-			desc_free(&desc, 1);
-			return -1;
-		}
-		memcpy(p, name+5, len-5);
-		p[len-5] = 0;
+		memcpy(buffer, name+5, len-5);
+		buffer[len-5] = 0;
 
 		// PTH, GRP, FRM, MOD
 		switch (name[1]) {
 		case 'P':
 		case 'G':
-			desc.desc = p;
+			entry->desc.desc = buffer;
 			break;
 		case 'F':
-			desc.format = p;
+			entry->desc.format = buffer;
 			break;
 		case 'M':
-			desc.mod = p;
+			entry->desc.mod = buffer;
 			break;
 		default:
 			ERROR(eon->base.context, "Unknown type descriptor: %.*s", len, name);
-			desc_free(&desc, 1);
-			free(p);
-			return -1;
+			free(entry);
+			return NULL;
 		}
-	} while ((name = next) != NULL);
+		buffer += len-4;
+
+		if (!next)
+			break;
+		name = next + 1;
+	}
+
+	if (!is_group_desc(&entry->desc))
+		fill_in_desc_details(eon, &entry->desc);
+
+	return entry;
+}
+
+static void
+desc_free (suunto_eonsteel_parser_t *eon)
+{
+	for (unsigned int i = 0; i < MAXTYPE; ++i) {
+		free(eon->type_owned[i]);
+		eon->type_owned[i] = NULL;
+	}
+	memset(eon->type_desc, 0, sizeof(eon->type_desc));
+}
+
+static int record_type(suunto_eonsteel_parser_t *eon, unsigned short type, const char *name, int namelen)
+{
+	struct type_entry *entry, *owned = NULL;
+	unsigned int length = 0, hash;
+
+	// The descriptor text is terminated by a NUL byte.
+	while (length < (unsigned int) namelen && name[length])
+		length++;
 
 	if (type >= MAXTYPE) {
-		ERROR(eon->base.context, "Type out of range (%04x: '%s' '%s' '%s')",
-			type,
-			desc.desc ? desc.desc : "",
-			desc.format ? desc.format : "",
-			desc.mod ? desc.mod : "");
-		desc_free(&desc, 1);
+		ERROR(eon->base.context, "Type out of range (%04x: '%.*s')", type, length, name);
 		return -1;
 	}
 
-	fill_in_desc_details(eon, &desc);
+	hash = type_text_hash(name, length);
 
-	desc_free(eon->type_desc + type, 1);
-	eon->type_desc[type] = desc;
+	dc_mutex_lock(&type_cache_lock);
+	entry = type_cache_lookup(name, length, hash);
+	dc_mutex_unlock(&type_cache_lock);
+
+	if (!entry) {
+		struct type_entry *parsed = parse_type_entry(eon, name, length, hash);
+		if (!parsed)
+			return -1;
+
+		// Another thread may have interned the same text meanwhile.
+		dc_mutex_lock(&type_cache_lock);
+		entry = type_cache_lookup(name, length, hash);
+		if (entry) {
+			free(parsed);
+		} else if (type_cache_count < MAXINTERNED) {
+			parsed->next = type_cache[hash % NBUCKETS];
+			type_cache[hash % NBUCKETS] = parsed;
+			type_cache_count++;
+			entry = parsed;
+		} else {
+			entry = owned = parsed;
+		}
+		dc_mutex_unlock(&type_cache_lock);
+	}
+
+	free(eon->type_owned[type]);
+	eon->type_owned[type] = owned;
+
+	eon->type_desc[type] = entry->desc;
+	if (is_group_desc(&entry->desc))
+		fill_in_desc_details(eon, eon->type_desc + type);
 	return 0;
 }
 
@@ -455,8 +556,7 @@ static int traverse_data(suunto_eonsteel_parser_t *eon, eon_data_cb_t callback,
 
 struct sample_data {
 	suunto_eonsteel_parser_t *eon;
-	dc_sample_callback_t callback;
-	void *userdata;
+	const dc_sample_sink_t *sink;
 	unsigned int time;
 	const char *state_type, *notify_type;
 	const char *warning_type, *alarm_type;
@@ -473,7 +573,7 @@ static void sample_time(struct sample_data *info, unsigned short time_delta)
 
 	info->time += time_delta;
 	sample.time = info->time / 1000;
-	if (info->callback) info->callback(DC_SAMPLE_TIME, sample, info->userdata);
+	dc_sample_sink_emit(info->sink, DC_SAMPLE_TIME, &sample);
 }
 
 static void sample_depth(struct sample_data *info, unsigned short depth)
@@ -484,7 +584,7 @@ static void sample_depth(struct sample_data *info, unsigned short depth)
 		return;
 
 	sample.depth = depth / 100.0;
-	if (info->callback) info->callback(DC_SAMPLE_DEPTH, sample, info->userdata);
+	dc_sample_sink_emit(info->sink, DC_SAMPLE_DEPTH, &sample);
 }
 
 static void sample_temp(struct sample_data *info, short temp)
@@ -495,7 +595,7 @@ static void sample_temp(struct sample_data *info, short temp)
 		return;
 
 	sample.temperature = temp / 10.0;
-	if (info->callback) info->callback(DC_SAMPLE_TEMPERATURE, sample, info->userdata);
+	dc_sample_sink_emit(info->sink, DC_SAMPLE_TEMPERATURE, &sample);
 }
 
 static void sample_ndl(struct sample_data *info, short ndl)
@@ -508,7 +608,7 @@ static void sample_ndl(struct sample_data *info, short ndl)
 
 	sample.deco.type = DC_DECO_NDL;
 	sample.deco.time = ndl;
-	if (info->callback) info->callback(DC_SAMPLE_DECO, sample, info->userdata);
+	dc_sample_sink_emit(info->sink, DC_SAMPLE_DECO, &sample);
 }
 
 static void sample_tts(struct sample_data *info, unsigned short tts)
@@ -532,7 +632,7 @@ static void sample_heading(struct sample_data *info, unsigned short heading)
 
 	sample.event.type = SAMPLE_EVENT_HEADING;
 	sample.event.value = heading;
-	if (info->callback) info->callback(DC_SAMPLE_EVENT, sample, info->userdata);
+	dc_sample_sink_emit(info->sink, DC_SAMPLE_EVENT, &sample);
 }
 
 static void sample_abspressure(struct sample_data *info, unsigned short pressure)
@@ -574,7 +674,7 @@ static void sample_pressure(struct sample_data *info, unsigned short pressure)
 
 	sample.pressure.tank = info->gasnr-1;
 	sample.pressure.value = pressure / 100.0;
-	if (info->callback) info->callback(DC_SAMPLE_PRESSURE, sample, info->userdata);
+	dc_sample_sink_emit(info->sink, DC_SAMPLE_PRESSURE, &sample);
 }
 
 static void sample_bookmark_event(struct sample_data *info, unsigned short idx)
@@ -584,7 +684,7 @@ static void sample_bookmark_event(struct sample_data *info, unsigned short idx)
 	sample.event.type = SAMPLE_EVENT_BOOKMARK;
 	sample.event.value = idx;
 
-	if (info->callback) info->callback(DC_SAMPLE_EVENT, sample, info->userdata);
+	dc_sample_sink_emit(info->sink, DC_SAMPLE_EVENT, &sample);
 }
 
 static void sample_gas_switch_event(struct sample_data *info, unsigned short idx)
@@ -596,7 +696,7 @@ static void sample_gas_switch_event(struct sample_data *info, unsigned short idx
 		return;
 
 	sample.gasmix = idx - 1;
-	if (info->callback) info->callback(DC_SAMPLE_GASMIX, sample, info->userdata);
+	dc_sample_sink_emit(info->sink, DC_SAMPLE_GASMIX, &sample);
 }
 
 /*
@@ -608,7 +708,7 @@ static void sample_gas_switch_event(struct sample_data *info, unsigned short idx
  *
  * "enum:0=NoFly Time,1=Depth,2=Surface Time,3=..."
  */
-static const char *lookup_enum(const struct type_desc *desc, unsigned char value)
+static const char *lookup_enum(suunto_eonsteel_parser_t *eon, const struct type_desc *desc, unsigned char value)
 {
 	const char *str = desc->format;
 	unsigned char c;
@@ -622,7 +722,6 @@ static const char *lookup_enum(const struct type_desc *desc, unsigned char value
 	while ((c = *str) != 0) {
 		unsigned char n;
 		const char *begin, *end;
-		char *ret;
 
 		str++;
 		if (!isdigit(c))
@@ -652,13 +751,7 @@ static const char *lookup_enum(const struct type_desc *desc, unsigned char value
 		if (n != value)
 			continue;
 
-		ret = (char *)malloc(end - begin + 1);
-		if (!ret)
-			break;
-
-		memcpy(ret, begin, end-begin);
-		ret[end-begin] = 0;
-		return ret;
+		return dc_arena_strndup(&eon->base.arena, begin, end-begin);
 	}
 	return NULL;
 }
@@ -669,7 +762,7 @@ static const char *lookup_enum(const struct type_desc *desc, unsigned char value
  */
 static void sample_event_state_type(const struct type_desc *desc, struct sample_data *info, unsigned char type)
 {
-	info->state_type = lookup_enum(desc, type);
+	info->state_type = lookup_enum(info->eon, desc, type);
 }
 
 static void sample_event_state_value(const struct type_desc *desc, struct sample_data *info, unsigned char value)
@@ -686,12 +779,12 @@ static void sample_event_state_value(const struct type_desc *desc, struct sample
 	sample.event.flags = value ? SAMPLE_FLAGS_BEGIN : SAMPLE_FLAGS_END;
 	sample.event.flags |= 1 << SAMPLE_FLAGS_SEVERITY_SHIFT;
 
-	if (info->callback) info->callback(DC_SAMPLE_EVENT, sample, info->userdata);
+	dc_sample_sink_emit(info->sink, DC_SAMPLE_EVENT, &sample);
 }
 
 static void sample_event_notify_type(const struct type_desc *desc, struct sample_data *info, unsigned char type)
 {
-	info->notify_type = lookup_enum(desc, type);
+	info->notify_type = lookup_enum(info->eon, desc, type);
 }
 
 static void sample_event_notify_value(const struct type_desc *desc, struct sample_data *info, unsigned char value)
@@ -708,13 +801,13 @@ static void sample_event_notify_value(const struct type_desc *desc, struct sampl
 	sample.event.flags = value ? SAMPLE_FLAGS_BEGIN : SAMPLE_FLAGS_END;
 	sample.event.flags |= 2 << SAMPLE_FLAGS_SEVERITY_SHIFT;
 
-	if (info->callback) info->callback(DC_SAMPLE_EVENT, sample, info->userdata);
+	dc_sample_sink_emit(info->sink, DC_SAMPLE_EVENT, &sample);
 }
 
 
 static void sample_event_warning_type(const struct type_desc *desc, struct sample_data *info, unsigned char type)
 {
-	info->warning_type = lookup_enum(desc, type);
+	info->warning_type = lookup_enum(info->eon, desc, type);
 }
 
 static void sample_event_warning_value(const struct type_desc *desc, struct sample_data *info, unsigned char value)
@@ -731,12 +824,12 @@ static void sample_event_warning_value(const struct type_desc *desc, struct samp
 	sample.event.flags = value ? SAMPLE_FLAGS_BEGIN : SAMPLE_FLAGS_END;
 	sample.event.flags |= 3 << SAMPLE_FLAGS_SEVERITY_SHIFT;
 
-	if (info->callback) info->callback(DC_SAMPLE_EVENT, sample, info->userdata);
+	dc_sample_sink_emit(info->sink, DC_SAMPLE_EVENT, &sample);
 }
 
 static void sample_event_alarm_type(const struct type_desc *desc, struct sample_data *info, unsigned char type)
 {
-	info->alarm_type = lookup_enum(desc, type);
+	info->alarm_type = lookup_enum(info->eon, desc, type);
 }
 
 
@@ -754,14 +847,14 @@ static void sample_event_alarm_value(const struct type_desc *desc, struct sample
 	sample.event.flags = value ? SAMPLE_FLAGS_BEGIN : SAMPLE_FLAGS_END;
 	sample.event.flags |= 4 << SAMPLE_FLAGS_SEVERITY_SHIFT;
 
-	if (info->callback) info->callback(DC_SAMPLE_EVENT, sample, info->userdata);
+	dc_sample_sink_emit(info->sink, DC_SAMPLE_EVENT, &sample);
 }
 
 // enum:0=Low,1=High,2=Custom
 static void sample_setpoint_type(const struct type_desc *desc, struct sample_data *info, unsigned char value)
 {
 	dc_sample_value_t sample = {0};
-	const char *type = lookup_enum(desc, value);
+	const char *type = lookup_enum(info->eon, desc, value);
 
 	if (!type) {
 		DEBUG(info->eon->base.context, "sample_setpoint_type(%u) did not match anything in %s", value, desc->format);
@@ -776,12 +869,10 @@ static void sample_setpoint_type(const struct type_desc *desc, struct sample_dat
 		sample.ppo2 = info->eon->cache.customsetpoint;
 	else {
 		DEBUG(info->eon->base.context, "sample_setpoint_type(%u) unknown type '%s'", value, type);
-		free((void *)type);
 		return;
 	}
 
-	if (info->callback) info->callback(DC_SAMPLE_SETPOINT, sample, info->userdata);
-	free((void *)type);
+	dc_sample_sink_emit(info->sink, DC_SAMPLE_SETPOINT, &sample);
 }
 
 // uint32
@@ -939,7 +1030,7 @@ static int traverse_samples(unsigned short type, const struct type_desc *desc, c
 		sample.deco.type = DC_DECO_DECOSTOP;
 		sample.deco.time = info->tts;
 		sample.deco.depth = info->ceiling;
-		if (info->callback) info->callback(DC_SAMPLE_DECO, sample, info->userdata);
+		dc_sample_sink_emit(info->sink, DC_SAMPLE_DECO, &sample);
 	}
 
 	// Warn if there are left-over bytes for something we did use part of
@@ -949,10 +1040,10 @@ static int traverse_samples(unsigned short type, const struct type_desc *desc, c
 }
 
 static dc_status_t
-suunto_eonsteel_parser_samples_foreach(dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+suunto_eonsteel_parser_samples_decode(dc_parser_t *abstract, const dc_sample_sink_t *sink)
 {
 	suunto_eonsteel_parser_t *eon = (suunto_eonsteel_parser_t *) abstract;
-	struct sample_data data = { eon, callback, userdata, 0 };
+	struct sample_data data = { eon, sink, 0 };
 
 	traverse_data(eon, traverse_samples, &data);
 	return DC_STATUS_SUCCESS;
@@ -1111,7 +1202,7 @@ static int add_gas_type(suunto_eonsteel_parser_t *eon, const struct type_desc *d
 		return 0;
 
 	eon->cache.ngases = idx+1;
-	name = lookup_enum(desc, type);
+	name = lookup_enum(eon, desc, type);
 	if (!name)
 		DEBUG(eon->base.context, "Unable to look up gas type %u in %s", type, desc->format);
 	else if (!strcasecmp(name, "Diluent"))
@@ -1127,7 +1218,6 @@ static int add_gas_type(suunto_eonsteel_parser_t *eon, const struct type_desc *d
 
 	eon->cache.initialized |= 1 << DC_FIELD_GASMIX_COUNT;
 	eon->cache.initialized |= 1 << DC_FIELD_TANK_COUNT;
-	free((void *)name);
 	return 0;
 }
 
@@ -1180,7 +1270,7 @@ static int add_string(suunto_eonsteel_parser_t *eon, const char *desc, const cha
 		if (str->desc)
 			continue;
 		str->desc = desc;
-		str->value = strdup(value);
+		str->value = dc_arena_strdup(&eon->base.arena, value);
 		break;
 	}
 	return 0;
@@ -1526,8 +1616,7 @@ suunto_eonsteel_parser_set_data(dc_parser_t *parser, const unsigned char *data,
 {
 	suunto_eonsteel_parser_t *eon = (suunto_eonsteel_parser_t *) parser;
 
-	desc_free(eon->type_desc, MAXTYPE);
-	memset(eon->type_desc, 0, sizeof(eon->type_desc));
+	desc_free(eon);
 	initialize_field_caches(eon);
 	show_all_descriptors(eon);
 	return DC_STATUS_SUCCESS;
@@ -1538,7 +1627,7 @@ suunto_eonsteel_parser_destroy(dc_parser_t *parser)
 {
 	suunto_eonsteel_parser_t *eon = (suunto_eonsteel_parser_t *) parser;
 
-	desc_free(eon->type_desc, MAXTYPE);
+	desc_free(eon);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -1549,7 +1638,8 @@ static const dc_parser_vtable_t suunto_eonsteel_parser_vtable = {
 	suunto_eonsteel_parser_set_data, /* set_data */
 	suunto_eonsteel_parser_get_datetime, /* datetime */
 	suunto_eonsteel_parser_get_field, /* fields */
-	suunto_eonsteel_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_foreach */
+	suunto_eonsteel_parser_samples_decode, /* samples_decode */
 	suunto_eonsteel_parser_destroy /* destroy */
 };
 
@@ -1568,6 +1658,7 @@ suunto_eonsteel_parser_create(dc_parser_t **out, dc_context_t *context, unsigned
 	}
 
 	memset(&parser->type_desc, 0, sizeof(parser->type_desc));
+	memset(&parser->type_owned, 0, sizeof(parser->type_owned));
 	memset(&parser->cache, 0, sizeof(parser->cache));
 
 	*out = (dc_parser_t *) parser;
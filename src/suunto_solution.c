@@ -87,6 +87,8 @@ suunto_solution_device_open (dc_device_t **out, dc_context_t *context, const cha
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (1200 8N2).
 	status = dc_iostream_configure (device->iostream, 1200, 8, DC_PARITY_NONE, DC_STOPBITS_TWO, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -278,6 +280,8 @@ suunto_solution_device_foreach (dc_device_t *abstract, dc_dive_callback_t callba
 	}
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
+	device_image_set_memory (abstract, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+
 	rc = suunto_solution_extract_dives (abstract,
 		dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), callback, userdata);
 
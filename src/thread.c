@@ -0,0 +1,191 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2018 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+
+#include "thread.h"
+
+typedef struct dc_thread_start_t {
+	dc_thread_func_t func;
+	void *userdata;
+} dc_thread_start_t;
+
+#ifdef _WIN32
+static DWORD WINAPI
+dc_thread_start (LPVOID param)
+#else
+static void *
+dc_thread_start (void *param)
+#endif
+{
+	dc_thread_start_t start = *(dc_thread_start_t *) param;
+
+	free (param);
+
+	start.func (start.userdata);
+
+	return 0;
+}
+
+dc_status_t
+dc_thread_create (dc_thread_t *thread, dc_thread_func_t func, void *userdata)
+{
+	if (thread == NULL || func == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// The start parameters are released by the new thread.
+	dc_thread_start_t *start = (dc_thread_start_t *) malloc (sizeof (dc_thread_start_t));
+	if (start == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	start->func = func;
+	start->userdata = userdata;
+
+#ifdef _WIN32
+	*thread = CreateThread (NULL, 0, dc_thread_start, start, 0, NULL);
+	if (*thread == NULL) {
+		free (start);
+		return DC_STATUS_IO;
+	}
+#else
+	if (pthread_create (thread, NULL, dc_thread_start, start) != 0) {
+		free (start);
+		return DC_STATUS_IO;
+	}
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_thread_join (dc_thread_t *thread)
+{
+	if (thread == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef _WIN32
+	if (WaitForSingleObject (*thread, INFINITE) != WAIT_OBJECT_0)
+		return DC_STATUS_IO;
+
+	CloseHandle (*thread);
+#else
+	if (pthread_join (*thread, NULL) != 0)
+		return DC_STATUS_IO;
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_mutex_init (dc_mutex_t *mutex)
+{
+#ifdef _WIN32
+	InitializeSRWLock (mutex);
+#else
+	if (pthread_mutex_init (mutex, NULL) != 0)
+		return DC_STATUS_NOMEMORY;
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
+void
+dc_mutex_lock (dc_mutex_t *mutex)
+{
+#ifdef _WIN32
+	AcquireSRWLockExclusive (mutex);
+#else
+	pthread_mutex_lock (mutex);
+#endif
+}
+
+void
+dc_mutex_unlock (dc_mutex_t *mutex)
+{
+#ifdef _WIN32
+	ReleaseSRWLockExclusive (mutex);
+#else
+	pthread_mutex_unlock (mutex);
+#endif
+}
+
+void
+dc_mutex_free (dc_mutex_t *mutex)
+{
+#ifdef _WIN32
+	// Slim reader/writer locks do not need to be destroyed on Windows.
+#else
+	pthread_mutex_destroy (mutex);
+#endif
+}
+
+dc_status_t
+dc_cond_init (dc_cond_t *cond)
+{
+#ifdef _WIN32
+	InitializeConditionVariable (cond);
+#else
+	if (pthread_cond_init (cond, NULL) != 0)
+		return DC_STATUS_NOMEMORY;
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
+void
+dc_cond_wait (dc_cond_t *cond, dc_mutex_t *mutex)
+{
+#ifdef _WIN32
+	SleepConditionVariableSRW (cond, mutex, INFINITE, 0);
+#else
+	pthread_cond_wait (cond, mutex);
+#endif
+}
+
+void
+dc_cond_signal (dc_cond_t *cond)
+{
+#ifdef _WIN32
+	WakeConditionVariable (cond);
+#else
+	pthread_cond_signal (cond);
+#endif
+}
+
+void
+dc_cond_broadcast (dc_cond_t *cond)
+{
+#ifdef _WIN32
+	WakeAllConditionVariable (cond);
+#else
+	pthread_cond_broadcast (cond);
+#endif
+}
+
+void
+dc_cond_free (dc_cond_t *cond)
+{
+#ifdef _WIN32
+	// Condition variables do not need to be destroyed on Windows.
+#else
+	pthread_cond_destroy (cond);
+#endif
+}
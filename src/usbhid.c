@@ -127,6 +127,7 @@ static const dc_iostream_vtable_t dc_usbhid_vtable = {
 	NULL, /* configure */
 	dc_usbhid_read, /* read */
 	dc_usbhid_write, /* write */
+	NULL, /* writev */
 	NULL, /* flush */
 	NULL, /* purge */
 	NULL, /* sleep */
@@ -98,6 +98,8 @@ uwatec_aladin_device_open (dc_device_t **out, dc_context_t *context, const char
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (19200 8N1).
 	status = dc_iostream_configure (device->iostream, 19200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -275,6 +277,8 @@ uwatec_aladin_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback
 	devinfo.serial = array_uint24_be (data + HEADER + 0x7ed);
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
+	device_image_set_memory (abstract, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+
 	rc = uwatec_aladin_extract_dives (abstract,
 		dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), callback, userdata);
 
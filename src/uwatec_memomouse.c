@@ -94,6 +94,8 @@ uwatec_memomouse_device_open (dc_device_t **out, dc_context_t *context, const ch
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (9600 8N1).
 	status = dc_iostream_configure (device->iostream, 9600, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -108,6 +110,14 @@ uwatec_memomouse_device_open (dc_device_t **out, dc_context_t *context, const ch
 		goto error_close;
 	}
 
+	// Enable the receive buffer, to avoid reading the small packets
+	// with several system calls.
+	status = dc_iostream_set_buffer (device->iostream, 1024);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to enable the receive buffer.");
+		goto error_close;
+	}
+
 	// Clear the DTR line.
 	status = dc_iostream_set_dtr (device->iostream, 0);
 	if (status != DC_STATUS_SUCCESS) {
@@ -488,6 +498,8 @@ uwatec_memomouse_device_foreach (dc_device_t *abstract, dc_dive_callback_t callb
 		return rc;
 	}
 
+	device_image_set_memory (abstract, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+
 	rc = uwatec_memomouse_extract_dives (abstract,
 		dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), callback, userdata);
 
@@ -206,6 +206,8 @@ uwatec_smart_device_open (dc_device_t **out, dc_context_t *context)
 		goto error_device_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Perform the handshaking.
 	status = uwatec_smart_handshake (device);
 	if (status != DC_STATUS_SUCCESS) {
@@ -406,6 +408,8 @@ uwatec_smart_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback,
 		return rc;
 	}
 
+	device_image_set_memory (abstract, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+
 	rc = uwatec_smart_extract_dives (abstract,
 		dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), callback, userdata);
 
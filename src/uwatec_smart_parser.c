@@ -144,6 +144,8 @@ struct uwatec_smart_parser_t {
 	const uwatec_smart_header_info_t *header;
 	unsigned int headersize;
 	unsigned int nsamples;
+	unsigned int galileo;
+	unsigned char identify[256];
 	const uwatec_smart_event_info_t *events[NEVENTS];
 	unsigned int nevents[NEVENTS];
 	unsigned int trimix;
@@ -160,9 +162,10 @@ struct uwatec_smart_parser_t {
 static dc_status_t uwatec_smart_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
 static dc_status_t uwatec_smart_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t uwatec_smart_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
-static dc_status_t uwatec_smart_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t uwatec_smart_parser_samples_decode (dc_parser_t *abstract, const dc_sample_sink_t *sink);
 
-static dc_status_t uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback, void *userdata);
+static dc_status_t uwatec_smart_parse (uwatec_smart_parser_t *parser, const dc_sample_sink_t *sink);
+static void uwatec_smart_identify_init (uwatec_smart_parser_t *parser);
 
 static const dc_parser_vtable_t uwatec_smart_parser_vtable = {
 	sizeof(uwatec_smart_parser_t),
@@ -170,7 +173,8 @@ static const dc_parser_vtable_t uwatec_smart_parser_vtable = {
 	uwatec_smart_parser_set_data, /* set_data */
 	uwatec_smart_parser_get_datetime, /* datetime */
 	uwatec_smart_parser_get_field, /* fields */
-	uwatec_smart_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_foreach */
+	uwatec_smart_parser_samples_decode, /* samples_decode */
 	NULL /* destroy */
 };
 
@@ -668,6 +672,10 @@ uwatec_smart_parser_create (dc_parser_t **out, dc_context_t *context, unsigned i
 		goto error_free;
 	}
 
+	// Precompute the type bits lookup table.
+	parser->galileo = (parser->samples == uwatec_smart_galileo_samples);
+	uwatec_smart_identify_init (parser);
+
 	parser->cached = 0;
 	parser->ngasmixes = 0;
 	parser->ntanks = 0;
@@ -767,7 +775,7 @@ uwatec_smart_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsi
 
 	// Cache the profile data.
 	if (parser->cached < PROFILE) {
-		rc = uwatec_smart_parse (parser, NULL, NULL);
+		rc = uwatec_smart_parse (parser, NULL);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 	}
@@ -842,17 +850,17 @@ uwatec_smart_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsi
 
 
 static unsigned int
-uwatec_smart_identify (const unsigned char data[], unsigned int size)
+uwatec_smart_identify (const unsigned char table[], const unsigned char data[], unsigned int size)
 {
+	// The type is encoded as the number of leading one bits, which may
+	// span multiple bytes. The table contains the number of leading one
+	// bits for each byte value.
 	unsigned int count = 0;
 	for (unsigned int i = 0; i < size; ++i) {
-		unsigned char value = data[i];
-		for (unsigned int j = 0; j < NBITS; ++j) {
-			unsigned char mask = 1 << (NBITS - 1 - j);
-			if ((value & mask) == 0)
-				return count;
-			count++;
-		}
+		unsigned int n = table[data[i]];
+		count += n;
+		if (n < NBITS)
+			return count;
 	}
 
 	return (unsigned int) -1;
@@ -879,27 +887,43 @@ uwatec_galileo_identify (unsigned char value)
 }
 
 
+static void
+uwatec_smart_identify_init (uwatec_smart_parser_t *parser)
+{
+	for (unsigned int i = 0; i < 256; ++i) {
+		if (parser->galileo) {
+			// The Galileo type bits always fit in the first byte.
+			parser->identify[i] = uwatec_galileo_identify (i);
+		} else {
+			// Count the leading one bits.
+			unsigned int n = 0;
+			while (n < NBITS && (i & (0x80 >> n)))
+				n++;
+			parser->identify[i] = n;
+		}
+	}
+}
+
+
 static unsigned int
 uwatec_smart_fixsignbit (unsigned int x, unsigned int n)
 {
 	if (n <= 0 || n > 32)
 		return 0;
 
-	unsigned int signbit = (1 << (n - 1));
-	unsigned int mask = (signbit - 1);
+	unsigned int signbit = (1u << (n - 1));
+	unsigned int mask = (signbit << 1) - 1;
 
 	// When turning a two's-complement number with a certain number
 	// of bits into one with more bits, the sign bit must be repeated
-	// in all the extra bits.
-	if ((x & signbit) == signbit)
-		return x | ~mask;
-	else
-		return x & mask;
+	// in all the extra bits. Flipping the sign bit and subtracting it
+	// again does that without a branch.
+	return ((x & mask) ^ signbit) - signbit;
 }
 
 
 static dc_status_t
-uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback, void *userdata)
+uwatec_smart_parse (uwatec_smart_parser_t *parser, const dc_sample_sink_t *sink)
 {
 	dc_parser_t *abstract = (dc_parser_t *) parser;
 
@@ -952,16 +976,12 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 
 		// Process the type bits in the bitstream.
 		unsigned int id = 0;
-		if (parser->model == GALILEO || parser->model == GALILEOTRIMIX ||
-			parser->model == ALADIN2G || parser->model == MERIDIAN ||
-			parser->model == CHROMIS || parser->model == MANTIS2 ||
-			parser->model == G2 || parser->model == ALADINSPORTMATRIX ||
-			parser->model == ALADINSQUARE) {
+		if (parser->galileo) {
 			// Uwatec Galileo
-			id = uwatec_galileo_identify (data[offset]);
+			id = parser->identify[data[offset]];
 		} else {
 			// Uwatec Smart
-			id = uwatec_smart_identify (data + offset, size - offset);
+			id = uwatec_smart_identify (parser->identify, data + offset, size - offset);
 		}
 		if (id >= entries) {
 			ERROR (abstract->context, "Invalid type bits.");
@@ -1166,7 +1186,7 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 
 		while (complete) {
 			sample.time = time;
-			if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+			dc_sample_sink_emit (sink, DC_SAMPLE_TIME, &sample);
 
 			if (parser->ngasmixes && gasmix != gasmix_previous) {
 				idx = uwatec_smart_find_gasmix (parser, gasmix);
@@ -1175,13 +1195,13 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 					return DC_STATUS_DATAFORMAT;
 				}
 				sample.gasmix = idx;
-				if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
+				dc_sample_sink_emit (sink, DC_SAMPLE_GASMIX, &sample);
 				gasmix_previous = gasmix;
 			}
 
 			if (have_temperature) {
 				sample.temperature = temperature;
-				if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
+				dc_sample_sink_emit (sink, DC_SAMPLE_TEMPERATURE, &sample);
 			}
 
 			if (bookmark) {
@@ -1189,12 +1209,12 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 				sample.event.time = 0;
 				sample.event.flags = 0;
 				sample.event.value = 0;
-				if (callback) callback (DC_SAMPLE_EVENT, sample, userdata);
+				dc_sample_sink_emit (sink, DC_SAMPLE_EVENT, &sample);
 			}
 
 			if (have_rbt || have_pressure) {
 				sample.rbt = rbt;
-				if (callback) callback (DC_SAMPLE_RBT, sample, userdata);
+				dc_sample_sink_emit (sink, DC_SAMPLE_RBT, &sample);
 			}
 
 			if (have_pressure) {
@@ -1202,24 +1222,24 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 				if (idx < parser->ntanks) {
 					sample.pressure.tank = idx;
 					sample.pressure.value = pressure;
-					if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
+					dc_sample_sink_emit (sink, DC_SAMPLE_PRESSURE, &sample);
 				}
 			}
 
 			if (have_heartrate) {
 				sample.heartbeat = heartrate;
-				if (callback) callback (DC_SAMPLE_HEARTBEAT, sample, userdata);
+				dc_sample_sink_emit (sink, DC_SAMPLE_HEARTBEAT, &sample);
 			}
 
 			if (have_bearing) {
 				sample.bearing = bearing;
-				if (callback) callback (DC_SAMPLE_BEARING, sample, userdata);
+				dc_sample_sink_emit (sink, DC_SAMPLE_BEARING, &sample);
 				have_bearing = 0;
 			}
 
 			if (have_depth) {
 				sample.depth = (depth - depth_calibration) / salinity;
-				if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+				dc_sample_sink_emit (sink, DC_SAMPLE_DEPTH, &sample);
 			}
 
 			time += interval;
@@ -1234,7 +1254,7 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 
 
 static dc_status_t
-uwatec_smart_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+uwatec_smart_parser_samples_decode (dc_parser_t *abstract, const dc_sample_sink_t *sink)
 {
 	uwatec_smart_parser_t *parser = (uwatec_smart_parser_t *) abstract;
 
@@ -1245,10 +1265,10 @@ uwatec_smart_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t
 
 	// Cache the profile data.
 	if (parser->cached < PROFILE) {
-		rc = uwatec_smart_parse (parser, NULL, NULL);
+		rc = uwatec_smart_parse (parser, NULL);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 	}
 
-	return uwatec_smart_parse (parser, callback, userdata);
+	return uwatec_smart_parse (parser, sink);
 }